@@ -0,0 +1,114 @@
+/****************************************************************
+ * $ID: checksum.c                                              *
+ *                                                              *
+ * Description: byte-sum checksum shared by mkSmartQ and the    *
+ *              upgrade flasher.                                *
+ *                                                              *
+ * This file is free software;                                  *
+ *   you are free to modify and/or redistribute it   	        *
+ *   under the terms of the GNU General Public Licence (GPL).   *
+ *                                                              *
+ ****************************************************************/
+#include <string.h>
+
+#include "checksum.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/*
+ * Portable fallback: sum four bytes at a time in two 16-bit lanes.
+ * Each lane gains at most 2 * 255 per word, so the lanes are folded
+ * into the 32-bit total every 128 words before they can overflow.
+ */
+static uint32_t sum_words(const unsigned char *p, size_t len)
+{
+    uint32_t ret = 0, acc, w;
+    size_t n;
+
+    while (len >= 4) {
+	n = len / 4;
+	if (n > 128)
+	    n = 128;
+	len -= n * 4;
+	acc = 0;
+	while (n--) {
+	    memcpy(&w, p, 4);
+	    acc += (w & 0x00ff00ff) + ((w >> 8) & 0x00ff00ff);
+	    p += 4;
+	}
+	ret += (acc & 0xffff) + (acc >> 16);
+    }
+    while (len--)
+	ret += *p++;
+    return ret;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/* psadbw against zero leaves each 8-byte group's sum in a 64-bit lane */
+__attribute__((target("avx2")))
+static uint32_t sum_avx2(const unsigned char *p, size_t len)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i acc = zero;
+    uint64_t lanes[4];
+
+    for (; len >= 32; p += 32, len -= 32)
+	acc = _mm256_add_epi64(acc,
+		_mm256_sad_epu8(_mm256_loadu_si256((const __m256i *)p), zero));
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    return (uint32_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3])
+	   + sum_words(p, len);
+}
+#endif
+
+#if defined(__SSE2__)
+static uint32_t sum_sse2(const unsigned char *p, size_t len)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    uint64_t lanes[2];
+
+    for (; len >= 16; p += 16, len -= 16)
+	acc = _mm_add_epi64(acc,
+		_mm_sad_epu8(_mm_loadu_si128((const __m128i *)p), zero));
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    return (uint32_t)(lanes[0] + lanes[1]) + sum_words(p, len);
+}
+#endif
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+/* the 32-bit lanes may wrap: the result is only wanted modulo 2^32 */
+static uint32_t sum_neon(const unsigned char *p, size_t len)
+{
+    uint32x4_t acc = vdupq_n_u32(0);
+    uint32_t lanes[4];
+
+    for (; len >= 16; p += 16, len -= 16)
+	acc = vpadalq_u16(acc, vpaddlq_u8(vld1q_u8(p)));
+    vst1q_u32(lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_words(p, len);
+}
+#endif
+
+uint32_t fw_byte_sum(const unsigned char *buf, size_t len)
+{
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+    if (__builtin_cpu_supports("avx2"))
+	return sum_avx2(buf, len);
+#endif
+#if defined(__SSE2__)
+    return sum_sse2(buf, len);
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    return sum_neon(buf, len);
+#else
+    return sum_words(buf, len);
+#endif
+}
+
+/******************* End Of File: checksum.c *******************/
+// vim:sts=4:ts=8: 
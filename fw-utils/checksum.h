@@ -0,0 +1,27 @@
+/****************************************************************
+ * $ID: checksum.h                                              *
+ *                                                              *
+ * Description: byte-sum checksum shared by mkSmartQ and the    *
+ *              upgrade flasher.                                *
+ *                                                              *
+ * This file is free software;                                  *
+ *   you are free to modify and/or redistribute it   	        *
+ *   under the terms of the GNU General Public Licence (GPL).   *
+ *                                                              *
+ ****************************************************************/
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Sum of all bytes in buf, modulo 2^32.  This is the stanza check_sum
+ * of firmware_header.h and is bit-identical to the historic
+ * "int ret; ret += buffer[i]" loop.
+ */
+extern uint32_t fw_byte_sum(const unsigned char *buf, size_t len);
+
+#endif
+/******************* End Of File: checksum.h *******************/
+// vim:sts=4:ts=8: 
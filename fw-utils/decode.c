@@ -0,0 +1,271 @@
+/****************************************************************
+ * $ID: decode.c                                                *
+ *                                                              *
+ * Description: push-style stream decompressors for upgrade.    *
+ *                                                              *
+ * This file is free software;                                  *
+ *   you are free to modify and/or redistribute it   	        *
+ *   under the terms of the GNU General Public Licence (GPL).   *
+ *                                                              *
+ ****************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include <lzma.h>
+
+#include "decode.h"
+#include "lz4.h"
+
+#define DECODE_OUT_SIZE	(128 * 1024)
+
+struct decoder {
+    int codec;
+    decode_out out;
+    void *arg;
+    int ended;			/* saw the end of the last member */
+    z_stream z;
+    lzma_stream x;
+    unsigned char *lin, *lout;	/* one LZ4 block in and out */
+    uint32_t lneed, lhave;	/* block being gathered, 0: its size */
+    int lframed;		/* saw the magic */
+    unsigned char lsize[4];
+    unsigned char obuf[DECODE_OUT_SIZE];
+};
+
+int decode_sniff(const unsigned char *buf, size_t len)
+{
+    static const unsigned char gzip[] = { 0x1f, 0x8b };
+    static const unsigned char xz[] = { 0xfd, '7', 'z', 'X', 'Z', 0x00 };
+    static const unsigned char lz4[] = { 0x02, 0x21, 0x4c, 0x18 };
+
+    if (len >= sizeof(lz4) && !memcmp(buf, lz4, sizeof(lz4)))
+	return CODEC_LZ4;
+    if (len >= sizeof(xz) && !memcmp(buf, xz, sizeof(xz)))
+	return CODEC_XZ;
+    if (len >= sizeof(gzip) && !memcmp(buf, gzip, sizeof(gzip)))
+	return CODEC_GZIP;
+    return -1;
+}
+
+Decoder *decode_open(int codec, decode_out out, void *arg)
+{
+    Decoder *d = calloc(1, sizeof(*d));
+
+    if (d == NULL)
+	return NULL;
+    d->codec = codec;
+    d->out = out;
+    d->arg = arg;
+
+    switch (codec) {
+    case CODEC_NONE:
+	break;
+    case CODEC_GZIP:
+	/* 15 + 32: gzip or zlib header, detected */
+	if (inflateInit2(&d->z, 15 + 32) != Z_OK)
+	    goto fail;
+	break;
+    case CODEC_XZ:
+	d->x = (lzma_stream)LZMA_STREAM_INIT;
+	if (lzma_stream_decoder(&d->x, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+	    goto fail;
+	break;
+    case CODEC_LZ4:
+	d->lin = malloc(LZ4_BOUND(LZ4_LEGACY_BLOCK));
+	d->lout = malloc(LZ4_LEGACY_BLOCK);
+	if (d->lin == NULL || d->lout == NULL) {
+	    free(d->lin);
+	    free(d->lout);
+	    goto fail;
+	}
+	d->ended = 1;		/* clean until a block is half way */
+	break;
+    default:
+	goto fail;
+    }
+    return d;
+fail:
+    fprintf(stderr, "decode: can't set up codec %d\n", codec);
+    free(d);
+    return NULL;
+}
+
+static int all_zero(const unsigned char *p, size_t len)
+{
+    while (len--)
+	if (*p++)
+	    return 0;
+    return 1;
+}
+
+static int write_gzip(Decoder *d, const unsigned char *buf, size_t len)
+{
+    int ret;
+
+    d->z.next_in = (unsigned char *)buf;
+    d->z.avail_in = len;
+    while (d->z.avail_in > 0) {
+	/* concatenated members (pigz, mkSmartQ blocks) just carry on */
+	if (d->ended) {
+	    if (all_zero(d->z.next_in, d->z.avail_in))
+		return 0;	/* padding after the last member, as gzip -d */
+	    if (inflateReset(&d->z) != Z_OK)
+		return -1;
+	    d->ended = 0;
+	}
+	d->z.next_out = d->obuf;
+	d->z.avail_out = DECODE_OUT_SIZE;
+	ret = inflate(&d->z, Z_NO_FLUSH);
+	if (ret == Z_STREAM_END)
+	    d->ended = 1;
+	else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+	    fprintf(stderr, "decode: inflate fails: %s\n",
+		    d->z.msg ? d->z.msg : "?");
+	    return -1;
+	}
+	if (d->z.avail_out < DECODE_OUT_SIZE
+		&& d->out(d->obuf, DECODE_OUT_SIZE - d->z.avail_out, d->arg) < 0)
+	    return -1;
+    }
+    /* drain output still buffered inside inflate */
+    while (!d->ended) {
+	d->z.next_out = d->obuf;
+	d->z.avail_out = DECODE_OUT_SIZE;
+	ret = inflate(&d->z, Z_NO_FLUSH);
+	if (ret == Z_STREAM_END)
+	    d->ended = 1;
+	if (d->z.avail_out == DECODE_OUT_SIZE)
+	    break;
+	if (d->out(d->obuf, DECODE_OUT_SIZE - d->z.avail_out, d->arg) < 0)
+	    return -1;
+    }
+    return 0;
+}
+
+static int run_xz(Decoder *d, lzma_action action)
+{
+    lzma_ret ret;
+
+    do {
+	d->x.next_out = d->obuf;
+	d->x.avail_out = DECODE_OUT_SIZE;
+	ret = lzma_code(&d->x, action);
+	if (ret == LZMA_STREAM_END)
+	    d->ended = 1;
+	else if (ret != LZMA_OK && ret != LZMA_BUF_ERROR) {
+	    fprintf(stderr, "decode: xz fails (%d)\n", ret);
+	    return -1;
+	}
+	if (d->x.avail_out < DECODE_OUT_SIZE
+		&& d->out(d->obuf, DECODE_OUT_SIZE - d->x.avail_out, d->arg) < 0)
+	    return -1;
+    } while (d->x.avail_in > 0 || d->x.avail_out == 0);
+    return 0;
+}
+
+/*
+ * LZ4 legacy frames: gather each block whole, then decode it in one go.
+ * A magic where a block size is due starts a concatenated frame.
+ */
+static int write_lz4(Decoder *d, const unsigned char *buf, size_t len)
+{
+    uint32_t n;
+    long out;
+
+    while (len > 0) {
+	if (d->lneed == 0) {
+	    n = 4 - d->lhave;
+	    if (n > len)
+		n = len;
+	    memcpy(d->lsize + d->lhave, buf, n);
+	    d->lhave += n;
+	    buf += n;
+	    len -= n;
+	    d->ended = 0;
+	    if (d->lhave < 4)
+		continue;
+	    d->lhave = 0;
+	    n = d->lsize[0] | d->lsize[1] << 8 | d->lsize[2] << 16
+		| (uint32_t)d->lsize[3] << 24;
+	    if (n == LZ4_LEGACY_MAGIC) {
+		d->lframed = d->ended = 1;
+		continue;
+	    }
+	    if (!d->lframed || n == 0 || n > LZ4_BOUND(LZ4_LEGACY_BLOCK)) {
+		fprintf(stderr, "decode: bad lz4 block size %u\n", n);
+		return -1;
+	    }
+	    d->lneed = n;
+	    continue;
+	}
+	n = d->lneed - d->lhave;
+	if (n > len)
+	    n = len;
+	memcpy(d->lin + d->lhave, buf, n);
+	d->lhave += n;
+	buf += n;
+	len -= n;
+	if (d->lhave < d->lneed)
+	    continue;
+
+	out = lz4_decompress(d->lin, d->lneed, d->lout, LZ4_LEGACY_BLOCK);
+	if (out < 0) {
+	    fprintf(stderr, "decode: corrupt lz4 block\n");
+	    return -1;
+	}
+	d->lneed = d->lhave = 0;
+	d->ended = 1;
+	if (out && d->out(d->lout, out, d->arg) < 0)
+	    return -1;
+    }
+    return 0;
+}
+
+int decode_write(Decoder *d, const unsigned char *buf, size_t len)
+{
+    switch (d->codec) {
+    case CODEC_NONE:
+	return len ? d->out(buf, len, d->arg) : 0;
+    case CODEC_GZIP:
+	return write_gzip(d, buf, len);
+    case CODEC_XZ:
+	d->x.next_in = buf;
+	d->x.avail_in = len;
+	return run_xz(d, LZMA_RUN);
+    case CODEC_LZ4:
+	return write_lz4(d, buf, len);
+    }
+    return -1;
+}
+
+int decode_close(Decoder *d)
+{
+    int ret = 0;
+
+    switch (d->codec) {
+    case CODEC_GZIP:
+	if (!d->ended)
+	    ret = -1;
+	inflateEnd(&d->z);
+	break;
+    case CODEC_XZ:
+	/* LZMA_CONCATENATED only reports the end once told there is no more */
+	d->x.avail_in = 0;
+	if (run_xz(d, LZMA_FINISH) < 0 || !d->ended)
+	    ret = -1;
+	lzma_end(&d->x);
+	break;
+    case CODEC_LZ4:
+	if (!d->ended)
+	    ret = -1;
+	free(d->lin);
+	free(d->lout);
+	break;
+    }
+    free(d);
+    return ret;
+}
+
+/******************* End Of File: decode.c *******************/
+// vim:sts=4:ts=8: 
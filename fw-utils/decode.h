@@ -0,0 +1,38 @@
+/****************************************************************
+ * $ID: decode.h                                                *
+ *                                                              *
+ * Description: push-style stream decompressors for upgrade.    *
+ *                                                              *
+ * This file is free software;                                  *
+ *   you are free to modify and/or redistribute it   	        *
+ *   under the terms of the GNU General Public Licence (GPL).   *
+ *                                                              *
+ ****************************************************************/
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "firmware_header.h"	/* enum codecs */
+
+/* receives decoded bytes; returns 0, or -1 to abort decoding */
+typedef int (*decode_out)(const unsigned char *buf, size_t len, void *arg);
+
+typedef struct decoder Decoder;
+
+/* guess the codec from the first bytes of a stream (gzip/xz/lz4 magic) */
+extern int decode_sniff(const unsigned char *buf, size_t len);
+
+extern Decoder *decode_open(int codec, decode_out out, void *arg);
+/* feed compressed bytes; decoded output is pushed to out as it appears */
+extern int decode_write(Decoder *d, const unsigned char *buf, size_t len);
+/*
+ * returns 0 only if the stream ended cleanly; always frees d.  Prints
+ * nothing: closing early on purpose (extract --get) is not an error.
+ */
+extern int decode_close(Decoder *d);
+
+#endif
+/******************* End Of File: decode.h *******************/
+// vim:sts=4:ts=8: 
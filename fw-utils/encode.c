@@ -0,0 +1,438 @@
+/****************************************************************
+ * $ID: encode.c                                                *
+ *                                                              *
+ * Description: stream compressors for mkSmartQ sections.       *
+ *                                                              *
+ * This file is free software;                                  *
+ *   you are free to modify and/or redistribute it   	        *
+ *   under the terms of the GNU General Public Licence (GPL).   *
+ *                                                              *
+ ****************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <lzma.h>
+
+#include "encode.h"
+#include "checksum.h"
+#include "lz4.h"
+
+/*
+ * The input is cut into blocks that are compressed independently, by a
+ * pool of worker threads, and written out in order by the caller's
+ * thread.  Each codec has a way of chaining such blocks that any decoder
+ * takes as one stream:
+ *   gzip  one member per block, as pigz -i; gzip -d and busybox
+ *         concatenate members
+ *   xz    one xz Block per block, in a single stream with one index,
+ *         as xz -T
+ *   lz4   the legacy frame is made of independent 8MB blocks anyway
+ */
+#define GZIP_BLOCK	(1024 * 1024)
+#define XZ_BLOCK	(8 * 1024 * 1024)
+#define XZ_PRESET	6
+
+enum { JOB_FREE, JOB_FILLED, JOB_BUSY, JOB_DONE };
+
+typedef struct job {
+    unsigned char *in, *out;
+    size_t inlen, outlen;
+    lzma_vli unpadded;		/* xz: for the index */
+    int state;
+    int err;
+} Job;
+
+static const char *codec_names[MAX_CODECS] = {
+    [CODEC_NONE] = "none",
+    [CODEC_GZIP] = "gzip",
+    [CODEC_XZ]   = "xz",
+    [CODEC_LZ4]  = "lz4",
+};
+
+struct encoder {
+    int codec;
+    int fd;
+    uint32_t size, sum;		/* written to fd so far */
+    size_t block, bound;	/* in and out size of a job */
+    int njobs, nthreads;
+    Job *job;
+    unsigned fill, head;	/* job being filled, oldest not written */
+    pthread_t *thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work, done;
+    int quit;
+    lzma_index *xi;
+    lzma_stream_flags xflags;
+    uint32_t **offsets, *count;	/* encode_track() */
+};
+
+int encode_codec(const char *name)
+{
+    int i;
+
+    for (i = 0; i < MAX_CODECS; i++)
+	if (strcmp(name, codec_names[i]) == 0)
+	    return i;
+    return -1;
+}
+
+const char *encode_name(int codec)
+{
+    return codec >= 0 && codec < MAX_CODECS ? codec_names[codec] : "?";
+}
+
+size_t encode_block_size(int codec)
+{
+    switch (codec) {
+    case CODEC_GZIP:
+	return GZIP_BLOCK;
+    case CODEC_XZ:
+	return XZ_BLOCK;
+    case CODEC_LZ4:
+	return LZ4_LEGACY_BLOCK;
+    }
+    return 0;
+}
+
+void encode_track(Encoder *e, uint32_t **offsets, uint32_t *count)
+{
+    e->offsets = offsets;
+    e->count = count;
+}
+
+static int track(Encoder *e)
+{
+    uint32_t *p;
+
+    if ((*e->count & 255) == 0) {
+	p = realloc(*e->offsets, (*e->count + 256) * sizeof(*p));
+	if (p == NULL)
+	    return -1;
+	*e->offsets = p;
+    }
+    (*e->offsets)[(*e->count)++] = e->size;
+    return 0;
+}
+
+static int put(Encoder *e, const unsigned char *p, size_t len)
+{
+    ssize_t n;
+
+    e->size += len;
+    e->sum += fw_byte_sum(p, len);
+    while (len > 0) {
+	n = write(e->fd, p, len);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return -1;
+	p += n;
+	len -= n;
+    }
+    return 0;
+}
+
+static int gzip_block(Job *j, size_t cap)
+{
+    z_stream z;
+    int ret;
+
+    memset(&z, 0, sizeof(z));
+    /* 15 + 16: gzip wrapper, so "gzip -d" takes the section as is */
+    if (deflateInit2(&z, 9, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+	return -1;
+    z.next_in = j->in;
+    z.avail_in = j->inlen;
+    z.next_out = j->out;
+    z.avail_out = cap;
+    ret = deflate(&z, Z_FINISH);
+    j->outlen = cap - z.avail_out;
+    deflateEnd(&z);
+    return ret == Z_STREAM_END ? 0 : -1;
+}
+
+static int xz_block(Job *j, size_t cap)
+{
+    lzma_options_lzma opt;
+    lzma_filter filters[2];
+    lzma_block block;
+
+    if (lzma_lzma_preset(&opt, XZ_PRESET))
+	return -1;
+    filters[0].id = LZMA_FILTER_LZMA2;
+    filters[0].options = &opt;
+    filters[1].id = LZMA_VLI_UNKNOWN;
+    filters[1].options = NULL;
+    memset(&block, 0, sizeof(block));
+    block.version = 0;
+    block.check = LZMA_CHECK_CRC32;
+    block.filters = filters;
+
+    j->outlen = 0;
+    if (lzma_block_buffer_encode(&block, NULL, j->in, j->inlen,
+		j->out, &j->outlen, cap) != LZMA_OK)
+	return -1;
+    j->unpadded = lzma_block_unpadded_size(&block);
+    return 0;
+}
+
+static int lz4_block(Job *j)
+{
+    size_t n = lz4_compress(j->in, j->inlen, j->out + 4);
+
+    j->out[0] = n;
+    j->out[1] = n >> 8;
+    j->out[2] = n >> 16;
+    j->out[3] = n >> 24;
+    j->outlen = n + 4;
+    return 0;
+}
+
+static void *worker(void *arg)
+{
+    Encoder *e = arg;
+    Job *j;
+    unsigned i;
+    int err;
+
+    pthread_mutex_lock(&e->lock);
+    for (;;) {
+	/* the oldest filled job first, so the writer waits the least */
+	for (j = NULL, i = e->head; i != e->fill; i++)
+	    if (e->job[i % e->njobs].state == JOB_FILLED) {
+		j = &e->job[i % e->njobs];
+		break;
+	    }
+	if (j == NULL) {
+	    if (e->quit)
+		break;
+	    pthread_cond_wait(&e->work, &e->lock);
+	    continue;
+	}
+	j->state = JOB_BUSY;
+	pthread_mutex_unlock(&e->lock);
+
+	switch (e->codec) {
+	case CODEC_GZIP:
+	    err = gzip_block(j, e->bound);
+	    break;
+	case CODEC_XZ:
+	    err = xz_block(j, e->bound);
+	    break;
+	default:
+	    err = lz4_block(j);
+	    break;
+	}
+
+	pthread_mutex_lock(&e->lock);
+	j->err = err;
+	j->state = JOB_DONE;
+	pthread_cond_broadcast(&e->done);
+    }
+    pthread_mutex_unlock(&e->lock);
+    return NULL;
+}
+
+/* write out the oldest job once it is compressed */
+static int drain_one(Encoder *e)
+{
+    Job *j = &e->job[e->head % e->njobs];
+    int ret;
+
+    pthread_mutex_lock(&e->lock);
+    while (j->state != JOB_DONE)
+	pthread_cond_wait(&e->done, &e->lock);
+    pthread_mutex_unlock(&e->lock);
+
+    ret = j->err || (e->offsets && track(e) < 0) ? -1 : put(e, j->out, j->outlen);
+    if (ret == 0 && e->codec == CODEC_XZ
+	    && lzma_index_append(e->xi, NULL, j->unpadded, j->inlen) != LZMA_OK)
+	ret = -1;
+
+    pthread_mutex_lock(&e->lock);
+    j->state = JOB_FREE;
+    j->inlen = 0;
+    e->head++;
+    pthread_mutex_unlock(&e->lock);
+    return ret;
+}
+
+static void submit(Encoder *e)
+{
+    pthread_mutex_lock(&e->lock);
+    e->job[e->fill % e->njobs].state = JOB_FILLED;
+    e->fill++;
+    pthread_cond_signal(&e->work);
+    pthread_mutex_unlock(&e->lock);
+}
+
+static void stop_workers(Encoder *e)
+{
+    int i;
+
+    pthread_mutex_lock(&e->lock);
+    e->quit = 1;
+    pthread_cond_broadcast(&e->work);
+    pthread_mutex_unlock(&e->lock);
+    for (i = 0; i < e->nthreads; i++)
+	pthread_join(e->thread[i], NULL);
+}
+
+static void free_encoder(Encoder *e)
+{
+    int i;
+
+    if (e->job)
+	for (i = 0; i < e->njobs; i++) {
+	    free(e->job[i].in);
+	    free(e->job[i].out);
+	}
+    free(e->job);
+    free(e->thread);
+    if (e->xi)
+	lzma_index_end(e->xi, NULL);
+    pthread_mutex_destroy(&e->lock);
+    pthread_cond_destroy(&e->work);
+    pthread_cond_destroy(&e->done);
+    free(e);
+}
+
+Encoder *encode_open(int codec, int fd, int threads)
+{
+    static const unsigned char lz4_magic[4] = { 0x02, 0x21, 0x4c, 0x18 };
+    unsigned char xz_header[LZMA_STREAM_HEADER_SIZE];
+    Encoder *e = calloc(1, sizeof(*e));
+    int i;
+
+    if (e == NULL)
+	return NULL;
+    e->codec = codec;
+    e->fd = fd;
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->work, NULL);
+    pthread_cond_init(&e->done, NULL);
+
+    e->block = encode_block_size(codec);
+    switch (codec) {
+    case CODEC_NONE:
+	return e;
+    case CODEC_GZIP:
+	e->bound = compressBound(GZIP_BLOCK) + 32;	/* + gzip wrapper */
+	break;
+    case CODEC_XZ:
+	e->bound = lzma_block_buffer_bound(XZ_BLOCK);
+	e->xi = lzma_index_init(NULL);
+	e->xflags.version = 0;
+	e->xflags.check = LZMA_CHECK_CRC32;
+	if (e->xi == NULL || lzma_stream_header_encode(&e->xflags, xz_header) != LZMA_OK
+		|| put(e, xz_header, sizeof(xz_header)) < 0)
+	    goto fail;
+	break;
+    case CODEC_LZ4:
+	e->bound = LZ4_BOUND(LZ4_LEGACY_BLOCK) + 4;
+	if (put(e, lz4_magic, sizeof(lz4_magic)) < 0)
+	    goto fail;
+	break;
+    default:
+	goto fail;
+    }
+
+    /* one job more than workers keeps them busy while one is written */
+    e->nthreads = threads > 0 ? threads : 1;
+    e->njobs = e->nthreads + 2;
+    e->job = calloc(e->njobs, sizeof(Job));
+    e->thread = calloc(e->nthreads, sizeof(pthread_t));
+    if (e->job == NULL || e->thread == NULL)
+	goto fail;
+    for (i = 0; i < e->njobs; i++) {
+	e->job[i].in = malloc(e->block);
+	e->job[i].out = malloc(e->bound);
+	if (e->job[i].in == NULL || e->job[i].out == NULL)
+	    goto fail;
+    }
+    for (i = 0; i < e->nthreads; i++)
+	if (pthread_create(&e->thread[i], NULL, worker, e)) {
+	    e->nthreads = i;
+	    stop_workers(e);
+	    goto fail;
+	}
+    return e;
+fail:
+    printf("encode: can't set up %s\n", encode_name(codec));
+    free_encoder(e);
+    return NULL;
+}
+
+int encode_write(Encoder *e, const unsigned char *buf, size_t len)
+{
+    Job *j;
+    size_t n;
+
+    if (e->codec == CODEC_NONE)
+	return put(e, buf, len);
+
+    while (len > 0) {
+	j = &e->job[e->fill % e->njobs];
+	n = e->block - j->inlen;
+	if (n > len)
+	    n = len;
+	memcpy(j->in + j->inlen, buf, n);
+	j->inlen += n;
+	buf += n;
+	len -= n;
+	if (j->inlen < e->block)
+	    break;
+	submit(e);
+	/* the next job to fill must have been written out */
+	if (e->fill - e->head == (unsigned)e->njobs && drain_one(e) < 0)
+	    return -1;
+    }
+    return 0;
+}
+
+static int finish_xz(Encoder *e)
+{
+    unsigned char footer[LZMA_STREAM_HEADER_SIZE], *index;
+    size_t pos = 0;
+    int ret;
+
+    e->xflags.backward_size = lzma_index_size(e->xi);
+    index = malloc(e->xflags.backward_size);
+    if (index == NULL)
+	return -1;
+    ret = lzma_index_buffer_encode(e->xi, index, &pos, e->xflags.backward_size) != LZMA_OK
+	|| lzma_stream_footer_encode(&e->xflags, footer) != LZMA_OK
+	|| put(e, index, pos) < 0
+	|| put(e, footer, sizeof(footer)) < 0 ? -1 : 0;
+    free(index);
+    return ret;
+}
+
+int encode_close(Encoder *e, uint32_t *size, uint32_t *sum)
+{
+    int ret = 0;
+
+    if (e->codec != CODEC_NONE) {
+	if (e->job[e->fill % e->njobs].inlen)
+	    submit(e);
+	while (e->head != e->fill)
+	    if (drain_one(e) < 0)
+		ret = -1;
+	stop_workers(e);
+	if (ret == 0 && e->offsets && track(e) < 0)
+	    ret = -1;
+	if (ret == 0 && e->codec == CODEC_XZ)
+	    ret = finish_xz(e);
+    }
+    *size = e->size;
+    *sum = e->sum;
+    free_encoder(e);
+    return ret;
+}
+
+/******************* End Of File: encode.c *******************/
+// vim:sts=4:ts=8: 
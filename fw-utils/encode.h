@@ -0,0 +1,49 @@
+/****************************************************************
+ * $ID: encode.h                                                *
+ *                                                              *
+ * Description: stream compressors for mkSmartQ sections.       *
+ *                                                              *
+ * This file is free software;                                  *
+ *   you are free to modify and/or redistribute it   	        *
+ *   under the terms of the GNU General Public Licence (GPL).   *
+ *                                                              *
+ ****************************************************************/
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "firmware_header.h"	/* enum codecs */
+
+typedef struct encoder Encoder;
+
+/* "none", "gzip", "lz4" or "xz" to enum codecs; -1 if unknown */
+extern int encode_codec(const char *name);
+extern const char *encode_name(int codec);
+
+/*
+ * Compressed output goes to fd, appended at its current offset.  The
+ * input is compressed in independent blocks by threads workers, so the
+ * output is the multi-member/multi-block form of the codec.
+ */
+extern Encoder *encode_open(int codec, int fd, int threads);
+extern int encode_write(Encoder *e, const unsigned char *buf, size_t len);
+/*
+ * Append the offset, from the start of the stream, of each block as it is
+ * written to *offsets, and at encode_close() the offset where the blocks
+ * end.  *offsets is realloc'ed and left to the caller to free.  Call it
+ * before the first encode_write().
+ */
+extern void encode_track(Encoder *e, uint32_t **offsets, uint32_t *count);
+/* what one block of codec decodes to */
+extern size_t encode_block_size(int codec);
+/*
+ * Flush the stream; *size is what was written to fd and *sum its byte
+ * sum.  Always frees e.
+ */
+extern int encode_close(Encoder *e, uint32_t *size, uint32_t *sum);
+
+#endif
+/******************* End Of File: encode.h *******************/
+// vim:sts=4:ts=8: 
@@ -70,8 +70,8 @@ int extract(char *filename, firmware_fileheader *fw_fh)
     read(fd, (void *)fw_fh, sizeof(firmware_fileheader));
 
     fprintf(stderr, "fw_fh->magic = %x\n", fw_fh->magic);
-    if(fw_fh->magic != 0x39000032) {
-	fprintf(stderr, "ERROR: magic != 0x39000032\n");
+    if(fw_fh->magic != HEAD_MAGIC && fw_fh->magic != HEAD_MAGIC_EXT) {
+	fprintf(stderr, "ERROR: magic != 0x%x\n", HEAD_MAGIC);
 	return -1;
     }
 
@@ -138,5 +138,371 @@ int extract(char *filename, firmware_fileheader *fw_fh)
     return 0;
 }
 
+#define FW_EXT_MAX_SIZE     (1024 * 1024)
+
+/*
+ * Read the header extension that follows the header, if there is one.
+ * Returns 0 with *ext set to NULL for a plain firmware file and -1 if the
+ * extension is there but damaged or its extent lists don't match the
+ * stanzas.  The caller frees *ext.
+ */
+int extract_ext(char *filename, firmware_fileheader *fw_fh, FWHeaderExt **ext)
+{
+    FWHeaderExt head, *fx;
+    struct fw_extent *ep;
+    struct stanza *stp;
+    uint32_t i, j, sum, data, blocks;
+    int fd, ret = -1;
+
+    *ext = NULL;
+    fd = open(filename, O_RDONLY);
+    if(fd == -1) {
+	fprintf(stderr, "extract_ext: open %s failed\n", filename);
+	return -1;
+    }
+    if(pread(fd, &head, sizeof(head), fw_fh->fh_size) != sizeof(head)
+	    || head.magic != FW_EXT_MAGIC) {
+	close(fd);
+	if(fw_fh->magic == HEAD_MAGIC_EXT) {
+	    fprintf(stderr, "ERROR: header extension missing\n");
+	    return -1;
+	}
+	return 0;
+    }
+    if(head.version != FW_EXT_VERSION || head.size < sizeof(head) 
+	    || head.size > FW_EXT_MAX_SIZE) {
+	fprintf(stderr, "ERROR: header extension version %d size %d\n",
+	    head.version, head.size);
+	goto out;
+    }
+    fx = malloc(head.size);
+    if(fx == NULL || pread(fd, fx, head.size, fw_fh->fh_size) != head.size) {
+	fprintf(stderr, "ERROR: can't read the header extension\n");
+	free(fx);
+	goto out;
+    }
+    for(i = 8, sum = 0; i < fx->size; i++)
+	sum += ((uint8_t *)fx)[i];
+    if(sum != fx->check_sum) {
+	fprintf(stderr, "ERROR: extension checksum = 0x%x calc'ed 0x%x\n",
+	    fx->check_sum, sum);
+	free(fx);
+	goto out;
+    }
+
+    for(i = QI; i < fw_fh->component_count && i < MAX_SECTIONS; i++) {
+        stp = (struct stanza *) ((void*) fw_fh + sects[i].stanzaOffset);
+	if(fx->sect[i].codec >= MAX_CODECS || (fx->sect[i].codec == CODEC_NONE 
+		    && fx->sect[i].size != stp->file.size)) {
+	    fprintf(stderr, "ERROR: %s codec %d size %d\n", sects[i].name,
+		fx->sect[i].codec, fx->sect[i].size);
+	    free(fx);
+	    goto out;
+	}
+	if(fx->sect[i].codec != CODEC_NONE)
+	    fprintf(stderr, "%10s codec       = %d (%d bytes decoded)\n", sects[i].name,
+		fx->sect[i].codec, fx->sect[i].size);
+	if(fx->sect[i].extent_offset == 0) {
+	    if(fx->sect[i].size != stp->nand.size) {
+		fprintf(stderr, "ERROR: %s decodes to %d bytes, not %d\n", 
+		    sects[i].name, fx->sect[i].size, stp->nand.size);
+		free(fx);
+		goto out;
+	    }
+	    continue;
+	}
+	/* filesystems are written by loading_fs()/loading_image() only */
+	if(i >= ROOTFS || fx->sect[i].extent_offset < sizeof(*fx) || fx->sect[i].extent_count
+		> (fx->size - fx->sect[i].extent_offset) / sizeof(*ep)) {
+	    fprintf(stderr, "ERROR: %s extent list out of bounds\n", sects[i].name);
+	    free(fx);
+	    goto out;
+	}
+	/* in order, inside nand.size, and adding up to what is stored */
+	ep = (struct fw_extent *)((void *)fx + fx->sect[i].extent_offset);
+	blocks = (stp->nand.size + NANDBLKSIZE - 1) / NANDBLKSIZE;
+	for(j = 0, data = 0; j < fx->sect[i].extent_count; j++) {
+	    if((j && ep[j].block < ep[j - 1].block + ep[j - 1].count)
+		    || ep[j].count == 0 || ep[j].block >= blocks
+		    || ep[j].count > blocks - ep[j].block)
+		break;
+	    if((ep[j].block + ep[j].count) * NANDBLKSIZE > stp->nand.size)
+		data += stp->nand.size - ep[j].block * NANDBLKSIZE;
+	    else
+		data += ep[j].count * NANDBLKSIZE;
+	}
+	if(j != fx->sect[i].extent_count || data != fx->sect[i].size) {
+	    fprintf(stderr, "ERROR: %s extents don't match the stanza\n", sects[i].name);
+	    free(fx);
+	    goto out;
+	}
+        fprintf(stderr, "%10s extents     = %d (%d of %d bytes stored)\n", sects[i].name,
+	    fx->sect[i].extent_count, data, stp->nand.size);
+    }
+    *ext = fx;
+    ret = 0;
+out:
+    close(fd);
+    return ret;
+}
+
+/*
+ * The bytes of the file upgrade reads, which its progress bar and its
+ * rootfs size check count: the header, u-boot, zImage and initramfs twice
+ * (once for each copy), the rootfs and, unless it is kept, the homefs.
+ * Summed from the stanzas: homefs.file.offset would also take in qi,
+ * which upgrade doesn't write, and the header extension.
+ */
+uint32_t fw_upgrade_size(firmware_fileheader *fw_fh, int with_homefs)
+{
+    uint32_t size;
+
+    size = 2 * (fw_fh->fh_size + fw_fh->u_boot.file.size
+	    + fw_fh->zimage.file.size + fw_fh->initramfs.file.size);
+    size += fw_fh->rootfs.file.size;
+    if(with_homefs)
+	size += fw_fh->homefs.file.size;
+    return size;
+}
+
+#ifdef EXTRACT_MAIN
+/*
+ * Host tool: "extract fw.bin" checks and prints the header as upgrade
+ * does, "--list" lists the files of the indexed filesystems and "--get
+ * path" writes one of them to stdout, decoding only the blocks it is in.
+ * Both need the seek index of mkSmartQ --index.
+ */
+#include "decode.h"
+
+#define FW_INDEX_MAX_SIZE   (64 * 1024 * 1024)
+#define GET_READ_SIZE       (64 * 1024)
+
+static FWIndex *read_index(int fd)
+{
+    struct fw_index_tail tail;
+    FWIndex head, *ix;
+    off_t end = lseek(fd, 0, SEEK_END);
+    uint32_t i, sum;
+
+    if(end < (off_t)sizeof(tail) 
+	    || pread(fd, &tail, sizeof(tail), end - sizeof(tail)) != sizeof(tail)
+	    || tail.magic != FW_INDEX_MAGIC
+	    || pread(fd, &head, sizeof(head), tail.offset) != sizeof(head)
+	    || head.magic != FW_INDEX_MAGIC) {
+	fprintf(stderr, "ERROR: no seek index, make the file with mkSmartQ --index\n");
+	return NULL;
+    }
+    if(head.version != FW_INDEX_VERSION || head.size < sizeof(head) 
+	    || head.size > FW_INDEX_MAX_SIZE) {
+	fprintf(stderr, "ERROR: seek index version %d size %d\n", head.version, head.size);
+	return NULL;
+    }
+    ix = malloc(head.size);
+    if(ix == NULL || pread(fd, ix, head.size, tail.offset) != head.size) {
+	fprintf(stderr, "ERROR: can't read the seek index\n");
+	free(ix);
+	return NULL;
+    }
+    for(i = 8, sum = 0; i < ix->size; i++)
+	sum += ((uint8_t *)ix)[i];
+    if(sum != ix->check_sum) {
+	fprintf(stderr, "ERROR: seek index checksum = 0x%x calc'ed 0x%x\n", ix->check_sum, sum);
+	free(ix);
+	return NULL;
+    }
+    for(i = QI; i < MAX_SECTIONS; i++) {
+	struct section_index *si = &ix->sect[i];
+
+	if(si->block_size && (si->block_count == 0 
+		|| si->block_offset > ix->size || si->block_count
+		    >= (ix->size - si->block_offset) / sizeof(uint32_t)
+		|| si->member_offset > ix->size || si->member_count
+		    > (ix->size - si->member_offset) / sizeof(struct fw_index_member))) {
+	    fprintf(stderr, "ERROR: %s seek index out of bounds\n", sects[i].name);
+	    free(ix);
+	    return NULL;
+	}
+    }
+    return ix;
+}
+
+static const char *member_name(FWIndex *ix, struct fw_index_member *mp)
+{
+    const char *name = (const char *)ix + mp->name;
+
+    if(mp->name >= ix->size || memchr(name, '\0', ix->size - mp->name) == NULL)
+	return "?";
+    return name;
+}
+
+/* archive names as the user gives them: no leading "/" or "./" */
+static const char *plain_name(const char *name)
+{
+    for(;;) {
+	if(name[0] == '/')
+	    name++;
+	else if(name[0] == '.' && name[1] == '/')
+	    name += 2;
+	else
+	    return name;
+    }
+}
+
+typedef struct get_ctx {
+    uint32_t skip;		/* decoded bytes before the member */
+    uint32_t left;		/* and of it still to write */
+} GetCtx;
+
+static int get_sink(const unsigned char *buf, size_t len, void *arg)
+{
+    GetCtx *g = arg;
+    ssize_t n;
+
+    if(len <= g->skip) {
+	g->skip -= len;
+	return 0;
+    }
+    buf += g->skip;
+    len -= g->skip;
+    g->skip = 0;
+    if(len > g->left)
+	len = g->left;
+    for(g->left -= len; len > 0; buf += n, len -= n) {
+	n = write(1, buf, len);
+	if(n < 0 && errno == EINTR)
+	    n = 0;
+	else if(n <= 0)
+	    return -1;
+    }
+    /* stops the decoder once the member is out */
+    return g->left ? 0 : -1;
+}
+
+/*
+ * Decode the stream header, then the blocks the member is in.  Stopping
+ * where they end keeps the decoder off whatever follows (the xz index
+ * would not match), so it never fails before the member is out.
+ */
+static int get_member(int fd, struct stanza *stp, int codec, 
+	FWIndex *ix, struct section_index *si, struct fw_index_member *mp)
+{
+    uint32_t *blocks = (void *)ix + si->block_offset;
+    uint32_t b = mp->offset / si->block_size;
+    uint32_t e = ((uint64_t)mp->offset + mp->size - 1) / si->block_size + 1;
+    unsigned char *buf;
+    Decoder *dec;
+    GetCtx g;
+    off_t pos, end;
+    ssize_t n;
+
+    g.skip = mp->offset - b * si->block_size;
+    g.left = mp->size;
+    if(g.left == 0)
+	return 0;
+    if(e > si->block_count || blocks[0] > blocks[b] || blocks[b] > blocks[e]
+	    || blocks[e] > stp->file.size) {
+	fprintf(stderr, "ERROR: %s is past the end of the section\n", member_name(ix, mp));
+	return -1;
+    }
+    buf = malloc(GET_READ_SIZE);
+    dec = decode_open(codec, get_sink, &g);
+    if(buf == NULL || dec == NULL) {
+	fprintf(stderr, "ERROR: can't set up the decoder\n");
+	free(buf);
+	return -1;
+    }
+    n = blocks[0];
+    if(n && (pread(fd, buf, n, stp->file.offset) != n || decode_write(dec, buf, n) < 0))
+	g.left = 1;
+    end = (off_t)stp->file.offset + blocks[e];
+    for(pos = stp->file.offset + blocks[b]; g.left && pos < end; pos += n) {
+	n = end - pos < GET_READ_SIZE ? end - pos : GET_READ_SIZE;
+	if(pread(fd, buf, n, pos) != n || decode_write(dec, buf, n) < 0)
+	    break;
+    }
+    decode_close(dec);
+    free(buf);
+    if(g.left) {
+	fprintf(stderr, "ERROR: %s: %d bytes could not be decoded\n", 
+	    member_name(ix, mp), g.left);
+	return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    firmware_fileheader fw_fh;
+    struct fw_index_member *mp;
+    struct section_index *si;
+    struct stanza *stp;
+    FWIndex *ix;
+    const char *file = NULL, *get = NULL;
+    unsigned char magic[8];
+    int i, list = 0, fd, codec, ret = 1;
+    uint32_t j;
+
+    for(i = 1; i < argc; i++) {
+	if(strcmp(argv[i], "--list") == 0)
+	    list = 1;
+	else if(strcmp(argv[i], "--get") == 0 && i + 1 < argc)
+	    get = plain_name(argv[++i]);
+	else if(file == NULL)
+	    file = argv[i];
+	else
+	    file = NULL, i = argc;
+    }
+    if(file == NULL) {
+	fprintf(stderr, "Usage: extract [--list] [--get path] SmartQ7\n"
+	    "checks and prints the firmware header; --list lists the files of\n"
+	    "the rootfs/homefs tarballs and --get writes one of them to stdout,\n"
+	    "both from the seek index that mkSmartQ --index appends\n");
+	return 1;
+    }
+    if(extract((char *)file, &fw_fh) < 0)
+	return 1;
+    if(!list && !get)
+	return 0;
+
+    fd = open(file, O_RDONLY);
+    if(fd == -1 || (ix = read_index(fd)) == NULL)
+	return 1;
+    for(i = QI; i < fw_fh.component_count && i < MAX_SECTIONS; i++) {
+	si = &ix->sect[i];
+	if(si->block_size == 0)
+	    continue;
+        stp = (struct stanza *) ((void*) &fw_fh + sects[i].stanzaOffset);
+	mp = (void *)ix + si->member_offset;
+	for(j = 0; j < si->member_count; j++, mp++) {
+	    if(list)
+		printf("%-7s %c %04o %10u %s\n", sects[i].name, mp->type ? mp->type : '0',
+		    mp->mode, mp->size, member_name(ix, mp));
+	    if(!get || strcmp(plain_name(member_name(ix, mp)), get))
+		continue;
+	    if(mp->type != '0' && mp->type != '\0' && mp->type != '7') {
+		fprintf(stderr, "ERROR: %s is not a regular file\n", get);
+		goto out;
+	    }
+	    /* the tarball is sniffed like loading_fs() does */
+	    if(pread(fd, magic, sizeof(magic), stp->file.offset) != sizeof(magic)
+		    || (codec = decode_sniff(magic, sizeof(magic))) < 0) {
+		fprintf(stderr, "ERROR: %s is not compressed\n", sects[i].name);
+		goto out;
+	    }
+	    ret = get_member(fd, stp, codec, ix, si, mp) < 0;
+	    goto out;
+	}
+    }
+    if(get)
+	fprintf(stderr, "ERROR: %s not found\n", get);
+    else
+	ret = 0;
+out:
+    free(ix);
+    close(fd);
+    return ret;
+}
+#endif
+
 /****************** End Of File: extract.c ******************/
 // vim:sts=4:ts=8: 
@@ -32,6 +32,15 @@ enum sections {
 };
 
 #define HEAD_MAGIC          0x39000032 // 2009
+/*
+ * The magic of a file whose sections can't be copied as they are stored
+ * (see FWHeaderExt below), so that upgrades which predate the extension
+ * refuse it before writing anything.  Such upgrades would otherwise write
+ * the packed bytes end to end and still find the byte sums right.  The
+ * header is written to the iNAND with HEAD_MAGIC, which is what qi and
+ * u-boot look for there.
+ */
+#define HEAD_MAGIC_EXT      0x39000033
 #define NANDBLKSIZE         (512)
 
 /* see linux/include/asm-xxx/mach-types.h */
@@ -60,6 +69,109 @@ typedef struct _firmware_fileheader FWFileHdr;
 
 #define FW_STANZA_OFFSET(stanza) (offsetof(FWFileHdr, stanza))
 
+/*
+ * A rootfs/homefs stanza may carry a pre-built ext2/ext3 image instead of
+ * a tarball.  The section then starts with a fw_sparse_header, followed by
+ * extent_count fw_extents and the data of each extent in order.  Blocks
+ * no extent covers are free in the filesystem and are never written.
+ */
+#define SPARSE_MAGIC        0x53504152 // 'SPAR'
+
+struct fw_extent {
+    uint32_t block;         // first block, in block_size units
+    uint32_t count;         // number of blocks
+};
+
+struct fw_sparse_header {
+    uint32_t magic;
+    uint32_t hdr_size;      // sizeof(struct fw_sparse_header)
+    uint32_t block_size;
+    uint32_t total_blocks;  // size of the filesystem as built
+    uint32_t extent_count;
+};
+
+/*
+ * Optional header extension, stored at file offset fh_size straight after
+ * the header.  fh_size still covers the base header only.  A file that has
+ * one carries HEAD_MAGIC_EXT instead of HEAD_MAGIC, which readers that
+ * predate the extension reject.
+ *
+ * A section with an extent list has its all-zero NANDBLKSIZE blocks left
+ * out of the file: the file holds the data of each extent in order,
+ * nand.size is the size of the section as written and whatever no extent
+ * covers is zero.  Zeros don't change a byte sum, so check_sum is that of
+ * the section either way.
+ *
+ * A section with a codec is stored compressed: file.size bytes in the
+ * file decode to size bytes, which are then what is described above.
+ * check_sum is of the decoded bytes, so it holds whatever the codec.
+ */
+/* how a section is stored in the file, see section_ext.codec */
+enum codecs {
+    CODEC_NONE,
+    CODEC_GZIP,
+    CODEC_XZ,
+    CODEC_LZ4,          // legacy frame, as "lz4 -l"
+    MAX_CODECS,
+};
+
+#define FW_EXT_MAGIC        0x54584546 // 'FEXT'
+#define FW_EXT_VERSION      1
+
+typedef struct _firmware_header_ext {
+    uint32_t magic;
+    uint32_t check_sum;     // for 8 ~ .size
+    uint32_t size;          // this header plus the extent lists after it
+    uint32_t version;
+    struct section_ext {
+        uint32_t extent_offset;  // from the start of the extension, 0: stored whole
+        uint32_t extent_count;   // fw_extents, in NANDBLKSIZE blocks
+        uint32_t codec;          // enum codecs
+        uint32_t size;           // decoded size of the file.size bytes
+    } sect[MAX_SECTIONS];
+} FWHeaderExt;
+
+/*
+ * Optional seek index (mkSmartQ --index), after the last section.  For a
+ * rootfs/homefs that mkSmartQ compressed from a plain tarball it records
+ * where each compressed block starts and where each member's data lies in
+ * the decoded tarball, so "extract --get" decodes only the blocks holding
+ * one file.  Block k decodes to tarball bytes k * block_size onwards; the
+ * bytes before block 0 are the stream header, which a decoder needs first.
+ * upgrade never reads the index; the file ends with a fw_index_tail so it
+ * can be found without parsing the sections.
+ */
+#define FW_INDEX_MAGIC      0x58444e49 // 'INDX'
+#define FW_INDEX_VERSION    1
+
+typedef struct _firmware_index {
+    uint32_t magic;
+    uint32_t check_sum;     // for 8 ~ .size
+    uint32_t size;          // this header plus the tables and names after it
+    uint32_t version;
+    struct section_index {
+        uint32_t block_size;     // decoded bytes per block, 0: not indexed
+        uint32_t block_offset;   // from the start of the index, block_count + 1
+        uint32_t block_count;    //   uint32_t offsets from file.offset, the last
+                                 //   where the blocks end
+        uint32_t member_offset;  // from the start of the index, member_count
+        uint32_t member_count;   //   fw_index_members in archive order
+    } sect[MAX_SECTIONS];
+} FWIndex;
+
+struct fw_index_member {
+    uint32_t offset;        // of its data in the decoded tarball
+    uint32_t size;
+    uint32_t name;          // of its NUL terminated path, from the start of the index
+    uint16_t mode;          // permission bits
+    uint16_t type;          // tar typeflag
+};
+
+struct fw_index_tail {      // the last bytes of the file
+    uint32_t offset;        // file offset of the FWIndex
+    uint32_t magic;         // FW_INDEX_MAGIC
+};
+
 #endif
 /******************* End Of File: compress.h *******************/
 // vim:sts=4:ts=8: 
@@ -0,0 +1,167 @@
+/****************************************************************
+ * $ID: lz4.c                                                   *
+ *                                                              *
+ * Description: LZ4 block codec and legacy frame constants for  *
+ *              mkSmartQ and the upgrade flasher.               *
+ *                                                              *
+ * This file is free software;                                  *
+ *   you are free to modify and/or redistribute it   	        *
+ *   under the terms of the GNU General Public Licence (GPL).   *
+ *                                                              *
+ ****************************************************************/
+#include <string.h>
+
+#include "lz4.h"
+
+/*
+ * Just the block format: a token with the literal and match lengths,
+ * the literals, a 16-bit offset, and 255-runs for long lengths.  The
+ * compressor is the plain greedy single-probe one, which is what makes
+ * LZ4 fast to decode rather than small; the format rules keep the last
+ * 5 bytes literal and start no match in the last 12.
+ */
+#define HASH_LOG	14
+#define MINMATCH	4
+#define LASTLITERALS	5
+#define MFLIMIT		12
+#define MAX_DISTANCE	65535
+
+static uint32_t read32(const unsigned char *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint32_t hash4(const unsigned char *p)
+{
+    return (read32(p) * 2654435761U) >> (32 - HASH_LOG);
+}
+
+static unsigned char *put_len(unsigned char *op, size_t n)
+{
+    while (n >= 255) {
+	*op++ = 255;
+	n -= 255;
+    }
+    *op++ = n;
+    return op;
+}
+
+static unsigned char *put_literals(unsigned char *op, const unsigned char *lit,
+	size_t n, size_t ml)
+{
+    *op++ = (n >= 15 ? 15 : n) << 4 | (ml >= 15 ? 15 : ml);
+    if (n >= 15)
+	op = put_len(op, n - 15);
+    memcpy(op, lit, n);
+    return op + n;
+}
+
+size_t lz4_compress(const unsigned char *src, size_t len, unsigned char *dst)
+{
+    uint32_t table[1 << HASH_LOG];
+    const unsigned char *ip = src, *anchor = src, *end = src + len;
+    const unsigned char *ref, *mp, *rp;
+    unsigned char *op = dst;
+    size_t off, ml;
+    uint32_t h;
+
+    if (len > MFLIMIT) {
+	const unsigned char *mflimit = end - MFLIMIT;
+	const unsigned char *matchlimit = end - LASTLITERALS;
+
+	memset(table, 0, sizeof(table));
+	for (ip = src + 1; ip <= mflimit; ) {
+	    h = hash4(ip);
+	    ref = src + table[h];
+	    table[h] = ip - src;
+	    if (ref >= ip || ip - ref > MAX_DISTANCE || read32(ref) != read32(ip)) {
+		ip++;
+		continue;
+	    }
+	    while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+		ip--;
+		ref--;
+	    }
+	    for (mp = ip + MINMATCH, rp = ref + MINMATCH; mp < matchlimit && *mp == *rp; )
+		mp++, rp++;
+
+	    off = ip - ref;
+	    ml = mp - ip - MINMATCH;
+	    op = put_literals(op, anchor, ip - anchor, ml);
+	    *op++ = off;
+	    *op++ = off >> 8;
+	    if (ml >= 15)
+		op = put_len(op, ml - 15);
+
+	    anchor = ip = mp;
+	    table[hash4(ip - 2)] = ip - 2 - src;
+	}
+    }
+    op = put_literals(op, anchor, end - anchor, 0);
+    return op - dst;
+}
+
+long lz4_decompress(const unsigned char *src, size_t len,
+	unsigned char *dst, size_t cap)
+{
+    const unsigned char *ip = src, *iend = src + len, *match;
+    unsigned char *op = dst, *oend = dst + cap;
+    size_t n, off;
+    unsigned token, b;
+
+    for (;;) {
+	if (ip >= iend)
+	    return -1;
+	token = *ip++;
+
+	n = token >> 4;
+	if (n == 15)
+	    do {
+		if (ip >= iend)
+		    return -1;
+		b = *ip++;
+		n += b;
+	    } while (b == 255);
+	if (n > (size_t)(iend - ip) || n > (size_t)(oend - op))
+	    return -1;
+	memcpy(op, ip, n);
+	op += n;
+	ip += n;
+	if (ip == iend)		/* the last sequence has no match */
+	    break;
+
+	if (iend - ip < 2)
+	    return -1;
+	off = ip[0] | ip[1] << 8;
+	ip += 2;
+	if (off == 0 || off > (size_t)(op - dst))
+	    return -1;
+	n = token & 15;
+	if (n == 15)
+	    do {
+		if (ip >= iend)
+		    return -1;
+		b = *ip++;
+		n += b;
+	    } while (b == 255);
+	n += MINMATCH;
+	if (n > (size_t)(oend - op))
+	    return -1;
+
+	match = op - off;
+	if (off >= n) {
+	    memcpy(op, match, n);
+	    op += n;
+	} else {		/* overlapping: a repeating pattern */
+	    while (n--)
+		*op++ = *match++;
+	}
+    }
+    return op - dst;
+}
+
+/******************* End Of File: lz4.c *******************/
+// vim:sts=4:ts=8:
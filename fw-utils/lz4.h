@@ -0,0 +1,42 @@
+/****************************************************************
+ * $ID: lz4.h                                                   *
+ *                                                              *
+ * Description: LZ4 block codec and legacy frame constants for  *
+ *              mkSmartQ and the upgrade flasher.               *
+ *                                                              *
+ * This file is free software;                                  *
+ *   you are free to modify and/or redistribute it   	        *
+ *   under the terms of the GNU General Public Licence (GPL).   *
+ *                                                              *
+ ****************************************************************/
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Legacy frame, as written by "lz4 -l": the magic, then blocks, each a
+ * little-endian compressed size followed by that many bytes.  Every block
+ * but the last decodes to exactly LZ4_LEGACY_BLOCK bytes.  There is no
+ * checksum; the stanza check_sum covers the decoded data instead.
+ */
+#define LZ4_LEGACY_MAGIC	0x184C2102
+#define LZ4_LEGACY_BLOCK	(8 * 1024 * 1024)
+
+/* worst case compressed size of len bytes */
+#define LZ4_BOUND(len)		((len) + (len) / 255 + 16)
+
+/* compress len bytes of src to dst (LZ4_BOUND(len) bytes); returns the size */
+extern size_t lz4_compress(const unsigned char *src, size_t len, unsigned char *dst);
+
+/*
+ * Decode one block of len bytes into at most cap bytes of dst.  Returns
+ * the decoded size, or -1 for a block that is corrupt or doesn't fit.
+ */
+extern long lz4_decompress(const unsigned char *src, size_t len,
+	unsigned char *dst, size_t cap);
+
+#endif
+/******************* End Of File: lz4.h *******************/
+// vim:sts=4:ts=8:
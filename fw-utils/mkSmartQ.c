@@ -26,8 +26,13 @@
 #include <unistd.h>
 #include <errno.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <pthread.h>
 
 #include "firmware_header.h"
+#include "checksum.h"
+#include "encode.h"
 
 #define SIZE_PER_READ	(4 * 1024 * 1024)   // 4MB
 static char Q5[] = "SmartQ5";
@@ -43,8 +48,28 @@ typedef struct section {
    const char * name;
    uint32_t     nandOffset;  /* nand offsets are in 2K blocks */
    size_t       stanzaOffset;
-   uint32_t     fileSize;
+   uint32_t     fileSize;    /* as stored in the firmware file */
+   uint32_t     nandSize;    /* as written, zero blocks included */
    uint32_t     checkSum;
+   int          fd;          /* open input, -1 when skipped */
+   unsigned char *map;       /* whole input mapped, or MAP_FAILED */
+   size_t       mapSize;
+   struct fw_sparse_header sparse;  /* ext2/3 images in ROOTFS/HOMEFS */
+   struct fw_extent *extents;
+   struct fw_extent *dataExtents;   /* non-zero blocks, with --sparse */
+   uint32_t     dataCount;
+   int          codec;       /* enum codecs, for --codec */
+   int          sniffed;     /* a tarball, loading_fs() finds the codec */
+   uint32_t     codedFrom;   /* fileSize before it was compressed */
+   Encoder     *enc;
+   int          summing;     /* a worker thread owns checkSum */
+   pthread_t    summer;
+   uint32_t    *blocks;      /* --index: compressed block offsets */
+   uint32_t     blockCount;
+   struct fw_index_member *members;  /* and the members of the tarball */
+   uint32_t     memberCount;
+   char        *names;
+   uint32_t     namesSize;
 } Section;
 
 static Section sects[MAX_SECTIONS] = {
@@ -58,48 +83,549 @@ static Section sects[MAX_SECTIONS] = {
 };
 
 
-static inline int get_sum(unsigned char *buffer, int buffer_size)
+static int show_stats = 0;
+static int elide_zeros = 0;
+static int codec = CODEC_NONE;
+static int jobs = 0;         /* compressor threads, 0: one per CPU */
+static int make_index = 0;
+
+static double elapsed(struct timeval *start)
 {
-    int ret = 0, i;
-    for(i = 0; i < buffer_size; i++)
-	ret += buffer[i];
-    return ret;
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1e6;
 }
 
-static uint32_t get_check_sum(char *file_name, int file_size)
+static int write_all(int fd, const unsigned char *p, size_t len)
 {
-    /* use this to boot one-true-smartQ kernel */
-    int fd;
-    int remnant_size, size, ret = 0;
-    
-    fd = open(file_name, O_RDONLY);
-    if(-1 == fd) {
+    ssize_t n;
+
+    while (len > 0) {
+	    n = write(fd, p, len);
+	    if (n < 0) {
+	        if (errno == EINTR)
+		        continue;
+	        return -1;
+	    }
+	    p += n;
+	    len -= n;
+    }
+    return 0;
+}
+
+/* section data to the firmware file, through the compressor if it has one */
+static int emit(int fd, Section *sp, const unsigned char *p, size_t len)
+{
+    if (sp->enc)
+	    return encode_write(sp->enc, p, len);
+    return write_all(fd, p, len);
+}
+
+/*
+ * Open and map one section.  Mapped sections are summed by a worker
+ * thread of their own while the main thread writes them out, so all six
+ * sections are checksummed in parallel and the pages faulted in by the
+ * summer are the ones the writer copies from.
+ */
+static void *sum_section(void *arg)
+{
+    Section *sp = arg;
+
+    sp->checkSum = fw_byte_sum(sp->map, sp->mapSize);
+    return NULL;
+}
+
+static uint32_t get32(const unsigned char *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+#define EXT2_MAGIC		0xEF53
+#define EXT2_INCOMPAT_META_BG	0x0010
+#define EXT2_INCOMPAT_64BIT	0x0080
+#define EXT2_RO_GDT_CSUM	0x0010	/* uninitialised bitmaps */
+#define EXT2_RO_METADATA_CSUM	0x0400
+
+static int add_extent(struct fw_extent **list, uint32_t *n, uint32_t *max,
+	uint32_t block, uint32_t count)
+{
+    struct fw_extent *ep;
+
+    if (*n && (*list)[*n - 1].block + (*list)[*n - 1].count == block) {
+	    (*list)[*n - 1].count += count;
+	    return 0;
+    }
+    if (*n == *max) {
+	    *max = *max ? *max * 2 : 256;
+	    ep = realloc(*list, *max * sizeof(*ep));
+	    if (ep == NULL)
+	        return -1;
+	    *list = ep;
+    }
+    (*list)[*n].block = block;
+    (*list)[*n].count = count;
+    (*n)++;
+    return 0;
+}
+
+static int add_block(Section *sp, uint32_t block, uint32_t *max)
+{
+    return add_extent(&sp->extents, &sp->sparse.extent_count, max, block, 1);
+}
+
+/*
+ * If the section is an ext2/ext3 image, turn its block bitmaps into the
+ * list of used extents so only those go into the firmware.  Returns 1 if
+ * the section is to be sparse-encoded, 0 if it is to be copied as is and
+ * -1 for an ext image this can't handle.
+ */
+static int ext2_extents(Section *sp)
+{
+    const unsigned char *sb = sp->map + 1024, *gd, *bitmap;
+    uint32_t blocks, first, bs, bpg, groups, g, b, blk, max = 0;
+
+    if (sp->mapSize < 2048 || (sb[56] | sb[57] << 8) != EXT2_MAGIC)
+	    return 0;
+    if ((get32(sb + 96) & (EXT2_INCOMPAT_META_BG | EXT2_INCOMPAT_64BIT))
+	    || (get32(sb + 100) & (EXT2_RO_GDT_CSUM | EXT2_RO_METADATA_CSUM))) {
+	    printf("only plain ext2/ext3 images can be sparse-encoded\n");
+	    return -1;
+    }
+    blocks = get32(sb + 4);
+    first  = get32(sb + 20);
+    bs     = 1024 << get32(sb + 24);
+    bpg    = get32(sb + 32);
+    if (bpg == 0 || (uint64_t)blocks * bs > sp->mapSize) {
+	    printf("ext2 image is truncated\n");
+	    return -1;
+    }
+    groups = (blocks - first + bpg - 1) / bpg;
+    gd = sp->map + (first + 1) * bs;
+    if (gd + groups * 32 > sp->map + sp->mapSize)
+	    return -1;
+
+    sp->sparse.magic = SPARSE_MAGIC;
+    sp->sparse.hdr_size = sizeof(sp->sparse);
+    sp->sparse.block_size = bs;
+    sp->sparse.total_blocks = blocks;
+    sp->sparse.extent_count = 0;
+
+    /* 1K-block filesystems leave the boot block out of the bitmaps */
+    for (blk = 0; blk < first; blk++)
+	    if (add_block(sp, blk, &max) < 0)
+	        return -1;
+    for (g = 0; g < groups; g++) {
+	    blk = get32(gd + g * 32);	/* bg_block_bitmap */
+	    if ((uint64_t)(blk + 1) * bs > sp->mapSize)
+	        return -1;
+	    bitmap = sp->map + (size_t)blk * bs;
+	    for (b = 0; b < bpg && first + g * bpg + b < blocks; b++)
+	        if ((bitmap[b >> 3] & (1 << (b & 7)))
+		        && add_block(sp, first + g * bpg + b, &max) < 0)
+		        return -1;
+    }
+
+    sp->fileSize = sizeof(sp->sparse) 
+	    + sp->sparse.extent_count * sizeof(struct fw_extent);
+    for (g = 0; g < sp->sparse.extent_count; g++)
+	    sp->fileSize += sp->extents[g].count * bs;
+    return 1;
+}
+
+#define ELIDE_MIN_BLOCKS    8   /* shorter zero runs aren't worth an extent */
+
+static int zero_block(const unsigned char *p, size_t len)
+{
+    static const unsigned char zero[NANDBLKSIZE];
+
+    return memcmp(p, zero, len) == 0;
+}
+
+/*
+ * Describe a mapped raw section by the extents between its runs of at
+ * least ELIDE_MIN_BLOCKS all-zero blocks, so only those go into the
+ * firmware file.  fileSize shrinks to what is stored, nandSize stays.
+ */
+static int elide_zero_blocks(Section *sp)
+{
+    uint32_t blocks = (sp->mapSize + NANDBLKSIZE - 1) / NANDBLKSIZE;
+    uint32_t b, start = 0, zeros = 0, max = 0;
+    size_t len;
+
+    for (b = 0; b < blocks; b++) {
+	    len = sp->mapSize - (size_t)b * NANDBLKSIZE;
+	    if (zero_block(sp->map + (size_t)b * NANDBLKSIZE, 
+		        len < NANDBLKSIZE ? len : NANDBLKSIZE)) {
+	        zeros++;
+	        continue;
+	    }
+	    if (zeros >= ELIDE_MIN_BLOCKS) {
+	        if (b - zeros > start && add_extent(&sp->dataExtents, 
+			        &sp->dataCount, &max, start, b - zeros - start) < 0)
+		        return -1;
+	        start = b;
+	    }
+	    zeros = 0;
+    }
+    if (zeros < ELIDE_MIN_BLOCKS)
+	    zeros = 0;
+    if (blocks - zeros > start && add_extent(&sp->dataExtents,
+		    &sp->dataCount, &max, start, blocks - zeros - start) < 0)
+	    return -1;
+
+    if (sp->dataCount == 0 
+	    || (sp->dataCount == 1 && sp->dataExtents[0].count == blocks)) {
+	    free(sp->dataExtents);  /* nothing worth leaving out */
+	    sp->dataExtents = NULL;
+	    sp->dataCount = 0;
+	    return 0;
+    }
+    sp->fileSize = 0;
+    for (b = 0; b < sp->dataCount; b++)
+	    sp->fileSize += sp->dataExtents[b].count * NANDBLKSIZE;
+    /* the last block of the section may be short */
+    if (sp->dataCount && sp->dataExtents[sp->dataCount - 1].block 
+	    + sp->dataExtents[sp->dataCount - 1].count == blocks)
+	    sp->fileSize -= blocks * NANDBLKSIZE - sp->mapSize;
+    return 0;
+}
+
+static int is_tar(Section *sp)
+{
+    return sp->mapSize >= 512 && memcmp(sp->map + 257, "ustar", 5) == 0;
+}
+
+static uint64_t tar_num(const unsigned char *p, int len)
+{
+    uint64_t v = 0;
+
+    /* GNU base-256 for values that don't fit in octal */
+    if (*p & 0x80) {
+	    v = *p++ & 0x3f;
+	    while (--len > 0)
+	        v = (v << 8) | *p++;
+	    return v;
+    }
+    while (len > 0 && (*p == ' ' || *p == '\0'))
+	    p++, len--;
+    while (len-- > 0 && *p >= '0' && *p <= '7')
+	    v = v * 8 + (*p++ - '0');
+    return v;
+}
+
+static int tar_header_ok(const unsigned char *h)
+{
+    unsigned sum = 0;
+    int i;
+
+    for (i = 0; i < 512; i++)
+	    sum += (i >= 148 && i < 156) ? ' ' : h[i];
+    return sum == tar_num(h + 148, 8);
+}
+
+static int add_name(Section *sp, const char *name, size_t len, uint32_t *max)
+{
+    char *p;
+
+    while (sp->namesSize + len + 1 > *max) {
+	    *max = *max ? *max * 2 : 64 * 1024;
+	    p = realloc(sp->names, *max);
+	    if (p == NULL)
+	        return -1;
+	    sp->names = p;
+    }
+    memcpy(sp->names + sp->namesSize, name, len);
+    sp->names[sp->namesSize + len] = '\0';
+    sp->namesSize += len + 1;
+    return 0;
+}
+
+/*
+ * For --index, list where the data of each member of a mapped tarball
+ * lies.  GNU long names and pax path/size records are followed, as by
+ * untar.c; the names are kept as the archive has them.
+ */
+static int index_tar(Section *sp)
+{
+    const unsigned char *h, *rec, *end;
+    const char *name = NULL, *key;
+    char path[155 + 1 + 100 + 1];    /* ustar prefix/name */
+    size_t nameLen = 0, n;
+    uint64_t off, size, paxSize = 0;
+    uint32_t maxMembers = 0, maxNames = 0;
+    struct fw_index_member *mp;
+
+    if (sp->mapSize > UINT32_MAX) {
+	    printf("tarball too big to index\n");
+	    return -1;
+    }
+    for (off = 0; off + 512 <= sp->mapSize; off += 512 + (size + 511) / 512 * 512) {
+	    h = sp->map + off;
+	    if (h[0] == '\0')    /* the zero blocks at the end */
+	        return 0;
+	    if (!tar_header_ok(h))
+	        break;
+	    size = tar_num(h + 124, 12);
+	    if (off + 512 + size > sp->mapSize)
+	        break;
+
+	    switch (h[156]) {
+	    case 'L':   /* GNU long name of the next member */
+	        name = (const char *)h + 512;
+	        nameLen = strnlen(name, size);
+	        continue;
+	    case 'x':   /* pax records for the next member */
+	        for (rec = h + 512, end = rec + size; rec < end; rec += n) {
+		        n = strtoul((const char *)rec, (char **)&key, 10);
+		        if (n == 0 || *key != ' ' || rec + n > end)
+		            break;
+		        key++;
+		        if (!strncmp(key, "path=", 5)) {
+		            name = key + 5;
+		            nameLen = (const char *)rec + n - 1 - name;
+		        } else if (!strncmp(key, "size=", 5))
+		            paxSize = strtoull(key + 5, NULL, 10);
+	        }
+	        continue;
+	    case 'g':
+	    case 'K':
+	        continue;
+	    }
+
+	    if (paxSize) {
+	        size = paxSize;
+	        if (off + 512 + size > sp->mapSize)
+		        break;
+	    }
+	    if (name == NULL) {
+	        if (h[345])     /* ustar prefix */
+		        snprintf(path, sizeof(path), "%.155s/%.100s", h + 345, h);
+	        else
+		        snprintf(path, sizeof(path), "%.100s", h);
+	        name = path;
+	        nameLen = strlen(path);
+	    }
+	    if (sp->memberCount == maxMembers) {
+	        maxMembers = maxMembers ? maxMembers * 2 : 1024;
+	        mp = realloc(sp->members, maxMembers * sizeof(*mp));
+	        if (mp == NULL)
+		        return -1;
+	        sp->members = mp;
+	    }
+	    mp = &sp->members[sp->memberCount++];
+	    mp->offset = off + 512;
+	    mp->size = size;
+	    mp->name = sp->namesSize;
+	    mp->mode = tar_num(h + 100, 8) & 07777;
+	    mp->type = h[156];
+	    if (add_name(sp, name, nameLen, &maxNames) < 0)
+	        return -1;
+	    name = NULL;
+	    paxSize = 0;
+    }
+    printf("tarball is truncated or damaged, can't index it\n");
+    return -1;
+}
+
+/*
+ * qi and u-boot (raw) and filesystem images are compressed for upgrade
+ * to decode by the header extension.  A plain tarball is compressed
+ * into an ordinary tar.gz/tar.xz, which loading_fs() recognises itself;
+ * anything else is already compressed and copied as is.
+ */
+static int open_section(const char *file_name, Section *sp, int is_fs, int raw)
+{
+    struct stat st;
+    int sparse;
+
+    sp->map = MAP_FAILED;
+    sp->fd = open(file_name, O_RDONLY);
+    if (-1 == sp->fd) {
 	    printf("open %s failed\n", file_name);
 	    return -1;
     }
-    
-    remnant_size = file_size;
-    size = 0;
-    while(remnant_size / SIZE_PER_READ > 0) {
-	    size += read(fd, buffer, SIZE_PER_READ);
-	    ret += get_sum(buffer, SIZE_PER_READ);
-	    remnant_size = file_size - size;
+    if (fstat(sp->fd, &st) < 0) {
+	    printf("stat %s failed\n", file_name);
+	    return -1;
     }
-    size += read(fd, buffer, remnant_size);
-    ret += get_sum(buffer, remnant_size);
+    sp->fileSize = st.st_size;
+    sp->checkSum = 0;
+
+    if (st.st_size)
+	    sp->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, sp->fd, 0);
+    sp->mapSize = st.st_size;
+    if (sp->map != MAP_FAILED && is_fs) {
+	    sparse = ext2_extents(sp);
+	    if (sparse < 0) {
+	        printf("can't sparse-encode %s\n", file_name);
+	        return -1;
+	    }
+	    if (sparse) {  /* summed as it is encoded */
+	        sp->nandSize = sp->fileSize;
+	        sp->codec = codec;
+	        return 0;
+	    }
+	    if (codec != CODEC_NONE && is_tar(sp)) {  /* summed as it is compressed */
+	        /* loading_fs() and busybox tar know no .tar.lz4 */
+	        if (codec == CODEC_LZ4) {
+		        printf("%s: a tarball, compressed with gzip, not lz4\n", file_name);
+		        sp->codec = CODEC_GZIP;
+	        } else
+		        sp->codec = codec;
+	        sp->sniffed = 1;
+	        if (make_index && index_tar(sp) < 0) {
+		        printf("can't index %s\n", file_name);
+		        return -1;
+	        }
+	        return 0;
+	    }
+    }
+    sp->nandSize = sp->fileSize;
+    if (raw)
+	    sp->codec = codec;
+    if (sp->map != MAP_FAILED && raw && elide_zeros && elide_zero_blocks(sp) < 0) {
+	    printf("can't elide the zero blocks of %s\n", file_name);
+	    return -1;
+    }
+    if (sp->map != MAP_FAILED) {
+	    madvise(sp->map, st.st_size, MADV_SEQUENTIAL);
+	    sp->summing = !pthread_create(&sp->summer, NULL, sum_section, sp);
+    }
+    return 0;
+}
 
-    close(fd);
+/* sparse header, extent table, then just the used blocks of the image */
+static int write_sparse(int fd_out, Section *sp)
+{
+    struct fw_extent *ep;
+    uint32_t i, bs = sp->sparse.block_size;
+    size_t len;
+
+    len = sp->sparse.extent_count * sizeof(*ep);
+    sp->checkSum = fw_byte_sum((unsigned char *)&sp->sparse, sizeof(sp->sparse))
+	    + fw_byte_sum((unsigned char *)sp->extents, len);
+    if (emit(fd_out, sp, (unsigned char *)&sp->sparse, sizeof(sp->sparse)) < 0
+	    || emit(fd_out, sp, (unsigned char *)sp->extents, len) < 0)
+	    return -1;
 
+    for (i = 0, ep = sp->extents; i < sp->sparse.extent_count; i++, ep++) {
+	    len = (size_t)ep->count * bs;
+	    sp->checkSum += fw_byte_sum(sp->map + (size_t)ep->block * bs, len);
+	    if (emit(fd_out, sp, sp->map + (size_t)ep->block * bs, len) < 0)
+	        return -1;
+    }
+    return 0;
+}
+
+/* just the data extents; the zero blocks between them are left out */
+static int write_elided(int fd_out, Section *sp)
+{
+    struct fw_extent *ep;
+    size_t off, len;
+    uint32_t i;
+
+    for (i = 0, ep = sp->dataExtents; i < sp->dataCount; i++, ep++) {
+	    off = (size_t)ep->block * NANDBLKSIZE;
+	    len = (size_t)ep->count * NANDBLKSIZE;
+	    if (off + len > sp->mapSize)
+	        len = sp->mapSize - off;
+	    if (emit(fd_out, sp, sp->map + off, len) < 0)
+	        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Append one section to the firmware file.  Every byte is read once (by
+ * the page fault or by read()) and written once; unmapped sections are
+ * summed here on the way through the 4MB buffer.
+ */
+static int write_section(const char *file_name, int fd_out, Section *sp)
+{
+    int ret = 0;
+    uint32_t sum = 0, size;
+    ssize_t n;
+    size_t off;
+
+    if (sp->codec != CODEC_NONE) {
+	    sp->enc = encode_open(sp->codec, fd_out, jobs);
+	    if (sp->enc == NULL)
+	        return -1;
+	    if (sp->members)
+	        encode_track(sp->enc, &sp->blocks, &sp->blockCount);
+    }
+
+    if (sp->extents) {
+	    if (write_sparse(fd_out, sp) < 0)
+	        ret = -1;
+    } else if (sp->dataExtents) {
+	    if (write_elided(fd_out, sp) < 0)
+	        ret = -1;
+    } else if (sp->map != MAP_FAILED) {
+	    if (emit(fd_out, sp, sp->map, sp->fileSize) < 0)
+	        ret = -1;
+    } else {
+	    for (off = 0; off < sp->fileSize; off += n) {
+	        n = read(sp->fd, buffer, SIZE_PER_READ);
+	        if (n <= 0) {
+		        ret = -1;
+		        break;
+	        }
+	        sum += fw_byte_sum(buffer, n);
+	        if (emit(fd_out, sp, buffer, n) < 0) {
+		        ret = -1;
+		        break;
+	        }
+	    }
+	    sp->checkSum = sum;
+    }
+
+    sp->codedFrom = sp->fileSize;
+    if (sp->enc) {
+	    if (encode_close(sp->enc, &size, &sum) < 0)
+	        ret = -1;
+	    sp->enc = NULL;
+	    sp->fileSize = size;
+	    /* a compressed tarball is a tarball like any other */
+	    if (sp->sniffed) {
+	        sp->checkSum = sum;
+	        sp->nandSize = size;
+	    }
+    }
+
+    if (ret)
+	    printf("copying %s failed: %s\n", file_name, strerror(errno));
     return ret;
 }
 
-static void fill_fw_fh(FWFileHdr *fw_fh)
+static void close_section(Section *sp)
 {
-    unsigned fileOffset = sizeof(FWFileHdr);
+    if (sp->summing) {
+	    pthread_join(sp->summer, NULL);
+	    sp->summing = 0;
+    } else if (sp->map != MAP_FAILED && !sp->extents && !sp->sniffed)
+	    sp->checkSum = fw_byte_sum(sp->map, sp->mapSize);
+    if (sp->map != MAP_FAILED)
+	    munmap(sp->map, sp->mapSize);
+    sp->map = MAP_FAILED;
+    free(sp->extents);
+    sp->extents = NULL;
+    free(sp->dataExtents);
+    sp->dataExtents = NULL;
+    if (sp->fd != -1)
+	    close(sp->fd);
+    sp->fd = -1;
+}
+
+static void fill_fw_fh(FWFileHdr *fw_fh, uint32_t ext_size)
+{
+    unsigned fileOffset = sizeof(FWFileHdr) + ext_size;
     struct stanza *stp;
     int i;
 
-    fw_fh->magic = 0x39000032;	// '2009'
+    /* older upgrades must not take elided or compressed sections */
+    fw_fh->magic = ext_size ? HEAD_MAGIC_EXT : HEAD_MAGIC;
     fw_fh->fh_size = sizeof(FWFileHdr); 
     fw_fh->version = 1;
     fw_fh->date	= time((time_t*)NULL);
@@ -120,8 +646,125 @@ static void fill_fw_fh(FWFileHdr *fw_fh)
         stp->file.size   = sects[i].fileSize;
         stp->check_sum   = sects[i].checkSum;
         stp->nand.offset = sects[i].nandOffset;
-        stp->nand.size   = sects[i].fileSize;
+        stp->nand.size   = sects[i].nandSize;
+    }
+}
+
+/*
+ * The header extension, if any section was stored with its zero blocks
+ * left out or compressed; NULL otherwise, which keeps the file exactly
+ * as it always was.
+ */
+static FWHeaderExt *make_fw_ext(void)
+{
+    FWHeaderExt *fx;
+    uint32_t size = sizeof(FWHeaderExt);
+    int i, coded = 0;
+
+    for (i = QI ; i < MAX_SECTIONS; i++) {
+	    size += sects[i].dataCount * sizeof(struct fw_extent);
+	    coded |= sects[i].codec != CODEC_NONE && !sects[i].sniffed;
+    }
+    if (size == sizeof(FWHeaderExt) && !coded)
+	    return NULL;
+
+    fx = calloc(size, 1);
+    if (fx == NULL) {
+	    printf("malloc header extension failed\n");
+	    unlink(fwName);
+	    exit(2);
     }
+    fx->magic = FW_EXT_MAGIC;
+    fx->size = sizeof(FWHeaderExt);
+    fx->version = FW_EXT_VERSION;
+    for (i = QI ; i < MAX_SECTIONS; i++) {
+	    fx->sect[i].codec = sects[i].sniffed ? CODEC_NONE : sects[i].codec;
+	    if (!sects[i].dataExtents)
+	        continue;
+	    fx->sect[i].extent_offset = fx->size;
+	    fx->sect[i].extent_count = sects[i].dataCount;
+	    memcpy((void *)fx + fx->size, sects[i].dataExtents,
+	        sects[i].dataCount * sizeof(struct fw_extent));
+	    fx->size += sects[i].dataCount * sizeof(struct fw_extent);
+    }
+    return fx;
+}
+
+/* the sizes are only known once the sections are written */
+static void finish_fw_ext(FWHeaderExt *fx)
+{
+    int i;
+
+    for (i = QI ; i < MAX_SECTIONS; i++)
+	    fx->sect[i].size = fx->sect[i].codec != CODEC_NONE 
+	        ? sects[i].codedFrom : sects[i].fileSize;
+    fx->check_sum = fw_byte_sum((unsigned char *)fx + 8, fx->size - 8);
+}
+
+/*
+ * Append the --index tables of the sections that have them at offset, the
+ * end of the file, followed by the tail that points back at them.
+ */
+static int write_fw_index(int fd, uint32_t offset)
+{
+    FWIndex *ix;
+    struct fw_index_tail tail;
+    struct fw_index_member *mp;
+    uint32_t size = sizeof(FWIndex), pos, j;
+    int i, ret;
+
+    for (i = QI ; i < MAX_SECTIONS; i++)
+	    if (sects[i].members)
+	        size += sects[i].blockCount * sizeof(uint32_t) + (sects[i].namesSize + 3) / 4 * 4
+		        + sects[i].memberCount * sizeof(struct fw_index_member);
+    if (size == sizeof(FWIndex))
+	    return 0;
+
+    ix = calloc(size, 1);
+    if (ix == NULL) {
+	    printf("malloc seek index failed\n");
+	    return -1;
+    }
+    ix->magic = FW_INDEX_MAGIC;
+    ix->size = size;
+    ix->version = FW_INDEX_VERSION;
+    for (i = QI, pos = sizeof(FWIndex); i < MAX_SECTIONS; i++) {
+	    if (!sects[i].members)
+	        continue;
+	    ix->sect[i].block_size = encode_block_size(sects[i].codec);
+	    ix->sect[i].block_offset = pos;
+	    ix->sect[i].block_count = sects[i].blockCount - 1;
+	    memcpy((void *)ix + pos, sects[i].blocks, sects[i].blockCount * sizeof(uint32_t));
+	    pos += sects[i].blockCount * sizeof(uint32_t);
+
+	    ix->sect[i].member_offset = pos;
+	    ix->sect[i].member_count = sects[i].memberCount;
+	    mp = memcpy((void *)ix + pos, sects[i].members, 
+		    sects[i].memberCount * sizeof(*mp));
+	    pos += sects[i].memberCount * sizeof(*mp);
+	    /* names go after the members, each one's offset from the index */
+	    for (j = 0; j < sects[i].memberCount; j++)
+	        mp[j].name += pos;
+	    memcpy((void *)ix + pos, sects[i].names, sects[i].namesSize);
+	    pos += (sects[i].namesSize + 3) / 4 * 4;
+
+	    printf("Seek index: %s, %d members in %d blocks\n", sects[i].name,
+	        sects[i].memberCount, sects[i].blockCount - 1);
+	    free(sects[i].blocks);
+	    free(sects[i].members);
+	    free(sects[i].names);
+	    sects[i].blocks = NULL;
+	    sects[i].members = NULL;
+	    sects[i].names = NULL;
+    }
+    ix->check_sum = fw_byte_sum((unsigned char *)ix + 8, size - 8);
+
+    tail.offset = offset;
+    tail.magic = FW_INDEX_MAGIC;
+    ret = write_all(fd, (unsigned char *)ix, size) < 0 
+	    || write_all(fd, (unsigned char *)&tail, sizeof(tail)) < 0 ? -1 : 0;
+    free(ix);
+    return ret;
 }
 
 static uint32_t get_fw_fh_check_sum(FWFileHdr *fw_fh)
@@ -136,16 +779,51 @@ static uint32_t get_fw_fh_check_sum(FWFileHdr *fw_fh)
 
 int main(int argc, char *argv[])
 {
-    int i;
-    struct stat buf;
-    char system_cmd[512];
+    int i, nargs;
+    char *args[MAX_SECTIONS];
     int fd; /* firmware out */
-    
-    if(argc < 5 || argc > 7) {
-	    printf("Usage: mkSmartQ5/7 qi.bin u-boot.bin zImage initramfs.igz [ rootfs homefs] [bootargs]\n"
+    struct timeval start, tv;
+    double secs;
+    uint64_t total = 0;
+    FWHeaderExt *fw_ext;
+    uint32_t ext_size;
+
+    for (i = 1, nargs = 0; i < argc; i++) {
+	    if (strcmp(argv[i], "--stats") == 0)
+	        show_stats = 1;
+	    else if (strcmp(argv[i], "--sparse") == 0)
+	        elide_zeros = 1;
+	    else if (strcmp(argv[i], "--index") == 0)
+	        make_index = 1;
+	    else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+	        jobs = atoi(argv[++i]);
+	    else if (strcmp(argv[i], "--codec") == 0 && i + 1 < argc) {
+	        codec = encode_codec(argv[++i]);
+	        if (codec < 0)
+		        nargs = MAX_SECTIONS + 1;
+	    }
+	    else if (nargs < MAX_SECTIONS)
+	        args[nargs++] = argv[i];
+	    else
+	        nargs = MAX_SECTIONS + 1;
+    }
+
+    if(nargs < 4 || nargs > MAX_SECTIONS) {
+	    printf("Usage: mkSmartQ5/7 [--stats] [--sparse] [--codec c] [--jobs n] [--index] qi.bin u-boot.bin zImage initramfs.igz [ rootfs homefs] [bootargs]\n"
              "or\n"
-             "Usage mkSmartQ5/7 qi.bin u-boot.bin zImage initramfs.igz\n"
-             "where the filesystems may be either tar.gz or tar.xz\n"
+             "Usage mkSmartQ5/7 [--stats] [--sparse] [--codec c] [--jobs n] [--index] qi.bin u-boot.bin zImage initramfs.igz\n"
+             "where the filesystems may be either tar.gz or tar.xz, or an ext2/ext3\n"
+             "image which is stored sparse and written to the partition block by block\n"
+             "--stats reports the throughput of each section copied\n"
+             "--sparse leaves the runs of zero blocks in qi and u-boot out of the\n"
+             "      file; flashing it takes an upgrade that knows the header extension\n"
+             "--codec none|gzip|lz4|xz compresses qi, u-boot and filesystem images,\n"
+             "      to be decoded by that upgrade as it writes them, and plain .tar\n"
+             "      filesystems into the tarball format of that codec; lz4 has\n"
+             "      no tarball format, so a .tar filesystem then gets gzip\n"
+             "--jobs n compresses on n threads, one per CPU by default\n"
+             "--index appends a seek index of the .tar filesystems it compresses,\n"
+             "      for \"extract --list/--get\" to find single files by\n"
              "NOTE: The name of this binary (mkSmartQ5 or mkSmartQ7) determines\n"
              "      the target device.\n"
          );
@@ -170,60 +848,106 @@ int main(int argc, char *argv[])
 
     printf("Creating installable image for %s.\n", fwName);
 
+    if (jobs < 1)
+	    jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs < 1)
+	    jobs = 1;
+
     buffer = (unsigned char *)malloc(SIZE_PER_READ);
     if(NULL == buffer) {
 	    printf("malloc buffer failed\n");
 	    return -1;
     }
 
-    printf("        Section      Size   Checksum  Name\n");
-    printf("=============================================================\n");
-    for (i = QI ; i < MAX_SECTIONS; i++) {
-	    if (i + 1 == argc) break;  /* no more args */
+    unlink(fwName);
+    fd = open(fwName, O_RDWR | O_CREAT, 0644);
+
+    if (fd == -1) {
+       printf("Cannot open firmware file: %s.\n", strerror(errno));
+       exit(2);
+    }
 
-	    if (strcmp(argv[i + 1], ".") == 0)  /* skip files named "." */
-	    {
-		    sects[i].fileSize = 0;
-		    sects[i].checkSum = 0;
+    gettimeofday(&start, NULL);
+    for (i = QI ; i < MAX_SECTIONS; i++) {
+	    sects[i].fd = -1;
+	    sects[i].map = MAP_FAILED;
+	    if (i >= nargs || strcmp(args[i], ".") == 0)  /* skip files named "." */
 		    continue;
+	    /* zImage and initramfs stay whole: u-boot boots them off the SD file */
+	    if (open_section(args[i], &sects[i], i >= ROOTFS, i <= U_BOOT) < 0) {
+	        unlink(fwName);
+	        exit(4);
 	    }
-	    if(stat(argv[i + 1], &buf) < 0) {
-	        printf("stat %s failed\n", argv[i + 1]); exit(4);
-	    } else { 
-	        sects[i].fileSize = buf.st_size;
-	        sects[i].checkSum = get_check_sum(argv[i + 1], buf.st_size);
+    }
+
+    fw_ext = make_fw_ext();
+    ext_size = fw_ext ? fw_ext->size : 0;
+
+    /* sections go in first, the header is written last once the sums are known */
+    lseek(fd, sizeof(FWFileHdr) + ext_size, SEEK_SET);
+
+    printf("        Section      Size   Checksum  Name\n");
+    printf("=============================================================\n");
+    for (i = QI ; i < nargs; i++) {
+	    if (sects[i].fd == -1)
+		    continue;
+	    gettimeofday(&tv, NULL);
+	    if (write_section(args[i], fd, &sects[i]) < 0) {
+	        close(fd);
+	        unlink(fwName);
+	        exit(4);
 	    }
+	    close_section(&sects[i]);
        printf("%3d %11s %9d 0x%08x  %s\n",
-	       i, sects[i].name, sects[i].fileSize, sects[i].checkSum, argv[i + 1]);
+	       i, sects[i].name, sects[i].fileSize, sects[i].checkSum, args[i]);
+	    if (sects[i].codec != CODEC_NONE)
+	        printf("%15s %9d bytes before %s\n", "",
+		        sects[i].codedFrom, encode_name(sects[i].codec));
+	    if (sects[i].dataCount)
+	        printf("%15s %9d bytes in nand, %d zero bytes left out\n", "",
+		        sects[i].nandSize, sects[i].nandSize - sects[i].codedFrom);
+	    if (show_stats) {
+	        secs = elapsed(&tv);
+	        printf("%15s %9.3f s  %8.2f MB/s\n", "", secs,
+		        secs > 0 ? sects[i].codedFrom / secs / (1024 * 1024) : 0.0);
+	    }
+	    total += sects[i].fileSize;
     }   
+
+    if (make_index && write_fw_index(fd, sizeof(FWFileHdr) + ext_size + total) < 0) {
+       printf("Cannot write seek index: %s.\n", strerror(errno));
+       close(fd);
+       unlink(fwName);
+       exit(2);
+    }
     
     FWFileHdr *fw_fh = (FWFileHdr *) calloc(sizeof(FWFileHdr), 1);
 
-    fill_fw_fh(fw_fh);
+    fill_fw_fh(fw_fh, ext_size);
+    if (fw_ext)
+	    finish_fw_ext(fw_ext);
 
     fw_fh->check_sum = get_fw_fh_check_sum(fw_fh);
 
     printf("Header check sum = 0x%x\n", fw_fh->check_sum);
 
-    unlink(fwName);
-    fd = open(fwName, O_RDWR | O_CREAT, 0644);
-
-    if (fd == -1) {
-       printf("Cannot open firmware file: %s.\n", strerror(errno));
+    if (pwrite(fd, (void *)fw_fh, sizeof(FWFileHdr), 0) != sizeof(FWFileHdr)
+	    || (fw_ext && pwrite(fd, (void *)fw_ext, ext_size, sizeof(FWFileHdr)) != ext_size)) {
+       printf("Cannot write firmware header: %s.\n", strerror(errno));
+       close(fd);
+       unlink(fwName);
        exit(2);
     }
-
-    write(fd, (void *)fw_fh, sizeof(FWFileHdr));
     close(fd);
     free(fw_fh);
+    free(fw_ext);
     free(buffer);
 
-    /* append each section */
-    for (i = 1 ; i < argc ; i++)  {
-	    if (strcmp(argv[i], ".") == 0)  /* skip files named "." */
-	       continue;
-       sprintf(system_cmd, "cat %s >> %s", argv[i], fwName);
-       system(system_cmd);
+    if (show_stats) {
+	    secs = elapsed(&start);
+	    printf("Wrote %llu bytes in %.3f s: %.2f MB/s (one read and one write per byte)\n",
+	        (unsigned long long)total + sizeof(FWFileHdr) + ext_size, secs,
+	        secs > 0 ? total / secs / (1024 * 1024) : 0.0);
     }
 
     return 0;
@@ -0,0 +1,233 @@
+/****************************************************************
+ * $ID: sizetest.c                                              *
+ *                                                              *
+ * Description: runs firmware files through the size checks of *
+ *              the upgrade flasher.                            *
+ *                                                              *
+ * This file is free software;                                  *
+ *   you are free to modify and/or redistribute it   	        *
+ *   under the terms of the GNU General Public Licence (GPL).   *
+ *                                                              *
+ ****************************************************************/
+/*
+ * Each file is checked with extract() and extract_ext() as upgrade does.
+ * Then the reads of loading_firmware() are replayed against it, in its
+ * order: the header and u-boot, zImage and initramfs once for each copy,
+ * then the homefs unless it is kept.  What they read must leave exactly
+ * the rootfs to go of fw_upgrade_size(), or upgrade stops with "wrong
+ * rootfs size".  Every section has to be in the file in full, too.
+ * A section stored with a codec must decode to the size the extension
+ * gives, and for qi, u-boot, zImage and initramfs to the stanza's sum.
+ * A rootfs or homefs that is no image must be a gzip or xz tarball, the
+ * only ones loading_fs() sniffs.
+ *
+ *   sizetest fw.bin...
+ *
+ * sizetest.sh makes plain, --sparse, --codec gzip and --codec lz4 files
+ * to run it on.
+ * Not built by default: "make sizetest".
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "firmware_header.h"
+#include "checksum.h"
+#include "decode.h"
+
+int extract(char *filename, firmware_fileheader *fw_fh);
+int extract_ext(char *filename, firmware_fileheader *fw_fh, FWHeaderExt **ext);
+uint32_t fw_upgrade_size(firmware_fileheader *fw_fh, int with_homefs);
+
+/* what loading_firmware() reads, in order, before the homefs */
+static const struct {
+    const char *name;
+    int sect;		/* -1: the header */
+} loads[] = {
+    { "file header1", -1 },
+    { "u_boot1", U_BOOT },
+    { "zimage1", ZIMAGE },
+    { "initramfs1", INITRAMFS },
+    { "file header2", -1 },
+    { "u_boot2", U_BOOT },
+    { "zimage2", ZIMAGE },
+    { "initramfs2", INITRAMFS },
+};
+
+static struct stanza *stanza(firmware_fileheader *fw_fh, int sect)
+{
+    static const size_t offset[MAX_SECTIONS] = {
+        FW_STANZA_OFFSET(qi), FW_STANZA_OFFSET(u_boot),
+        FW_STANZA_OFFSET(zimage), FW_STANZA_OFFSET(initramfs),
+        FW_STANZA_OFFSET(rootfs), FW_STANZA_OFFSET(homefs),
+    };
+
+    return (struct stanza *)((void *)fw_fh + offset[sect]);
+}
+
+/* reads len bytes at offset as the loaders do; returns how many it got */
+static uint32_t read_section(int fd, uint32_t offset, uint32_t len)
+{
+    static unsigned char buf[65536];
+    uint32_t done = 0;
+    ssize_t n;
+
+    while(done < len) {
+        n = pread(fd, buf, len - done < sizeof(buf) ? len - done : sizeof(buf),
+                offset + done);
+        if(n <= 0)
+            break;
+        done += n;
+    }
+    return done;
+}
+
+typedef struct decoded {
+    uint32_t size, sum;
+} Decoded;
+
+static int count_out(const unsigned char *buf, size_t len, void *arg)
+{
+    Decoded *d = arg;
+
+    d->size += len;
+    d->sum += fw_byte_sum(buf, len);
+    return 0;
+}
+
+/* decodes a section as load_section() does; 0 if it comes out right */
+static int check_codec(int fd, FWHeaderExt *ext, firmware_fileheader *fw_fh,
+        int sect)
+{
+    static unsigned char buf[65536];
+    struct stanza *stp = stanza(fw_fh, sect);
+    Decoded out = { 0, 0 };
+    Decoder *dec;
+    uint32_t done, n;
+    int ret = 0;
+
+    dec = decode_open(ext->sect[sect].codec, count_out, &out);
+    if(dec == NULL)
+        return -1;
+    for(done = 0; done < stp->file.size && ret == 0; done += n) {
+        n = stp->file.size - done < sizeof(buf) ? stp->file.size - done : sizeof(buf);
+        if(pread(fd, buf, n, stp->file.offset + done) != n)
+            ret = -1;
+        else
+            ret = decode_write(dec, buf, n);
+    }
+    if(decode_close(dec) < 0 || ret < 0 || out.size != ext->sect[sect].size)
+        return -1;
+    if(sect < ROOTFS && out.sum != stp->check_sum)
+        return -1;
+    return 0;
+}
+
+/* a tarball section must be one loading_fs() can sniff; 0 if it is */
+static int check_tarball(int fd, FWHeaderExt *ext, firmware_fileheader *fw_fh,
+        int sect)
+{
+    struct stanza *stp = stanza(fw_fh, sect);
+    unsigned char sniffer[8];
+    int codec;
+
+    if((ext && ext->sect[sect].codec != CODEC_NONE) || stp->file.size == 0)
+        return 0;		/* an image, or none */
+    if(pread(fd, sniffer, sizeof(sniffer), stp->file.offset) != sizeof(sniffer))
+        return -1;
+    if(*(uint32_t *)sniffer == SPARSE_MAGIC)
+        return 0;
+    codec = decode_sniff(sniffer, sizeof(sniffer));
+    return codec == CODEC_GZIP || codec == CODEC_XZ ? 0 : -1;
+}
+
+static int check(char *name)
+{
+    firmware_fileheader fh;
+    FWHeaderExt *ext = NULL;
+    struct stanza *stp;
+    uint32_t size_sum, total, len;
+    unsigned int i;
+    int fd, keep, bad = 0;
+
+    memset(&fh, 0, sizeof(fh));
+    if(extract(name, &fh) != 0 || extract_ext(name, &fh, &ext) != 0) {
+        printf("%s: not taken by extract\n", name);
+        return 1;
+    }
+    fd = open(name, O_RDONLY);
+    if(fd < 0) {
+        perror(name);
+        free(ext);
+        return 1;
+    }
+
+    for(keep = 0; keep <= 1; keep++) {
+        total = fw_upgrade_size(&fh, !keep);
+        size_sum = 0;
+        for(i = 0; i < sizeof(loads) / sizeof(loads[0]); i++) {
+            if(loads[i].sect < 0) {
+                len = fh.fh_size;
+                size_sum += read_section(fd, 0, len);
+            } else {
+                stp = stanza(&fh, loads[i].sect);
+                len = stp->file.size;
+                size_sum += read_section(fd, stp->file.offset, len);
+            }
+            if(size_sum > total) {
+                printf("%s: %s goes past the total\n", name, loads[i].name);
+                bad = 1;
+            }
+        }
+        if(!keep)
+            size_sum += read_section(fd, fh.homefs.file.offset,
+                    fh.homefs.file.size);
+        if(read_section(fd, fh.rootfs.file.offset, fh.rootfs.file.size)
+                != fh.rootfs.file.size) {
+            printf("%s: rootfs not in the file\n", name);
+            bad = 1;
+        }
+        /* upgrade's check before the rootfs */
+        if(total - size_sum != fh.rootfs.file.size) {
+            printf("%s: wrong rootfs size %u, stanza says %u%s\n", name,
+                    total - size_sum, fh.rootfs.file.size,
+                    keep ? " (homefs kept)" : "");
+            bad = 1;
+        }
+    }
+    for(i = QI; ext && i < MAX_SECTIONS; i++)
+        if(ext->sect[i].codec != CODEC_NONE && check_codec(fd, ext, &fh, i) < 0) {
+            printf("%s: section %u doesn't decode to what the extension says\n",
+                    name, i);
+            bad = 1;
+        }
+    for(i = ROOTFS; i <= HOMEFS; i++)
+        if(check_tarball(fd, ext, &fh, i) < 0) {
+            printf("%s: section %u is no tarball loading_fs() takes\n", name, i);
+            bad = 1;
+        }
+    printf("%-32s %s%s\n", name, fh.magic == HEAD_MAGIC_EXT ?
+            "with extension  " : "plain           ", bad ? "FAILED" : "ok");
+    close(fd);
+    free(ext);
+    return bad;
+}
+
+int main(int argc, char **argv)
+{
+    int i, errors = 0;
+
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s fw.bin...\n", argv[0]);
+        return 2;
+    }
+    for(i = 1; i < argc; i++)
+        errors += check(argv[i]);
+    return errors != 0;
+}
+
+/****************** End Of File: sizetest.c ******************/
+// vim:sts=4:ts=8:
@@ -0,0 +1,47 @@
+#!/bin/sh
+#
+# Makes firmware files out of made-up sections with mkSmartQ and runs
+# them through sizetest, the size checks of upgrade.  Run it from here
+# after "make mkSmartQ sizetest".
+#
+
+MKSMARTQ=${MKSMARTQ:-$PWD/mkSmartQ}
+SIZETEST=${SIZETEST:-$PWD/sizetest}
+
+dir=$(mktemp -d /tmp/sizetest.XXXXXX) || exit 2
+trap 'rm -rf "$dir"' EXIT
+cd "$dir" || exit 2
+
+# qi and u-boot with runs of zero blocks, for --sparse to leave out
+{ head -c 4096 /dev/urandom; head -c 65536 /dev/zero; head -c 4096 /dev/urandom; } > qi.bin
+{ head -c 8192 /dev/urandom; head -c 131072 /dev/zero; head -c 8192 /dev/urandom; } > u-boot.bin
+head -c 100000 /dev/urandom > zImage
+head -c 5000 /dev/urandom > initramfs.igz
+mkdir -p root/etc home/user
+head -c 200000 /dev/urandom > root/etc/f1
+echo hello > home/user/f2
+tar cf rootfs.tar -C root . && gzip -c rootfs.tar > rootfs.tar.gz
+tar cf homefs.tar -C home . && gzip -c homefs.tar > homefs.tar.gz
+ln -s "$MKSMARTQ" mkSmartQ7
+
+# name, then the mkSmartQ options; the filesystems are $fs
+fs="rootfs.tar.gz homefs.tar.gz"
+make_fw()
+{
+    name=$1
+    shift
+    ./mkSmartQ7 "$@" qi.bin u-boot.bin zImage initramfs.igz \
+        $fs > "$name.log" 2>&1 \
+        && mv SmartQ7 "$name" || { cat "$name.log"; exit 1; }
+}
+
+make_fw plain.bin
+make_fw sparse.bin --sparse
+make_fw gzip.bin --codec gzip
+make_fw sparse-gzip.bin --sparse --codec gzip
+# plain .tar filesystems, which lz4 must leave to gzip
+fs="rootfs.tar homefs.tar"
+make_fw lz4.bin --codec lz4
+
+"$SIZETEST" plain.bin sparse.bin gzip.bin sparse-gzip.bin lz4.bin 2> sizetest.log \
+    || { cat sizetest.log; exit 1; }
@@ -0,0 +1,157 @@
+/****************************************************************
+ * $ID: stream.c                                                *
+ *                                                              *
+ * Description: pipelined section copy for the upgrade flasher. *
+ *                                                              *
+ * This file is free software;                                  *
+ *   you are free to modify and/or redistribute it   	        *
+ *   under the terms of the GNU General Public Licence (GPL).   *
+ *                                                              *
+ ****************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "stream.h"
+
+typedef struct slot {
+    unsigned char *buf;
+    size_t len;
+    int full;
+} Slot;
+
+typedef struct ring {
+    Slot slot[STREAM_SLOTS];
+    pthread_mutex_t lock;
+    pthread_cond_t filled, drained;
+    int fd;
+    uint32_t size;
+    int error;		/* reader hit EOF/error early */
+    int abort;		/* sink gave up, reader should stop */
+} Ring;
+
+static ssize_t read_full(int fd, unsigned char *p, size_t len)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < len) {
+	n = read(fd, p + done, len - done);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    break;
+	done += n;
+    }
+    return done;
+}
+
+static void *reader(void *arg)
+{
+    Ring *r = arg;
+    uint32_t left = r->size;
+    size_t want, got;
+    int i = 0;
+    Slot *sp;
+
+    while (left > 0) {
+	sp = &r->slot[i];
+	pthread_mutex_lock(&r->lock);
+	while (sp->full && !r->abort)
+	    pthread_cond_wait(&r->drained, &r->lock);
+	if (r->abort) {
+	    pthread_mutex_unlock(&r->lock);
+	    break;
+	}
+	pthread_mutex_unlock(&r->lock);
+
+	want = left < STREAM_SLOT_SIZE ? left : STREAM_SLOT_SIZE;
+	got = read_full(r->fd, sp->buf, want);
+
+	pthread_mutex_lock(&r->lock);
+	sp->len = got;
+	sp->full = 1;
+	if (got != want)
+	    r->error = 1;
+	pthread_cond_signal(&r->filled);
+	pthread_mutex_unlock(&r->lock);
+
+	if (got != want)
+	    break;
+	left -= got;
+	i = (i + 1) % STREAM_SLOTS;
+    }
+    return NULL;
+}
+
+int stream_copy(int fd_in, uint32_t size, stream_sink sink, void *arg)
+{
+    Ring r;
+    pthread_t tid;
+    uint32_t left = size;
+    int i, ret = 0;
+    Slot *sp;
+
+    memset(&r, 0, sizeof(r));
+    r.fd = fd_in;
+    r.size = size;
+    for (i = 0; i < STREAM_SLOTS; i++) {
+	r.slot[i].buf = malloc(STREAM_SLOT_SIZE);
+	if (r.slot[i].buf == NULL) {
+	    fprintf(stderr, "stream: malloc buffer failed\n");
+	    while (i--)
+		free(r.slot[i].buf);
+	    return -1;
+	}
+    }
+    pthread_mutex_init(&r.lock, NULL);
+    pthread_cond_init(&r.filled, NULL);
+    pthread_cond_init(&r.drained, NULL);
+
+    if (pthread_create(&tid, NULL, reader, &r)) {
+	fprintf(stderr, "stream: can't start reader thread\n");
+	ret = -1;
+	goto out;
+    }
+
+    for (i = 0; left > 0; i = (i + 1) % STREAM_SLOTS) {
+	sp = &r.slot[i];
+	pthread_mutex_lock(&r.lock);
+	while (!sp->full)
+	    pthread_cond_wait(&r.filled, &r.lock);
+	pthread_mutex_unlock(&r.lock);
+
+	if (sp->len && sink(sp->buf, sp->len, arg) < 0)
+	    ret = -1;
+	left -= sp->len;
+
+	pthread_mutex_lock(&r.lock);
+	sp->full = 0;
+	if (ret || r.error)
+	    r.abort = 1;
+	pthread_cond_signal(&r.drained);
+	pthread_mutex_unlock(&r.lock);
+	if (r.abort)
+	    break;
+    }
+    pthread_join(tid, NULL);
+
+    if (r.error) {
+	fprintf(stderr, "stream: short read, %u of %u bytes\n",
+		size - left, size);
+	ret = -1;
+    }
+out:
+    pthread_cond_destroy(&r.drained);
+    pthread_cond_destroy(&r.filled);
+    pthread_mutex_destroy(&r.lock);
+    for (i = 0; i < STREAM_SLOTS; i++)
+	free(r.slot[i].buf);
+    return ret;
+}
+
+/******************* End Of File: stream.c *******************/
+// vim:sts=4:ts=8: 
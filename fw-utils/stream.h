@@ -0,0 +1,38 @@
+/****************************************************************
+ * $ID: stream.h                                                *
+ *                                                              *
+ * Description: pipelined section copy for the upgrade flasher. *
+ *                                                              *
+ * This file is free software;                                  *
+ *   you are free to modify and/or redistribute it   	        *
+ *   under the terms of the GNU General Public Licence (GPL).   *
+ *                                                              *
+ ****************************************************************/
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STREAM_SLOTS		4
+#define STREAM_SLOT_SIZE	(1024 * 1024)	// 1MB
+
+/* consumes one filled slot; returns 0, or -1 to abort the stream */
+typedef int (*stream_sink)(const unsigned char *buf, size_t len, void *arg);
+
+/*
+ * Read size bytes from the current offset of fd_in and hand them to sink
+ * in order, one call per slot; every slot but the last is full
+ * (STREAM_SLOT_SIZE bytes).  A reader thread fills a ring of STREAM_SLOTS buffers while
+ * the caller's thread drains them, so reading the SD card overlaps with
+ * whatever the sink does (writing the iNAND, untarring, ...).  Only
+ * read() and the file offset are used, so fd_in may be a device node, a
+ * loop device or a plain file.
+ *
+ * Returns 0 when all size bytes reached the sink, -1 otherwise.
+ */
+extern int stream_copy(int fd_in, uint32_t size, stream_sink sink, void *arg);
+
+#endif
+/******************* End Of File: stream.h *******************/
+// vim:sts=4:ts=8: 
@@ -0,0 +1,238 @@
+/****************************************************************
+ * $ID: streamtest.c                                            *
+ *                                                              *
+ * Description: loopback test of stream_copy(), the pipelined   *
+ *              section copy of the upgrade flasher.            *
+ *                                                              *
+ * This file is free software;                                  *
+ *   you are free to modify and/or redistribute it   	        *
+ *   under the terms of the GNU General Public Licence (GPL).   *
+ *                                                              *
+ ****************************************************************/
+/*
+ * Each case fills the source with a known pattern, seeks it to an odd
+ * offset as upgrade does to reach a section, and streams it into a sink
+ * that writes the destination the way inand_sink() writes the iNAND.
+ * The destination must then hold exactly those bytes, and the sink must
+ * have seen full slots only, but for the last.  The sizes go around the
+ * ring several times, and the sink is made slow or fast now and then so
+ * that both the reader and the writer end up waiting on each other.
+ * Then a source shorter than the section and a sink giving up halfway
+ * must both come back as -1 without hanging.
+ *
+ *   streamtest [source [destination]]
+ *
+ * Temporary files by default; pass loop devices (losetup -f --show
+ * over files of 48MB or more, the destination no smaller than the
+ * source) to run it through the block layer.  Both are overwritten,
+ * the source all of it.
+ *
+ * Not built by default: "make streamtest".
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "stream.h"
+
+#define BASE	4097	/* the section starts here in the source */
+
+typedef struct sink_ctx {
+    int fd;
+    uint32_t total;
+    int calls;
+    int short_slots;	/* slots shorter than STREAM_SLOT_SIZE */
+    int fail_at;	/* call on which to give up, or 0 */
+    int slow;
+} SinkCtx;
+
+static unsigned char pattern(uint32_t pos)
+{
+    return (pos * 2654435761u) >> 24;
+}
+
+static int write_all(int fd, const unsigned char *buf, size_t len)
+{
+    ssize_t n;
+
+    while(len > 0) {
+        n = write(fd, buf, len);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int file_sink(const unsigned char *buf, size_t len, void *arg)
+{
+    SinkCtx *ctx = arg;
+
+    if(++ctx->calls == ctx->fail_at)
+        return -1;
+    if(len != STREAM_SLOT_SIZE)
+        ctx->short_slots++;
+    if(ctx->slow && rand() % 3 == 0)
+        usleep(rand() % 20000);
+    if(write_all(ctx->fd, buf, len) < 0) {
+        perror("streamtest: write");
+        return -1;
+    }
+    ctx->total += len;
+    return 0;
+}
+
+/* fills the first len bytes of fd with the pattern */
+static int fill(int fd, uint32_t len)
+{
+    static unsigned char buf[65536];
+    uint32_t pos, i, n;
+
+    if(lseek(fd, 0, SEEK_SET) < 0)
+        return -1;
+    for(pos = 0; pos < len; pos += n) {
+        n = len - pos < sizeof(buf) ? len - pos : sizeof(buf);
+        for(i = 0; i < n; i++)
+            buf[i] = pattern(pos + i);
+        if(write_all(fd, buf, n) < 0)
+            return -1;
+    }
+    return fsync(fd);
+}
+
+/* checks that the first len bytes of fd are the pattern from BASE on */
+static int compare(int fd, uint32_t len)
+{
+    static unsigned char buf[65536];
+    uint32_t pos, i;
+    ssize_t n;
+
+    if(lseek(fd, 0, SEEK_SET) < 0)
+        return -1;
+    for(pos = 0; pos < len; pos += n) {
+        n = read(fd, buf, len - pos < sizeof(buf) ? len - pos : sizeof(buf));
+        if(n <= 0)
+            return -1;
+        for(i = 0; i < n; i++)
+            if(buf[i] != pattern(BASE + pos + i)) {
+                fprintf(stderr, "  differs at %u\n", pos + i);
+                return -1;
+            }
+    }
+    return 0;
+}
+
+/*
+ * Streams size bytes from BASE in fd_in to fd_out.  The result must be
+ * want, and on success the bytes must have arrived intact.
+ */
+static int run(const char *what, int fd_in, int fd_out, uint32_t size,
+        int fail_at, int slow, int want)
+{
+    SinkCtx ctx;
+    int ret, bad = 0;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.fd = fd_out;
+    ctx.fail_at = fail_at;
+    ctx.slow = slow;
+
+    if(lseek(fd_in, BASE, SEEK_SET) < 0 || lseek(fd_out, 0, SEEK_SET) < 0) {
+        perror("streamtest: lseek");
+        return 1;
+    }
+    ret = stream_copy(fd_in, size, file_sink, &ctx);
+
+    if(ret != want)
+        bad = 1;
+    else if(ret == 0) {
+        if(ctx.total != size || ctx.short_slots > 1
+                || (ctx.short_slots && size % STREAM_SLOT_SIZE == 0))
+            bad = 1;
+        else if(lseek(fd_in, 0, SEEK_CUR) != BASE + size)
+            bad = 1;	/* read past the section */
+        else if(compare(fd_out, size) < 0)
+            bad = 1;
+    }
+    printf("%-28s %9u bytes  %3d slots  %s\n", what, size, ctx.calls,
+            bad ? "FAILED" : "ok");
+    return bad;
+}
+
+static int open_rw(const char *name, char *tmpl)
+{
+    int fd;
+
+    if(name)
+        fd = open(name, O_RDWR);
+    else {
+        fd = mkstemp(tmpl);
+        if(fd >= 0)
+            unlink(tmpl);
+    }
+    if(fd < 0)
+        perror(name ? name : "streamtest: mkstemp");
+    return fd;
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t sizes[] = {
+        0, 1, STREAM_SLOT_SIZE - 1, STREAM_SLOT_SIZE, STREAM_SLOT_SIZE + 1,
+        STREAM_SLOTS * STREAM_SLOT_SIZE,
+        (3 * STREAM_SLOTS + 1) * STREAM_SLOT_SIZE + 4321,
+    };
+    char tmp_in[] = "/tmp/streamtest.inXXXXXX";
+    char tmp_out[] = "/tmp/streamtest.outXXXXXX";
+    uint32_t avail = BASE + 10 * STREAM_SLOTS * STREAM_SLOT_SIZE;
+    off_t end;
+    int fd_in, fd_out, errors = 0;
+    unsigned int i;
+
+    if(argc > 3) {
+        fprintf(stderr, "usage: %s [source [destination]]\n", argv[0]);
+        return 2;
+    }
+    fd_in = open_rw(argc > 1 ? argv[1] : NULL, tmp_in);
+    fd_out = open_rw(argc > 2 ? argv[2] : NULL, tmp_out);
+    if(fd_in < 0 || fd_out < 0)
+        return 2;
+    /* a device is filled to its end, so that its end is the short read */
+    if(argc > 1) {
+        end = lseek(fd_in, 0, SEEK_END);
+        if(end < avail || end > 0x7fffffff) {
+            fprintf(stderr, "%s: needs %u bytes to 2GB\n", argv[1], avail);
+            return 2;
+        }
+        avail = end;
+    }
+    if(fill(fd_in, avail) < 0) {
+        perror("streamtest: filling the source");
+        return 2;
+    }
+    srand(1);
+
+    for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        errors += run("copy", fd_in, fd_out, sizes[i], 0, 0, 0);
+        errors += run("copy, sink slow at times", fd_in, fd_out, sizes[i],
+                0, 1, 0);
+    }
+    errors += run("source too short", fd_in, fd_out, avail - BASE + 1,
+            0, 0, -1);
+    errors += run("sink gives up on slot 3", fd_in, fd_out,
+            2 * STREAM_SLOTS * STREAM_SLOT_SIZE, 3, 0, -1);
+    errors += run("sink gives up on slot 1", fd_in, fd_out,
+            STREAM_SLOT_SIZE / 2, 1, 1, -1);
+
+    printf("%s\n", errors ? "FAILED" : "all ok");
+    return errors != 0;
+}
+
+/***************** End Of File: streamtest.c *****************/
+// vim:sts=4:ts=8:
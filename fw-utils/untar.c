@@ -0,0 +1,625 @@
+/****************************************************************
+ * $ID: untar.c                                                 *
+ *                                                              *
+ * Description: in-process streaming tar extractor for the      *
+ *              rootfs/homefs sections.                         *
+ *                                                              *
+ * Understands ustar, GNU long names/links and pax path/size    *
+ * records, which covers what GNU and busybox tar produce.      *
+ * Ownership is restored numerically, as the initramfs has no   *
+ * passwd of the target.                                        *
+ *                                                              *
+ * This file is free software;                                  *
+ *   you are free to modify and/or redistribute it   	        *
+ *   under the terms of the GNU General Public Licence (GPL).   *
+ *                                                              *
+ ****************************************************************/
+#define _GNU_SOURCE	/* fallocate */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/sysmacros.h>
+
+#include "untar.h"
+
+#define TAR_BLOCK	512
+#define TAR_META_MAX	(64 * 1024)	/* longest long name / pax record */
+
+/* fallocate() appeared in glibc 2.10; older ones just skip preallocation */
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 10)
+#define HAVE_FALLOCATE
+#endif
+/* syncfs() in 2.14; sync() instead has no error to give */
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 14)
+#define HAVE_SYNCFS
+#endif
+
+typedef struct tar_header {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char chksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+} TarHeader;
+
+typedef struct dir_meta {
+    char *path;
+    mode_t mode;
+    uid_t uid;
+    gid_t gid;
+    time_t mtime;
+} DirMeta;
+
+enum {
+    ST_HEADER,		/* collecting a 512-byte header */
+    ST_DATA,		/* file contents */
+    ST_META,		/* long name / long link / pax record */
+    ST_SKIP,		/* padding and unsupported entries */
+    ST_END,		/* after the zero blocks */
+};
+
+struct untar {
+    char root[PATH_MAX];
+    int state;
+    int error;			/* the archive can't be read on */
+    int failed;			/* entries that didn't go in */
+    int zero_blocks;
+
+    union {
+	TarHeader h;
+	unsigned char b[TAR_BLOCK];
+    } hdr;
+    size_t have;		/* bytes of hdr, or of meta, collected */
+
+    uint64_t left;		/* bytes of the current entry to go */
+    uint64_t pad;		/* padding after it */
+
+    /* the entry being extracted */
+    int fd;
+    char path[PATH_MAX];
+    mode_t mode;
+    uid_t uid;
+    gid_t gid;
+    time_t mtime;
+
+    /* GNU 'L'/'K' and pax 'x' overrides for the next entry */
+    char meta_type;
+    char *meta;
+    char *long_name, *long_link;
+    int64_t pax_size;
+
+    DirMeta *dirs;
+    int ndirs, maxdirs;
+};
+
+static uint64_t tar_num(const char *p, int len)
+{
+    uint64_t v = 0;
+
+    /* GNU base-256 for values that don't fit in octal */
+    if (*p & 0x80) {
+	v = *p++ & 0x3f;
+	while (--len > 0)
+	    v = (v << 8) | (unsigned char)*p++;
+	return v;
+    }
+    while (len > 0 && (*p == ' ' || *p == '\0'))
+	p++, len--;
+    while (len-- > 0 && *p >= '0' && *p <= '7')
+	v = v * 8 + (*p++ - '0');
+    return v;
+}
+
+static int header_ok(Untar *u)
+{
+    unsigned sum = 0;
+    int i;
+
+    for (i = 0; i < TAR_BLOCK; i++)
+	sum += (i >= 148 && i < 156) ? ' ' : u->hdr.b[i];
+    return sum == tar_num(u->hdr.h.chksum, sizeof(u->hdr.h.chksum));
+}
+
+/* copy a name field that need not be NUL terminated */
+static void field(char *dst, const char *src, size_t len)
+{
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+/* root + archive name, refusing anything that climbs out of root */
+static int make_path(Untar *u, char *dst, const char *name)
+{
+    const char *p;
+
+    while (*name == '/')
+	name++;
+    while (name[0] == '.' && name[1] == '/')
+	name += 2;
+    for (p = name; (p = strstr(p, "..")) != NULL; p += 2)
+	if ((p == name || p[-1] == '/') && (p[2] == '/' || p[2] == '\0')) {
+	    fprintf(stderr, "untar: skipping unsafe path %s\n", name);
+	    return -1;
+	}
+    if (snprintf(dst, PATH_MAX, "%s/%s", u->root, name) >= PATH_MAX) {
+	fprintf(stderr, "untar: path too long: %s\n", name);
+	return -1;
+    }
+    /* "dir/" entries */
+    p = dst + strlen(dst);
+    while (p > dst + 1 && p[-1] == '/')
+	*(char *)--p = '\0';
+    return 0;
+}
+
+/* mkdir -p of the parent, for archives that omit directory entries */
+static void make_parents(char *path)
+{
+    char *p;
+
+    for (p = strchr(path + 1, '/'); p; p = strchr(p + 1, '/')) {
+	*p = '\0';
+	mkdir(path, 0755);
+	*p = '/';
+    }
+}
+
+static void remember_dir(Untar *u)
+{
+    DirMeta *dm;
+
+    if (u->ndirs == u->maxdirs) {
+	u->maxdirs = u->maxdirs ? u->maxdirs * 2 : 256;
+	dm = realloc(u->dirs, u->maxdirs * sizeof(*dm));
+	if (dm == NULL) {
+	    u->error = 1;
+	    return;
+	}
+	u->dirs = dm;
+    }
+    dm = &u->dirs[u->ndirs++];
+    dm->path = strdup(u->path);
+    dm->mode = u->mode;
+    dm->uid = u->uid;
+    dm->gid = u->gid;
+    dm->mtime = u->mtime;
+}
+
+/* an entry that didn't go in: say which and why, and go on to the next */
+static void entry_failed(Untar *u, const char *what, const char *path)
+{
+    fprintf(stderr, "untar: %s %s: %s\n", what, path, strerror(errno));
+    u->failed++;
+}
+
+/* drops a file that can't be written whole */
+static void drop_file(Untar *u)
+{
+    close(u->fd);
+    u->fd = -1;
+    unlink(u->path);
+}
+
+static void finish_file(Untar *u)
+{
+    struct timeval tv[2];
+
+    if (u->fd < 0)
+	return;
+    /* chown first: it clears set-id bits that fchmod then puts back */
+    fchown(u->fd, u->uid, u->gid);
+    fchmod(u->fd, u->mode);
+    tv[0].tv_sec = tv[1].tv_sec = u->mtime;
+    tv[0].tv_usec = tv[1].tv_usec = 0;
+    futimes(u->fd, tv);
+    /* on disk with the rest in untar_close() */
+    if (close(u->fd) < 0)
+	entry_failed(u, "close", u->path);
+    u->fd = -1;
+}
+
+static void skip_entry(Untar *u, uint64_t size)
+{
+    u->left = size;
+    u->state = ST_SKIP;
+}
+
+/* pax "len key=value\n" records: only what changes where bytes go */
+static void parse_pax(Untar *u, char *rec, size_t len)
+{
+    char *end = rec + len, *key, *val, *next;
+    unsigned long n;
+
+    while (rec < end) {
+	n = strtoul(rec, &key, 10);
+	if (n == 0 || *key != ' ' || rec + n > end)
+	    break;
+	next = rec + n;
+	next[-1] = '\0';
+	key++;
+	val = strchr(key, '=');
+	if (val) {
+	    *val++ = '\0';
+	    if (!strcmp(key, "path")) {
+		free(u->long_name);
+		u->long_name = strdup(val);
+	    } else if (!strcmp(key, "linkpath")) {
+		free(u->long_link);
+		u->long_link = strdup(val);
+	    } else if (!strcmp(key, "size"))
+		u->pax_size = strtoll(val, NULL, 10);
+	}
+	rec = next;
+    }
+}
+
+static void end_meta(Untar *u)
+{
+    char *m = u->meta;
+
+    m[u->have] = '\0';
+    switch (u->meta_type) {
+    case 'L':
+	free(u->long_name);
+	u->long_name = strdup(m);
+	break;
+    case 'K':
+	free(u->long_link);
+	u->long_link = strdup(m);
+	break;
+    case 'x':
+	parse_pax(u, m, u->have);
+	break;
+    }
+    free(m);
+    u->meta = NULL;
+    u->have = 0;
+}
+
+static void start_entry(Untar *u)
+{
+    TarHeader *h = &u->hdr.h;
+    char name[256 + 2], lname[PATH_MAX];
+    char target[PATH_MAX];
+    uint64_t size = tar_num(h->size, sizeof(h->size));
+    char type = h->typeflag;
+    dev_t dev;
+    int r;
+
+    if (u->pax_size >= 0)
+	size = u->pax_size;
+    u->pad = (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK;
+
+    switch (type) {
+    case 'L': case 'K': case 'x': case 'g':
+	if (size > TAR_META_MAX || type == 'g') {
+	    skip_entry(u, size + u->pad);
+	    return;
+	}
+	u->meta = malloc(size + 1);
+	if (u->meta == NULL) {
+	    u->error = 1;
+	    skip_entry(u, size + u->pad);
+	    return;
+	}
+	u->meta_type = type;
+	u->have = 0;
+	u->left = size;
+	u->state = ST_META;
+	return;
+    }
+
+    if (u->long_name)
+	snprintf(name, sizeof(name), "%s", u->long_name);
+    else if (!memcmp(h->magic, "ustar", 6) && h->prefix[0]) {
+	/* POSIX ustar; GNU "ustar  " uses this area for other things */
+	field(name, h->prefix, sizeof(h->prefix));
+	strcat(name, "/");
+	field(lname, h->name, sizeof(h->name));
+	strcat(name, lname);
+    } else
+	field(name, h->name, sizeof(h->name));
+    if (u->long_link)
+	snprintf(lname, sizeof(lname), "%s", u->long_link);
+    else
+	field(lname, h->linkname, sizeof(h->linkname));
+
+    u->mode = tar_num(h->mode, sizeof(h->mode)) & 07777;
+    u->uid = tar_num(h->uid, sizeof(h->uid));
+    u->gid = tar_num(h->gid, sizeof(h->gid));
+    u->mtime = tar_num(h->mtime, sizeof(h->mtime));
+
+    if (make_path(u, u->path, u->long_name ? u->long_name : name) < 0) {
+	skip_entry(u, size);
+	goto done;
+    }
+    if (u->path[strlen(u->root)] == '\0') {	/* "./" itself */
+	skip_entry(u, type == '5' ? 0 : size);
+	goto done;
+    }
+
+    if (type != '5')
+	unlink(u->path);
+
+    switch (type) {
+    case '0': case '\0': case '7':
+	u->fd = open(u->path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+	if (u->fd < 0 && errno == ENOENT) {
+	    make_parents(u->path);
+	    u->fd = open(u->path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+	}
+	if (u->fd < 0) {
+	    entry_failed(u, "create", u->path);
+	    skip_entry(u, size);
+	    break;
+	}
+#ifdef HAVE_FALLOCATE
+	/*
+	 * One extent per file where the fs can (ext4).  ext3 and kernels
+	 * without it say EOPNOTSUPP or ENOSYS, which is fine; anything else,
+	 * such as ENOSPC, means the file won't fit.
+	 */
+	if (size && fallocate(u->fd, 0, 0, size) < 0
+		&& errno != EOPNOTSUPP && errno != ENOSYS) {
+	    entry_failed(u, "fallocate", u->path);
+	    drop_file(u);
+	    skip_entry(u, size);
+	    break;
+	}
+#endif
+	u->left = size;
+	u->state = ST_DATA;
+	if (size == 0) {
+	    finish_file(u);
+	    skip_entry(u, 0);
+	}
+	break;
+
+    case '5':
+	/* owner-writable until untar_close() applies the real mode */
+	r = mkdir(u->path, 0700);
+	if (r < 0 && errno == ENOENT) {
+	    make_parents(u->path);
+	    r = mkdir(u->path, 0700);
+	}
+	if (r < 0 && errno != EEXIST)
+	    entry_failed(u, "mkdir", u->path);
+	else
+	    remember_dir(u);
+	skip_entry(u, 0);
+	break;
+
+    case '1':
+	if (make_path(u, target, lname) < 0 || link(target, u->path) < 0)
+	    entry_failed(u, "link", u->path);
+	skip_entry(u, 0);
+	break;
+
+    case '2':
+	r = symlink(lname, u->path);
+	if (r < 0 && errno == ENOENT) {
+	    make_parents(u->path);
+	    r = symlink(lname, u->path);
+	}
+	if (r < 0)
+	    entry_failed(u, "symlink", u->path);
+	else
+	    lchown(u->path, u->uid, u->gid);
+	skip_entry(u, 0);
+	break;
+
+    case '3': case '4': case '6':
+	dev = makedev(tar_num(h->devmajor, sizeof(h->devmajor)),
+		      tar_num(h->devminor, sizeof(h->devminor)));
+	if (mknod(u->path, u->mode | (type == '3' ? S_IFCHR :
+			type == '4' ? S_IFBLK : S_IFIFO), dev) < 0)
+	    entry_failed(u, "mknod", u->path);
+	else {
+	    struct timeval tv[2];
+
+	    chown(u->path, u->uid, u->gid);
+	    chmod(u->path, u->mode);
+	    tv[0].tv_sec = tv[1].tv_sec = u->mtime;
+	    tv[0].tv_usec = tv[1].tv_usec = 0;
+	    utimes(u->path, tv);
+	}
+	skip_entry(u, 0);
+	break;
+
+    default:
+	fprintf(stderr, "untar: skipping %s of unknown type '%c'\n", name, type);
+	skip_entry(u, size);
+	break;
+    }
+done:
+    if (u->state == ST_SKIP)
+	u->left += u->pad, u->pad = 0;
+    free(u->long_name);
+    free(u->long_link);
+    u->long_name = u->long_link = NULL;
+    u->pax_size = -1;
+}
+
+static void end_header(Untar *u)
+{
+    int i;
+
+    for (i = 0; i < TAR_BLOCK && !u->hdr.b[i]; i++)
+	;
+    if (i == TAR_BLOCK) {
+	/* two zero blocks end the archive; busybox stops at one */
+	if (++u->zero_blocks == 2)
+	    u->state = ST_END;
+	return;
+    }
+    u->zero_blocks = 0;
+    if (!header_ok(u)) {
+	fprintf(stderr, "untar: bad header checksum\n");
+	u->error = 1;
+	u->state = ST_END;
+	return;
+    }
+    start_entry(u);
+}
+
+Untar *untar_open(const char *root)
+{
+    Untar *u = calloc(1, sizeof(*u));
+
+    if (u == NULL)
+	return NULL;
+    snprintf(u->root, sizeof(u->root), "%s", root);
+    u->fd = -1;
+    u->pax_size = -1;
+    u->state = ST_HEADER;
+    return u;
+}
+
+int untar_write(const unsigned char *buf, size_t len, void *arg)
+{
+    Untar *u = arg;
+    size_t n = 0;
+    ssize_t w;
+
+    while (len > 0 && !u->error) {
+	switch (u->state) {
+	case ST_HEADER:
+	    n = TAR_BLOCK - u->have;
+	    if (n > len)
+		n = len;
+	    memcpy(u->hdr.b + u->have, buf, n);
+	    u->have += n;
+	    if (u->have == TAR_BLOCK) {
+		u->have = 0;
+		end_header(u);
+	    }
+	    break;
+
+	case ST_DATA:
+	    n = u->left < len ? u->left : len;
+	    w = write(u->fd, buf, n);
+	    if (w != (ssize_t)n) {
+		if (w >= 0)
+		    errno = ENOSPC;	/* what a short write to a file means */
+		entry_failed(u, "write", u->path);
+		drop_file(u);
+		skip_entry(u, u->left + u->pad);
+		n = 0;
+		break;
+	    }
+	    u->left -= n;
+	    if (u->left == 0) {
+		finish_file(u);
+		skip_entry(u, u->pad);
+	    }
+	    break;
+
+	case ST_META:
+	    n = u->left < len ? u->left : len;
+	    memcpy(u->meta + u->have, buf, n);
+	    u->have += n;
+	    u->left -= n;
+	    if (u->left == 0) {
+		end_meta(u);
+		skip_entry(u, u->pad);
+	    }
+	    break;
+
+	case ST_SKIP:
+	    n = u->left < len ? u->left : len;
+	    u->left -= n;
+	    break;
+
+	case ST_END:
+	    return 0;	/* trailing blocks of the record */
+	}
+	buf += n;
+	len -= n;
+	if (u->state == ST_SKIP && u->left == 0)
+	    u->state = ST_HEADER;
+    }
+    return u->error ? -1 : 0;
+}
+
+/* writes back the whole filesystem below root, once for all entries */
+static int sync_root(Untar *u)
+{
+#ifdef HAVE_SYNCFS
+    int fd, ret;
+
+    fd = open(u->root, O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+	return -1;
+    ret = syncfs(fd);
+    if (close(fd) < 0)
+	ret = -1;
+    return ret;
+#else
+    sync();
+    return 0;
+#endif
+}
+
+int untar_close(Untar *u)
+{
+    struct timeval tv[2];
+    DirMeta *dm;
+    int ret;
+
+    if (u->fd >= 0) {
+	fprintf(stderr, "untar: archive ends inside %s\n", u->path);
+	finish_file(u);
+	u->error = 1;
+    }
+    /* deepest last-created first, so parents' times stick */
+    while (u->ndirs > 0) {
+	dm = &u->dirs[--u->ndirs];
+	if (dm->path) {
+	    chown(dm->path, dm->uid, dm->gid);
+	    chmod(dm->path, dm->mode);
+	    tv[0].tv_sec = tv[1].tv_sec = dm->mtime;
+	    tv[0].tv_usec = tv[1].tv_usec = 0;
+	    utimes(dm->path, tv);
+	}
+	free(dm->path);
+    }
+    if (u->state != ST_END && u->state != ST_HEADER)
+	u->error = 1;
+    if (u->failed)
+	fprintf(stderr, "untar: %d entries failed\n", u->failed);
+    /* a write-back error can't be pinned on an entry any more */
+    if (sync_root(u) < 0) {
+	fprintf(stderr, "untar: sync %s: %s\n", u->root, strerror(errno));
+	u->error = 1;
+    }
+    ret = u->error || u->failed ? -1 : 0;
+    free(u->dirs);
+    free(u->meta);
+    free(u->long_name);
+    free(u->long_link);
+    free(u);
+    return ret;
+}
+
+/******************* End Of File: untar.c *******************/
+// vim:sts=4:ts=8: 
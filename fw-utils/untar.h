@@ -0,0 +1,38 @@
+/****************************************************************
+ * $ID: untar.h                                                 *
+ *                                                              *
+ * Description: in-process streaming tar extractor for the      *
+ *              rootfs/homefs sections.                         *
+ *                                                              *
+ * This file is free software;                                  *
+ *   you are free to modify and/or redistribute it   	        *
+ *   under the terms of the GNU General Public Licence (GPL).   *
+ *                                                              *
+ ****************************************************************/
+#ifndef UNTAR_H
+#define UNTAR_H
+
+#include <stddef.h>
+
+typedef struct untar Untar;
+
+/* extract below root, which must exist (like "tar xf - -C root") */
+extern Untar *untar_open(const char *root);
+/*
+ * Feed the next piece of the (already decompressed) archive.  Has the
+ * decode_out signature so it can sit directly behind a Decoder.
+ * Returns -1 only once the archive itself can't be read on; an entry
+ * that can't be written is named on stderr and skipped.  Nothing is
+ * synced on the way.
+ */
+extern int untar_write(const unsigned char *buf, size_t len, void *arg);
+/*
+ * Apply the deferred directory ownership, modes and times, sync the
+ * filesystem under root once and free u.  Returns 0 if the archive was
+ * complete, every entry went in and the sync succeeded.
+ */
+extern int untar_close(Untar *u);
+
+#endif
+/******************* End Of File: untar.h *******************/
+// vim:sts=4:ts=8: 
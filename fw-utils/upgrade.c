@@ -15,6 +15,7 @@
  *                                                              *
  * Last modified: , 27 10 2009 09:38:11 +0800     by root #
  ****************************************************************/
+#define _GNU_SOURCE     /* O_DIRECT */
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mount.h>
@@ -37,6 +38,14 @@
 #include <sys/wait.h>
 #include <linux/input.h>
 #include "firmware_header.h"
+#include "checksum.h"
+#include "stream.h"
+#include "decode.h"
+#include "untar.h"
+
+int extract(char *filename, firmware_fileheader *fw_fh);
+int extract_ext(char *filename, firmware_fileheader *fw_fh, FWHeaderExt **ext);
+uint32_t fw_upgrade_size(firmware_fileheader *fw_fh, int with_homefs);
 
 static int KEY_ADD = 109;
 static int KEY_DEC = 104;
@@ -258,362 +267,710 @@ static void close_screen(screen_buffer *sb)
 #include "font_zh.c"
 
 #define    INAND_SIZE_PER_WRITE    (4 * 1024 * 1024)   // 4MB
-#define    ROOTFS_SIZE_PER_WRITE    (256 * 1024)   // 256KB
 static firmware_fileheader *fw_fh = NULL;
+static FWHeaderExt *fw_ext = NULL;
 static int fd_sd, fd_inand;
 static char inand_partition_path[30];
 static char system_cmd[100];
 static unsigned char *buffer = NULL;
-static uint32_t inand_check_sum;
+
+/* what is re-read from the iNAND after each section is written */
+enum {
+    VERIFY_STREAM,      /* sum the bytes on their way to the iNAND only */
+    VERIFY_SAMPLE,      /* plus an O_DIRECT read-back of sampled chunks */
+    VERIFY_FULL,        /* plus an O_DIRECT read-back of everything */
+};
+#define VERIFY_SAMPLE_STRIDE    4
+#define VERIFY_ALIGN            4096    /* covers any O_DIRECT block size */
+static int verify_mode = VERIFY_STREAM;
+static int fd_verify = -1;
 static uint32_t total_size_sum, size_sum, old_size_sum;
 
-int loading(char *name_zh, char *name_en, uint32_t total_size, RGBLCD *bar_color, RGBLCD *trim_color)
+typedef struct loading_ctx {
+    char *name_zh, *name_en;
+    RGBLCD *bar_color, *trim_color;
+    uint32_t sum;           /* of every byte handed to the iNAND */
+    uint32_t *slot_sum;     /* per STREAM_SLOT_SIZE chunk, for read-back */
+    int slots;
+    const struct fw_extent *ext;    /* zero blocks left out of the file */
+    uint32_t ext_count, cur;        /* extent being written */
+    uint32_t done;                  /* bytes of it already written */
+    off_t base;                     /* where the section starts */
+    Decoder *dec;                   /* compressed sections */
+    uint32_t left;                  /* decoded bytes still due */
+} LoadingCtx;
+
+static void update_progress(LoadingCtx *ctx, int force)
 {
-    uint32_t read_size, size, remnant_size;
     char s[100];
 
-    size = 0;
-    remnant_size = total_size;
-    while(remnant_size / INAND_SIZE_PER_WRITE > 0) {
-    read_size = read(fd_sd, buffer, INAND_SIZE_PER_WRITE);
-    size += read_size;
-    size_sum += read_size;
-    if(INAND_SIZE_PER_WRITE != write(fd_inand, buffer, INAND_SIZE_PER_WRITE)) {
-        char err[120];
-        sprintf(err, "inand write fails %s", strerror(errno)); 
-        fprintf(stderr, "%s\n", err);
-        draw_string_en(err);
-#warning missing chinese
-        sleep(5);
-        return -1; 
-    }
-    ratio = size_sum / (float)total_size_sum;
-    if((ratio - old_ratio) * 100 > 1) {
-        sprintf(s, "%s %d%%\n", name_zh, (int)(ratio * 100));
-        draw_string_zh(s);
-        sprintf(s, "%s %d%%\n", name_en, (int)(ratio * 100));
-        draw_string_en(s);
-        draw_progress_bar(ratio, PROGRESS_BAR_X_OFFSET, PROGRESS_BAR_ZH_OFFSET,
-            PROGRESS_BAR_WIDTH, PROGRESS_BAR_HEIGHT,
-            PROGRESS_BAR_TRIM,
-            bar_color, trim_color);
-        old_ratio = ratio;
-    }
-    remnant_size = total_size - size;
-    }
-    read_size = read(fd_sd, buffer, remnant_size);
-    size += read_size;
-    size_sum += read_size;
-    write(fd_inand, buffer, remnant_size);
     ratio = size_sum / (float)total_size_sum;
-    sprintf(s, "%s %d%%\n", name_zh, (int)(ratio * 100));
+    if(!force && (ratio - old_ratio) * 100 <= 1)
+        return;
+    sprintf(s, "%s %d%%\n", ctx->name_zh, (int)(ratio * 100));
     draw_string_zh(s);
-    sprintf(s, "%s %d%%\n", name_en, (int)(ratio * 100));
+    sprintf(s, "%s %d%%\n", ctx->name_en, (int)(ratio * 100));
     draw_string_en(s);
     draw_progress_bar(ratio, PROGRESS_BAR_X_OFFSET, PROGRESS_BAR_ZH_OFFSET,
         PROGRESS_BAR_WIDTH, PROGRESS_BAR_HEIGHT,
         PROGRESS_BAR_TRIM,
-        bar_color, trim_color);
+        ctx->bar_color, ctx->trim_color);
     old_ratio = ratio;
+}
+
+static int write_all(int fd, const unsigned char *p, size_t len)
+{
+    ssize_t n;
+
+    while(len > 0) {
+        n = write(fd, p, len);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* elided sections: every byte goes to its extent, the gaps are cleared first */
+static int scatter_write(LoadingCtx *ctx, const unsigned char *buf, size_t len)
+{
+    uint32_t left;
+    ssize_t n;
+
+    while(len > 0) {
+        if(ctx->cur == ctx->ext_count) {
+            errno = EFBIG;
+            return -1;
+        }
+        left = ctx->ext[ctx->cur].count * NANDBLKSIZE - ctx->done;
+        n = pwrite(fd_inand, buf, len < left ? len : left, ctx->base 
+                + (off_t)ctx->ext[ctx->cur].block * NANDBLKSIZE + ctx->done);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+        ctx->done += n;
+        if(ctx->done == ctx->ext[ctx->cur].count * NANDBLKSIZE) {
+            ctx->cur++;
+            ctx->done = 0;
+        }
+    }
+    return 0;
+}
+
+static int zero_range(off_t pos, uint32_t len)
+{
+    static const unsigned char zero[64 * 1024];
+    ssize_t n;
+#ifdef BLKDISCARDZEROES
+    static int discard_zeroes = -1;
+    unsigned int z;
+    uint64_t range[2];
+
+    if(discard_zeroes < 0)
+        discard_zeroes = ioctl(fd_inand, BLKDISCARDZEROES, &z) == 0 && z;
+    if(discard_zeroes) {
+        range[0] = pos;
+        range[1] = len;
+        if(ioctl(fd_inand, BLKDISCARD, range) == 0)
+            return 0;
+        discard_zeroes = 0;
+    }
+#endif
+    while(len > 0) {
+        n = pwrite(fd_inand, zero, len < sizeof(zero) ? len : sizeof(zero), pos);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return -1;
+        pos += n;
+        len -= n;
+    }
+    return 0;
+}
 
+/*
+ * Zero what the extents of an elided section don't cover: discarded when
+ * the iNAND reads discarded blocks back as zeros, written out otherwise.
+ */
+static int clear_gaps(LoadingCtx *ctx, uint32_t nand_size)
+{
+    uint32_t i, from = 0, to;
+
+    for(i = 0; i <= ctx->ext_count; i++) {
+        to = i < ctx->ext_count ? ctx->ext[i].block * NANDBLKSIZE : nand_size;
+        if(to > from && zero_range(ctx->base + from, to - from) < 0)
+            return -1;
+        if(i < ctx->ext_count)
+            from = (ctx->ext[i].block + ctx->ext[i].count) * NANDBLKSIZE;
+    }
     return 0;
+}
 
+/*
+ * stream_copy() sink: runs in the writer while the next slot is being read.
+ * The bytes are summed here, on their way to the iNAND, which is the
+ * fused verify: the section checksum costs no extra pass.
+ */
+static int inand_sink(const unsigned char *buf, size_t len, void *arg)
+{
+    LoadingCtx *ctx = arg;
+    uint32_t sum = fw_byte_sum(buf, len);
+
+    ctx->sum += sum;
+    if(ctx->slot_sum)
+        ctx->slot_sum[ctx->slots++] = sum;
+    if(ctx->dec) {
+        /* nothing may spill into the next section */
+        if(len > ctx->left) {
+            errno = EFBIG;
+            len = 0;
+        } else
+            ctx->left -= len;
+    }
+
+    if(len == 0 || (ctx->ext ? scatter_write(ctx, buf, len) : write_all(fd_inand, buf, len)) < 0) {
+        char err[120];
+        sprintf(err, "inand write fails %s", strerror(errno)); 
+        fprintf(stderr, "%s\n", err);
+        draw_string_en(err);
+#warning missing chinese
+        sleep(5);
+        return -1; 
+    }
+    if(!ctx->dec) {
+        size_sum += len;
+        update_progress(ctx, 0);
+    }
+    return 0;
+}
+
+static unsigned long get_BLKGETSIZE_sectors(int fd)
+{
+    uint64_t v64;
+    unsigned long longsectors;
+
+    if (ioctl(fd, BLKGETSIZE64, &v64) == 0) {
+    /* Got bytes, convert to 512 byte sectors */
+    return (v64 >> 9);
+    }
+    /* Needs temp of type long */
+    if (ioctl(fd, BLKGETSIZE, &longsectors))
+    longsectors = 0;
+    return longsectors;
+}
+
+typedef struct fs_ctx {
+    LoadingCtx progress;
+    Decoder *dec;
+} FsCtx;
+
+/* stream_copy() sink for rootfs/homefs: decompress and untar in place */
+static int fs_sink(const unsigned char *buf, size_t len, void *arg)
+{
+    FsCtx *ctx = arg;
+
+    if(decode_write(ctx->dec, buf, len) < 0)
+        return -1;
+    size_sum += len;
+    update_progress(&ctx->progress, 0);
+    return 0;
 }
 
 int loading_fs(char *name_zh, char *name_en, uint32_t total_size, RGBLCD *bar_color, RGBLCD *trim_color)
 {
-    uint32_t read_size, size, remnant_size;
-    int ret;
-    char s[100];
-    int fd[2];
-    pid_t pid;
-    char sniffer[2];
-    static const char lzma[] = { 0xfd, 0x37 };
-    static const char gzip[] = { 0x1f, 0x8b };
-    /* assume gzip */
-    static char *untar = "/usr/bin/tar zxf - -C /mnt/upgrade";
+    FsCtx ctx = { { name_zh, name_en, bar_color, trim_color, 0, NULL, 0 }, NULL };
+    unsigned char sniffer[6];
+    int codec, ret = 0;
+    Untar *u;
     struct timeval tpStart, tpEnd;
     float timeUse;
 
-    size = 0;
-    remnant_size = total_size;
-
     read(fd_sd, sniffer, sizeof(sniffer));
 
     lseek(fd_sd, -sizeof(sniffer), SEEK_CUR); /* status quo ante */
 
     fprintf(stdout, "sniffer found: 0x%x 0x%x\n", sniffer[0], sniffer[1]);
 
-    if ((sniffer[0] == lzma[0]) && (sniffer[1] == lzma[1]))
-    {
-       untar = "/usr/bin/tar Jxf - -C /mnt/upgrade";
+    codec = decode_sniff(sniffer, sizeof(sniffer));
+    if (codec == CODEC_XZ)
        fprintf(stdout, "sniffer found lzma archive.\n");
-    }
     else
-    if ((sniffer[0] == gzip[0]) && (sniffer[1] == gzip[1]))
-    {
+    if (codec == CODEC_GZIP)
        fprintf(stdout, "sniffer found gzip archive.\n");
-    }
     else {
        fprintf(stdout, "sniffer found unrecognized archive.\n");
        return -1;
     }
 
     gettimeofday(&tpStart, NULL);
-    
-    if(pipe(fd) < 0) {
-        fprintf(stderr, "pipe error");
+
+    u = untar_open("/mnt/upgrade");
+    if(u == NULL || (ctx.dec = decode_open(codec, untar_write, u)) == NULL) {
+        fprintf(stderr, "can't set up extraction of %s\n", name_en);
+        if(u)
+            untar_close(u);
         return -1;
     }
 
-    if((pid = fork()) < 0) {
-        fprintf(stderr, "fork error");
+    if(stream_copy(fd_sd, total_size, fs_sink, &ctx) < 0)
+        ret = -1;
+    if(decode_close(ctx.dec) < 0) {
+        fprintf(stderr, "decode: truncated stream\n");
+        ret = -1;
+    }
+    if(untar_close(u) < 0)
+        ret = -1;
+    if (ret)
+       fprintf(stderr,"un-tar of %s fails.\n", name_en);
+    update_progress(&ctx.progress, 1);
+
+    gettimeofday(&tpEnd, NULL);
+    timeUse = (tpEnd.tv_sec - tpStart.tv_sec);
+    fprintf(stderr, "Used Time:%f\n", timeUse);
+    return ret;
+}
+
+
+/*
+ * SPARSE_MAGIC sections hold an ext2/ext3 image rather than a tarball.
+ * Filesystem sections are only ever compressed when they are images
+ * (tarballs come compressed already), so a codec says so too.
+ */
+static int is_fs_image(int sect)
+{
+    struct stanza *stp = (struct stanza *)((void *)fw_fh + sects[sect].stanzaOffset);
+    struct fw_sparse_header h;
+
+    if(fw_ext && fw_ext->sect[sect].codec != CODEC_NONE)
+        return 1;
+    return stp->file.size >= sizeof(h)
+        && pread(fd_sd, &h, sizeof(h), stp->file.offset) == sizeof(h)
+        && h.magic == SPARSE_MAGIC;
+}
+
+typedef struct image_ctx {
+    LoadingCtx progress;
+    int fd;                     /* the partition */
+    uint64_t part_size;
+    struct fw_sparse_header h;
+    struct fw_extent *ext;
+    uint32_t table;             /* bytes of header and extent table */
+    uint32_t have;              /* of those gathered so far */
+    uint32_t cur;               /* extent being filled */
+    uint64_t done;              /* bytes of it already written */
+} ImageCtx;
+
+static int image_header(ImageCtx *ctx)
+{
+    if(ctx->h.magic != SPARSE_MAGIC || ctx->h.hdr_size != sizeof(ctx->h)
+            || ctx->h.block_size == 0 || ctx->h.extent_count == 0
+            || ctx->h.extent_count > (UINT32_MAX - sizeof(ctx->h)) / sizeof(struct fw_extent)) {
+        fprintf(stderr, "image: bad sparse header\n");
         return -1;
-    } else if(pid > 0) {    // parent
-        close(fd[0]);    // close read end
-        /* parent copies argv[1] to pipe */
-        while(remnant_size / ROOTFS_SIZE_PER_WRITE > 0) {        
-            read_size = read(fd_sd, buffer, ROOTFS_SIZE_PER_WRITE);
-            size += read_size;
-            size_sum += read_size;
-            write(fd[1], buffer, ROOTFS_SIZE_PER_WRITE);
-            ratio = size_sum / (float)total_size_sum;
-            if((ratio - old_ratio) * 100 > 1) {
-                sprintf(s, "%s %d%%\n", name_zh, (int)(ratio * 100));
-                draw_string_zh(s);
-                sprintf(s, "%s %d%%\n", name_en, (int)(ratio * 100));
-                draw_string_en(s);
-                draw_progress_bar(ratio, PROGRESS_BAR_X_OFFSET, PROGRESS_BAR_ZH_OFFSET,
-                    PROGRESS_BAR_WIDTH, PROGRESS_BAR_HEIGHT,
-                    PROGRESS_BAR_TRIM,
-                    bar_color, trim_color);
-                old_ratio = ratio;
-            }
-            remnant_size = total_size - size;
+    }
+    if(ctx->part_size < (uint64_t)ctx->h.total_blocks * ctx->h.block_size) {
+        fprintf(stderr, "image: partition is smaller than the %u block filesystem\n",
+                ctx->h.total_blocks);
+        return -1;
+    }
+    ctx->table = sizeof(ctx->h) + ctx->h.extent_count * sizeof(struct fw_extent);
+    ctx->ext = malloc(ctx->table - sizeof(ctx->h));
+    if(ctx->ext == NULL) {
+        fprintf(stderr, "image: can't hold %u extents\n", ctx->h.extent_count);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Sink for the (decoded) section: gather the sparse header and extent
+ * table, then scatter the packed extents to their blocks.
+ */
+static int image_sink(const unsigned char *buf, size_t len, void *arg)
+{
+    ImageCtx *ctx = arg;
+    uint64_t left, pos;
+    ssize_t n;
+
+    ctx->progress.sum += fw_byte_sum(buf, len);
+    if(!ctx->progress.dec)
+        size_sum += len;
+    while(len > 0 && ctx->have < sizeof(ctx->h) + (ctx->ext ? ctx->table - sizeof(ctx->h) : 0)) {
+        if(ctx->have < sizeof(ctx->h)) {
+            n = sizeof(ctx->h) - ctx->have;
+            if((size_t)n > len)
+                n = len;
+            memcpy((void *)&ctx->h + ctx->have, buf, n);
+            if(ctx->have + n == sizeof(ctx->h) && image_header(ctx) < 0)
+                return -1;
+        } else {
+            n = ctx->table - ctx->have;
+            if((size_t)n > len)
+                n = len;
+            memcpy((void *)ctx->ext + ctx->have - sizeof(ctx->h), buf, n);
         }
-        read_size = read(fd_sd, buffer, remnant_size);
-        size += read_size;
-        size_sum += read_size;
-        write(fd[1], buffer, remnant_size);
-        ratio = size_sum / (float)total_size_sum;
-        sprintf(s, "%s %d%%\n", name_zh, (int)(ratio * 100));
-        draw_string_zh(s);
-        sprintf(s, "%s %d%%\n", name_en, (int)(ratio * 100));
-        draw_string_en(s);
-        draw_progress_bar(ratio, PROGRESS_BAR_X_OFFSET, PROGRESS_BAR_ZH_OFFSET,
-            PROGRESS_BAR_WIDTH, PROGRESS_BAR_HEIGHT,
-            PROGRESS_BAR_TRIM,
-            bar_color, trim_color);
-        old_ratio = ratio;
-        remnant_size = total_size - size;
-
-        close(fd[1]);    // close write end of pipe for reader
-        if(waitpid(pid, NULL, 0) < 0) {
-            fprintf(stderr, "waitpid error");
+        ctx->have += n;
+        buf += n;
+        len -= n;
+    }
+    while(len > 0) {
+        if(ctx->cur == ctx->h.extent_count) {
+            fprintf(stderr, "image: data past the last extent\n");
             return -1;
         }
-        return 0;
-    } else {        // child
-        close(fd[1]);    // close write end
-        if(fd[0] != STDIN_FILENO) {
-            if(dup2(fd[0], STDIN_FILENO) != STDIN_FILENO) {
-                fprintf(stderr, "dup2 error to stdin");
-                return -1;
-            }
-            close(fd[0]);   // don't need this after dup2
-        } 
-
-        ret = WEXITSTATUS(system(untar));
-        if (ret) {
-           fprintf(stderr,"un-tar of %s fails.\n", name_en);
+        left = (uint64_t)ctx->ext[ctx->cur].count * ctx->h.block_size - ctx->done;
+        pos = (uint64_t)ctx->ext[ctx->cur].block * ctx->h.block_size + ctx->done;
+        n = pwrite64(ctx->fd, buf, len < left ? len : left, pos);
+        if(n <= 0) {
+            fprintf(stderr, "image: write at %llu fails: %s\n", 
+                    (unsigned long long)pos, strerror(errno));
+            return -1;
+        }
+        buf += n;
+        len -= n;
+        ctx->done += n;
+        if(ctx->done == (uint64_t)ctx->ext[ctx->cur].count * ctx->h.block_size) {
+            ctx->cur++;
+            ctx->done = 0;
         }
     }
+    if(!ctx->progress.dec)
+        update_progress(&ctx->progress, 0);
+    return 0;
+}
 
-    gettimeofday(&tpEnd, NULL);
-    timeUse = (tpEnd.tv_sec - tpStart.tv_sec);
-    fprintf(stderr, "Used Time:%f\n", timeUse);
+/* stream_copy() sink for compressed sections: progress counts what is read */
+static int coded_sink(const unsigned char *buf, size_t len, void *arg)
+{
+    LoadingCtx *ctx = arg;
+
+    if(decode_write(ctx->dec, buf, len) < 0)
+        return -1;
+    size_sum += len;
+    update_progress(ctx, 0);
     return 0;
 }
 
-static unsigned long get_BLKGETSIZE_sectors(int fd)
+/*
+ * Deploy a sparse ext2/ext3 image section: only the allocated extents are
+ * written, straight to the partition, and the filesystem is then grown to
+ * fill it.  This replaces mkfs + mount + untar for such sections.
+ */
+int loading_image(char *partition, char *name_zh, char *name_en, int sect, RGBLCD *bar_color, RGBLCD *trim_color)
 {
-    uint64_t v64;
-    unsigned long longsectors;
+    struct stanza *stp = (struct stanza *)((void *)fw_fh + sects[sect].stanzaOffset);
+    int codec = fw_ext ? fw_ext->sect[sect].codec : CODEC_NONE;
+    ImageCtx ctx;
+    int ret = -1;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.progress.name_zh = name_zh;
+    ctx.progress.name_en = name_en;
+    ctx.progress.bar_color = bar_color;
+    ctx.progress.trim_color = trim_color;
+
+    ctx.fd = open(partition, O_WRONLY);
+    if(ctx.fd == -1) {
+        fprintf(stderr, "image: can't open %s\n", partition);
+        return -1;
+    }
+    ctx.part_size = (uint64_t)get_BLKGETSIZE_sectors(ctx.fd) * INAND_BLOCK_SIZE;
+    fprintf(stderr, "image: %u bytes (%s) to %s\n", stp->nand.size,
+            codec == CODEC_NONE ? "raw" : "compressed", partition);
+
+    if(codec != CODEC_NONE) {
+        ctx.progress.dec = decode_open(codec, image_sink, &ctx);
+        if(ctx.progress.dec == NULL)
+            goto out;
+        ret = stream_copy(fd_sd, stp->file.size, coded_sink, &ctx.progress);
+        if(decode_close(ctx.progress.dec) < 0) {
+            fprintf(stderr, "decode: truncated stream\n");
+            ret = -1;
+        }
+    } else
+        ret = stream_copy(fd_sd, stp->file.size, image_sink, &ctx);
+    if(ret == 0 && (ctx.ext == NULL || ctx.have != ctx.table 
+                || ctx.cur != ctx.h.extent_count)) {
+        fprintf(stderr, "image: section ends before its last extent\n");
+        ret = -1;
+    }
+    if(ret == 0 && ctx.progress.sum != stp->check_sum) {
+        fprintf(stderr, "image: xsum fail: expected %d calc'ed %d\n",
+                stp->check_sum, ctx.progress.sum);
+        ret = -1;
+    }
+    if(fsync(ctx.fd) < 0)
+        ret = -1;
+    update_progress(&ctx.progress, 1);
+    if(ret)
+        goto out;
+
+    /* the image was built small; let it have the whole partition */
+    sprintf(system_cmd, "resize2fs -f %s 1>/dev/null", partition);
+    fprintf(stderr, "%s\n", system_cmd);
+    if(WEXITSTATUS(system(system_cmd))) {
+        fprintf(stderr, "image: resize2fs of %s fails\n", partition);
+        ret = -1;
+    }
+out:
+    close(ctx.fd);
+    free(ctx.ext);
+    return ret;
+}
 
-    if (ioctl(fd, BLKGETSIZE64, &v64) == 0) {
-    /* Got bytes, convert to 512 byte sectors */
-    return (v64 >> 9);
+/*
+ * Read-back verify.  The iNAND is re-read through an O_DIRECT descriptor
+ * so the sums come from the medium rather than from the page cache the
+ * write just filled.  VERIFY_SAMPLE only re-reads every
+ * VERIFY_SAMPLE_STRIDE'th chunk (and the last one).
+ */
+/* sum len bytes at start, len at most STREAM_SLOT_SIZE, off the medium */
+static int readback_sum(off_t start, uint32_t len, uint32_t *sum)
+{
+    static unsigned char *vbuf = NULL;
+    off_t astart;
+    size_t skip, rlen;
+
+    if(vbuf == NULL && posix_memalign((void **)&vbuf, VERIFY_ALIGN,
+                STREAM_SLOT_SIZE + 2 * VERIFY_ALIGN)) {
+        vbuf = NULL;
+        fprintf(stderr, "malloc verify buffer failed\n");
+        return -1;
     }
-    /* Needs temp of type long */
-    if (ioctl(fd, BLKGETSIZE, &longsectors))
-    longsectors = 0;
-    return longsectors;
+    /* direct I/O wants an aligned window; sum just our part of it */
+    astart = start & ~(off_t)(VERIFY_ALIGN - 1);
+    skip = start - astart;
+    rlen = (skip + len + VERIFY_ALIGN - 1) & ~(VERIFY_ALIGN - 1);
+    if(pread(fd_verify, vbuf, rlen, astart) < (ssize_t)(skip + len))
+        return -1;
+    *sum = fw_byte_sum(vbuf + skip, len);
+    return 0;
 }
 
-static inline int get_sum(unsigned char *buffer, int buffer_size)
+static int readback_verify(char *what, off_t pos, uint32_t size, LoadingCtx *ctx)
 {
-    int ret = 0, i;
-    for(i = 0; i < buffer_size; i++)
-    ret += buffer[i];
-    return ret;
+    uint32_t len, sum, off, total;
+    int i;
+
+    fdatasync(fd_inand);
+
+    if(ctx->slot_sum == NULL) {
+        /* the slots were decoded or scattered; check the section as a whole */
+        for(off = 0, total = 0; off < size; off += len) {
+            len = size - off;
+            if(len > STREAM_SLOT_SIZE)
+                len = STREAM_SLOT_SIZE;
+            if(readback_sum(pos + off, len, &sum) < 0) {
+                fprintf(stderr, "%s read-back fails at %u: %s\n", what, 
+                        off, strerror(errno));
+                return -1;
+            }
+            total += sum;
+        }
+        if(total != ctx->sum) {
+            fprintf(stderr, "%s read-back mismatch: wrote 0x%x read 0x%x\n",
+                    what, ctx->sum, total);
+            return -1;
+        }
+        return 0;
+    }
+
+    for(i = 0; i < ctx->slots; i++) {
+        if(verify_mode == VERIFY_SAMPLE && i % VERIFY_SAMPLE_STRIDE 
+                && i != ctx->slots - 1)
+            continue;
+        len = size - i * STREAM_SLOT_SIZE;
+        if(len > STREAM_SLOT_SIZE)
+            len = STREAM_SLOT_SIZE;
+        if(readback_sum(pos + (off_t)i * STREAM_SLOT_SIZE, len, &sum) < 0) {
+            fprintf(stderr, "%s read-back fails at %u: %s\n", what, 
+                    i * STREAM_SLOT_SIZE, strerror(errno));
+            return -1;
+        }
+        if(sum != ctx->slot_sum[i]) {
+            fprintf(stderr, "%s read-back mismatch at %u: wrote 0x%x read 0x%x\n",
+                    what, i * STREAM_SLOT_SIZE, ctx->slot_sum[i], sum);
+            return -1;
+        }
+    }
+    return 0;
 }
 
-static uint32_t get_check_sum(int file_size)
+/*
+ * Copy one section from the SD image to nand_sector blocks before the end
+ * of the iNAND and check it against the stanza checksum.  sect is the
+ * section the data belongs to, or -1 for the header; a section stored
+ * compressed or with its zero blocks left out is expanded on the way.
+ */
+static int load_section(char *what, char *name_zh, char *name_en,
+        uint32_t sd_offset, int nand_sector, uint32_t size, uint32_t check_sum,
+        int sect, RGBLCD *bar_color, RGBLCD *trim_color)
 {
-    int remnant_size, size, ret = 0;
-    remnant_size = file_size;
-    size = 0;
-    while(remnant_size / INAND_SIZE_PER_WRITE > 0) {
-    size += read(fd_inand, buffer, INAND_SIZE_PER_WRITE);
-    ret += get_sum(buffer, INAND_SIZE_PER_WRITE);
-    remnant_size = file_size - size;
+    LoadingCtx ctx = { name_zh, name_en, bar_color, trim_color, 0, NULL, 0 };
+    struct stanza *stp;
+    uint32_t nand_size = size;
+    char err[120];
+    off_t pos;
+    int codec = CODEC_NONE, ret = 0;
+
+    lseek(fd_sd, sd_offset, SEEK_SET);
+    pos = lseek(fd_inand, (off_t)nand_sector * INAND_BLOCK_SIZE, SEEK_END);
+
+    if(sect >= 0 && fw_ext) {
+        stp = (struct stanza *)((void *)fw_fh + sects[sect].stanzaOffset);
+        nand_size = stp->nand.size;
+        codec = fw_ext->sect[sect].codec;
+    }
+    if(sect >= 0 && fw_ext && fw_ext->sect[sect].extent_offset) {
+        ctx.ext = (struct fw_extent *)((void *)fw_ext + fw_ext->sect[sect].extent_offset);
+        ctx.ext_count = fw_ext->sect[sect].extent_count;
+        ctx.base = pos;
+        if(clear_gaps(&ctx, nand_size) < 0) {
+            fprintf(stderr, "%s: clearing zero blocks fails %s\n", what, strerror(errno));
+            return -1;
+        }
     }
-    size += read(fd_inand, buffer, remnant_size);
-    ret += get_sum(buffer, remnant_size);
 
+    /* per-slot sums only line up with the iNAND for plain copies */
+    if(!ctx.ext && codec == CODEC_NONE) {
+        ctx.slot_sum = malloc((size / STREAM_SLOT_SIZE + 1) * sizeof(uint32_t));
+        if(ctx.slot_sum == NULL) {
+            fprintf(stderr, "malloc buffer failed\n");
+            return -1;
+        }
+    }
+
+    if(codec != CODEC_NONE) {
+        ctx.left = fw_ext->sect[sect].size;
+        ctx.dec = decode_open(codec, inand_sink, &ctx);
+        if(ctx.dec == NULL)
+            return -1;
+        ret = stream_copy(fd_sd, size, coded_sink, &ctx);
+        if(decode_close(ctx.dec) < 0) {
+            fprintf(stderr, "decode: truncated stream\n");
+            ret = -1;
+        } else if(ctx.left)
+            ret = -1;
+    } else
+        ret = stream_copy(fd_sd, size, inand_sink, &ctx);
+    if(ret < 0)
+        goto out;
+    update_progress(&ctx, 1);
+
+    if(ctx.sum != check_sum) { 
+        sprintf(err, "%s xsum fail: expected %d calc'ed %d", 
+                what, check_sum, ctx.sum); 
+        ret = -1;
+    } else if(verify_mode != VERIFY_STREAM 
+            && readback_verify(what, pos, nand_size, &ctx) < 0) {
+        sprintf(err, "%s read-back verify fail", what);
+        ret = -1;
+    }
+    if(ret) {
+        fprintf(stderr, "%s\n", err);
+#warning missing chinese
+        draw_string_en(err);
+        sleep(5);
+    }
+out:
+    free(ctx.slot_sum);
     return ret;
 }
 
+/*
+ * Write the file header to the iNAND.  A HEAD_MAGIC_EXT file gets plain
+ * HEAD_MAGIC there, as that is what qi and u-boot boot from; the byte sum
+ * leaves the magic out, so the check above it still holds.
+ */
+static int load_header(char *what, int nand_sector, uint32_t hdr_sum,
+        RGBLCD *bar_color, RGBLCD *trim_color)
+{
+    uint32_t magic = HEAD_MAGIC;
+    off_t pos;
+
+    if(load_section(what, "... ", "Upgrading... ", 0, nand_sector,
+            fw_fh->fh_size, hdr_sum, -1, bar_color, trim_color))
+        return -1;
+    if(fw_fh->magic == HEAD_MAGIC)
+        return 0;
+    pos = lseek(fd_inand, (off_t)nand_sector * INAND_BLOCK_SIZE, SEEK_END);
+    if(pos < 0 || pwrite(fd_inand, &magic, sizeof(magic), pos) != sizeof(magic)
+            || fdatasync(fd_inand) < 0) {
+        fprintf(stderr, "%s: writing the magic fails %s\n", what, strerror(errno));
+#warning missing chinese
+        draw_string_en("FATAL: writing the file header fails!");
+        sleep(5);
+        return -1;
+    }
+    return 0;
+}
+
 static int loading_firmware(char *inand_device, RGBLCD *bar_color, RGBLCD *trim_color)
 {
-    char err[120];
+    uint32_t hdr_sum;
+    int rootfs_image, ret;
     /* draw the external box of progress bar first */
     fill_broken_rect(sb, PROGRESS_BAR_X_OFFSET, PROGRESS_BAR_ZH_OFFSET, PROGRESS_BAR_WIDTH, PROGRESS_BAR_HEIGHT, trim_color);
     old_ratio = ratio = 0;
     size_sum = 0;
 
-    /* write the firmware_fileheader into the inand */
-    lseek(fd_sd, 0, SEEK_SET);
-    lseek(fd_inand, -ZIMAGE_INITRAMFS_SECTORS * INAND_BLOCK_SIZE, SEEK_END);
-    loading("... ", "Upgrading... ",  fw_fh->fh_size, bar_color, trim_color);
-    /* calculate the checksum of firmware_fileheader1 */
-    lseek(fd_inand, -ZIMAGE_INITRAMFS_SECTORS * INAND_BLOCK_SIZE + 8, SEEK_END);
-    inand_check_sum = get_check_sum(fw_fh->fh_size - 8);
-    if(inand_check_sum != fw_fh->check_sum) { 
-        sprintf(err, "file header1 xsum fail: expected %d calc'ed %d", 
-                fw_fh->check_sum, inand_check_sum); 
-        fprintf(stderr,"%s\n", err);
+    /*
+     * the header stanza sum leaves out magic and check_sum themselves,
+     * while the fused sum sees every byte
+     */
+    hdr_sum = fw_fh->check_sum + fw_byte_sum((unsigned char *)fw_fh, 8);
 
-#warning missing chinese
-        draw_string_en(err);
-        sleep(5);
+    /* write the firmware_fileheader into the inand */
+    if(load_header("file header1", -ZIMAGE_INITRAMFS_SECTORS, hdr_sum,
+            bar_color, trim_color))
         return -1;
 
-    }
-    
     /* write the u-boot into the inand */
-    lseek(fd_sd, (fw_fh->u_boot).file.offset, SEEK_SET);
-    lseek(fd_inand, (-ZIMAGE_INITRAMFS_SECTORS + (fw_fh->u_boot).nand.offset) * INAND_BLOCK_SIZE, SEEK_END);
-    loading("... ", "Upgrading... ", (fw_fh->u_boot).file.size, bar_color, trim_color);
-    /* calculate the checksum of u-boot1 */
-    lseek(fd_inand, (-ZIMAGE_INITRAMFS_SECTORS + (fw_fh->u_boot).nand.offset) * INAND_BLOCK_SIZE, SEEK_END);
-    inand_check_sum = get_check_sum((fw_fh->u_boot).file.size);
-    if(inand_check_sum != (fw_fh->u_boot).check_sum) { 
-        sprintf(err, "u_boot1 xsum fail: expected %d calc'ed %d", 
-               (fw_fh->u_boot).check_sum, inand_check_sum); 
-        fprintf(stderr,"%s\n", err);
-#warning missing chinese
-        draw_string_en(err);
-        sleep(5);
+    if(load_section("u_boot1", "... ", "Upgrading... ", (fw_fh->u_boot).file.offset,
+            -ZIMAGE_INITRAMFS_SECTORS + (int)(fw_fh->u_boot).nand.offset,
+            (fw_fh->u_boot).file.size, (fw_fh->u_boot).check_sum, U_BOOT, bar_color, trim_color))
         return -1;
-
-    }
    
     /* write the zimage into the inand */
-    lseek(fd_sd, (fw_fh->zimage).file.offset, SEEK_SET);
-    lseek(fd_inand, (-ZIMAGE_INITRAMFS_SECTORS + (fw_fh->zimage).nand.offset) * INAND_BLOCK_SIZE, SEEK_END);
-    loading("... ", "Upgrading... ", (fw_fh->zimage).file.size, bar_color, trim_color);
-    /* calculate the checksum of zimage1 */
-    lseek(fd_inand, (-ZIMAGE_INITRAMFS_SECTORS + (fw_fh->zimage).nand.offset) * INAND_BLOCK_SIZE, SEEK_END);
-    inand_check_sum = get_check_sum((fw_fh->zimage).file.size);
-    if(inand_check_sum != (fw_fh->zimage).check_sum) { 
-        sprintf(err, "zimage1 xsum fail: expected %d calc'ed %d", 
-                (fw_fh->zimage).check_sum, inand_check_sum); 
-        fprintf(stderr, "%s\n", err);
-        draw_string_en(err);
-        sleep(5);
+    if(load_section("zimage1", "... ", "Upgrading... ", (fw_fh->zimage).file.offset,
+            -ZIMAGE_INITRAMFS_SECTORS + (int)(fw_fh->zimage).nand.offset,
+            (fw_fh->zimage).file.size, (fw_fh->zimage).check_sum, ZIMAGE, bar_color, trim_color))
         return -1;
-
-    }
     
     /* write the initramfs into the inand */
-    lseek(fd_inand, (-ZIMAGE_INITRAMFS_SECTORS + (fw_fh->initramfs).nand.offset) * INAND_BLOCK_SIZE, SEEK_END);
-    loading("... ", "Upgrading... ", (fw_fh->initramfs).file.size, bar_color, trim_color);
-    /* calculate the checksum of initramfs1 */
-    lseek(fd_inand, (-ZIMAGE_INITRAMFS_SECTORS + (fw_fh->initramfs).nand.offset) * INAND_BLOCK_SIZE, SEEK_END);
-    inand_check_sum = get_check_sum((fw_fh->initramfs).file.size);
-    if(inand_check_sum != (fw_fh->initramfs).check_sum) { 
-        sprintf(err, "initramfs1 xsum fail: expected %d calc'ed %d", 
-                (fw_fh->initramfs).check_sum, inand_check_sum); 
-        fprintf(stderr, "%s\n", err);
-        draw_string_en(err);
-        sleep(5);
+    if(load_section("initramfs1", "... ", "Upgrading... ", (fw_fh->initramfs).file.offset,
+            -ZIMAGE_INITRAMFS_SECTORS + (int)(fw_fh->initramfs).nand.offset,
+            (fw_fh->initramfs).file.size, (fw_fh->initramfs).check_sum, INITRAMFS, bar_color, trim_color))
         return -1;
-    }
     
     /* write the firmware_fileheader backup into the inand */
-    lseek(fd_sd, 0, SEEK_SET);
-    lseek(fd_inand, -ZIMAGE_INITRAMFS_SECTORS * INAND_BLOCK_SIZE / 2, SEEK_END);
-    loading("... ", "Upgrading... ", fw_fh->fh_size, bar_color, trim_color);
-    /* calculate the checksum of firmware_fileheader2 */
-    lseek(fd_inand, -ZIMAGE_INITRAMFS_SECTORS * INAND_BLOCK_SIZE / 2 + 8, SEEK_END);
-    inand_check_sum = get_check_sum(fw_fh->fh_size - 8);
-    if(inand_check_sum != fw_fh->check_sum) { 
-        sprintf(err, "file header2 xsum fail: expected %d calc'ed %d", 
-                fw_fh->check_sum, inand_check_sum); 
-        fprintf(stderr, "%s\n", err);
-        draw_string_en(err);
-        sleep(5);
+    if(load_header("file header2", -ZIMAGE_INITRAMFS_SECTORS / 2, hdr_sum,
+            bar_color, trim_color))
         return -1;
-    }
 
     /* write the u-boot backup into the inand */
-    lseek(fd_sd, (fw_fh->u_boot).file.offset, SEEK_SET);
-    lseek(fd_inand, (-ZIMAGE_INITRAMFS_SECTORS / 2 + (fw_fh->u_boot).nand.offset) * INAND_BLOCK_SIZE, SEEK_END);
-    loading("... ", "Upgrading... ", (fw_fh->u_boot).file.size, bar_color, trim_color);
-    /* calculate the checksum of u-boot2 */
-    lseek(fd_inand, (-ZIMAGE_INITRAMFS_SECTORS / 2 + (fw_fh->u_boot).nand.offset) * INAND_BLOCK_SIZE, SEEK_END);
-    inand_check_sum = get_check_sum((fw_fh->u_boot).file.size);
-    if(inand_check_sum != (fw_fh->u_boot).check_sum) { 
-        sprintf(err, "u_boot2 xsum fail: expected %d calc'ed %d", 
-                      (fw_fh->u_boot).check_sum, inand_check_sum); 
-        fprintf(stderr, "%s\n", err);
-        draw_string_en(err);
-        sleep(5);
+    if(load_section("u_boot2", "... ", "Upgrading... ", (fw_fh->u_boot).file.offset,
+            -ZIMAGE_INITRAMFS_SECTORS / 2 + (int)(fw_fh->u_boot).nand.offset,
+            (fw_fh->u_boot).file.size, (fw_fh->u_boot).check_sum, U_BOOT, bar_color, trim_color))
         return -1;
 
-    }
-
     /* write the zimage backup into the inand */
-    lseek(fd_sd, (fw_fh->zimage).file.offset, SEEK_SET);
-    lseek(fd_inand, (-ZIMAGE_INITRAMFS_SECTORS / 2 + (fw_fh->zimage).nand.offset) * INAND_BLOCK_SIZE, SEEK_END);
-    loading("... ", "Upgrading... ", (fw_fh->zimage).file.size, bar_color, trim_color);
-    /* calculate the checksum of zimage2 */
-    lseek(fd_inand, (-ZIMAGE_INITRAMFS_SECTORS / 2 + (fw_fh->zimage).nand.offset) * INAND_BLOCK_SIZE, SEEK_END);
-    inand_check_sum = get_check_sum((fw_fh->zimage).file.size);
-    if(inand_check_sum != (fw_fh->zimage).check_sum) { 
-        sprintf(err, "zimage2 xsum fail: expected %d calc'ed %d", 
-                (fw_fh->zimage).check_sum, inand_check_sum); 
-        fprintf(stderr, "%s\n", err);
-        draw_string_en(err);
-        sleep(5);
+    if(load_section("zimage2", "... ", "Upgrading... ", (fw_fh->zimage).file.offset,
+            -ZIMAGE_INITRAMFS_SECTORS / 2 + (int)(fw_fh->zimage).nand.offset,
+            (fw_fh->zimage).file.size, (fw_fh->zimage).check_sum, ZIMAGE, bar_color, trim_color))
         return -1;
-    }
     
     /* write the initramfs backup into the inand */
-    lseek(fd_inand, (-ZIMAGE_INITRAMFS_SECTORS / 2 + (fw_fh->initramfs).nand.offset) * INAND_BLOCK_SIZE, SEEK_END);
-    loading("... ", "Upgrading... ", (fw_fh->initramfs).file.size, bar_color, trim_color);
-    /* calculate the checksum of initramfs2 */
-    lseek(fd_inand, (-ZIMAGE_INITRAMFS_SECTORS / 2 + (fw_fh->initramfs).nand.offset) * INAND_BLOCK_SIZE, SEEK_END);
-    inand_check_sum = get_check_sum((fw_fh->initramfs).file.size);
-    if(inand_check_sum != (fw_fh->initramfs).check_sum) { 
-        sprintf(err, "initramfs2 xsum fail: expected %d calc'ed %d", 
-                      (fw_fh->initramfs).check_sum, inand_check_sum); 
-        fprintf(stderr, "%s\n", err);
-        draw_string_en(err);
-        sleep(5);
+    if(load_section("initramfs2", "... ", "Upgrading... ", (fw_fh->initramfs).file.offset,
+            -ZIMAGE_INITRAMFS_SECTORS / 2 + (int)(fw_fh->initramfs).nand.offset,
+            (fw_fh->initramfs).file.size, (fw_fh->initramfs).check_sum, INITRAMFS, bar_color, trim_color))
         return -1;
-    }
 
     close(fd_inand);
 
@@ -626,29 +983,38 @@ static int loading_firmware(char *inand_device, RGBLCD *bar_color, RGBLCD *trim_
         system("mkdir /mnt/upgrade\n");
 
         if(!keep_userzone) {
-            /* mount the inand device to /mnt/upgrade */
             sprintf(inand_partition_path, "%sp%d", inand_device, 2);
+            lseek(fd_sd, (fw_fh->homefs).file.offset, SEEK_SET);
+            fprintf(stderr, "(fw_fh->homefs).file.offset = %d\n", (fw_fh->homefs).file.offset);
+            if(is_fs_image(HOMEFS)) {
+                /* write the homefs image straight to the partition */
+                if(0 != loading_image(inand_partition_path, "... ", "Upgrading... ", HOMEFS, bar_color, trim_color))
+                return -1;
+            } else {
+            /* mount the inand device to /mnt/upgrade */
             sprintf(system_cmd, "mount -t ext3 %s /mnt/upgrade/", inand_partition_path);
             system(system_cmd);
             fprintf(stderr, "%s\n", system_cmd);
 
             /* tar the homefs into the inand */
-            lseek(fd_sd, (fw_fh->homefs).file.offset, SEEK_SET);
-            fprintf(stderr, "(fw_fh->homefs).file.offset = %d\n", (fw_fh->homefs).file.offset);
             if(0 != loading_fs("... ", "Upgrading... ", (fw_fh->homefs).file.size, bar_color, trim_color))
             return -1;
             sync();
             umount("/mnt/upgrade");
             fprintf(stderr, "umount /mnt/upgrade\n");
+            }
             if(old_size_sum == size_sum)
                 size_sum += (fw_fh->homefs).file.size;
         }
 
-        /* mount the inand device to /mnt/upgrade */
         sprintf(inand_partition_path, "%sp%d", inand_device, 1);
+        rootfs_image = is_fs_image(ROOTFS);
+        if(!rootfs_image) {
+        /* mount the inand device to /mnt/upgrade */
         sprintf(system_cmd, "mount -t ext3 %s /mnt/upgrade/", inand_partition_path);
         system(system_cmd);
         fprintf(stderr, "%s\n", system_cmd);
+        }
 
         /* tar the rootfs into the inand */
         lseek(fd_sd, (fw_fh->rootfs).file.offset, SEEK_SET);
@@ -661,7 +1027,11 @@ static int loading_firmware(char *inand_device, RGBLCD *bar_color, RGBLCD *trim_
             return -1;
         }
 
-        if(0 != loading_fs("... ", "Upgrading... ", (fw_fh->rootfs).file.size, bar_color, trim_color))  {
+        if(rootfs_image)
+            ret = loading_image(inand_partition_path, "... ", "Upgrading... ", ROOTFS, bar_color, trim_color);
+        else
+            ret = loading_fs("... ", "Upgrading... ", (fw_fh->rootfs).file.size, bar_color, trim_color);
+        if(0 != ret)  {
            draw_string_en("Loading rootfs fails");
            sleep(5);
            return -1;
@@ -673,8 +1043,10 @@ static int loading_firmware(char *inand_device, RGBLCD *bar_color, RGBLCD *trim_
            PROGRESS_BAR_TRIM,
            bar_color, trim_color);
        sync();
+       if(!rootfs_image) {
        umount("/mnt/upgrade");
        fprintf(stderr, "umount /mnt/upgrade\n");
+       }
     }
 
     return 0;
@@ -737,12 +1109,26 @@ int main( int argc, char *argv[] )
     struct input_event event;
     struct timeval tpStart, tpEnd;
 
-    if(argc != 4) {
-        fprintf(stderr, "usage: ./upgrade firmware_file inand_device 0/1\n"
+    if(argc != 4 && argc != 5) {
+        fprintf(stderr, "usage: ./upgrade firmware_file inand_device 0/1 [stream|sample|full]\n"
                         "0: don't upgrade rootfs and homefs\n"
-                        "1: upgrade all\n");
+                        "1: upgrade all\n"
+                        "stream: verify checksums as the data is written (default)\n"
+                        "sample: also read back every %dth MB from the iNAND\n"
+                        "full:   also read back everything from the iNAND\n",
+                        VERIFY_SAMPLE_STRIDE);
         return -1;
     }
+    if(argc == 5) {
+        if(!strcmp(argv[4], "sample"))
+            verify_mode = VERIFY_SAMPLE;
+        else if(!strcmp(argv[4], "full"))
+            verify_mode = VERIFY_FULL;
+        else if(strcmp(argv[4], "stream")) {
+            fprintf(stderr, "unknown verify mode %s\n", argv[4]);
+            return -1;
+        }
+    }
 
     for (i = 0 ; i < argc ; i++)
         fprintf(stderr, "arg[%d] = %s\n", i, argv[i]);
@@ -791,6 +1177,18 @@ int main( int argc, char *argv[] )
         return -1;
     }
 
+    if(verify_mode != VERIFY_STREAM) {
+        fd_verify = open(argv[2], O_RDONLY | O_DIRECT);
+        if(fd_verify == -1) {
+            fprintf(stderr, "main: no O_DIRECT on %s, read-back goes through the page cache\n", argv[2]);
+            fd_verify = open(argv[2], O_RDONLY);
+        }
+        if(fd_verify == -1) {
+            fprintf(stderr, "main: can't open %s for read-back\n", argv[2]);
+            verify_mode = VERIFY_STREAM;
+        }
+    }
+
     if(1 == loading_homefs) {
         keys_fd = open("/dev/input/event1", O_RDONLY);
         if(keys_fd <= 0)
@@ -848,21 +1246,16 @@ int main( int argc, char *argv[] )
         draw_string_en("Verifying the firmware failed!\n");
         goto fail2;
     }
-
-    /* bizarre algorithm left for your amusement : WTF, over. */
-    total_size_sum = fw_fh->homefs.file.offset;
+    if(extract_ext(argv[1], fw_fh, &fw_ext) != 0) {
+        fprintf(stderr, "main: header extension of %s is bad\n", argv[1]);
+        draw_string_zh("У̼ʧܣ\n");
+        draw_string_en("Verifying the firmware failed!\n");
+        ret = -1;
+        goto fail2;
+    }
 
     /* add in size of homefs if we are using it */
-    if(!keep_userzone)
-       total_size_sum += fw_fh->homefs.file.size;
-
-    total_size_sum += fw_fh->fh_size + 
-                      fw_fh->u_boot.file.size +
-                      fw_fh->zimage.file.size + 
-                      fw_fh->initramfs.file.size;
-
-    /* got me on this one */
-    total_size_sum -= fw_fh->qi.file.size;
+    total_size_sum = fw_upgrade_size(fw_fh, !keep_userzone);
 
     fprintf(stderr, "total_size_sum = %d\n", total_size_sum);
 
@@ -904,11 +1297,14 @@ int main( int argc, char *argv[] )
         draw_string_zh("ڸʽ...\n");
         draw_string_en("Formatting root partition...\n");
 
+        /* image sections bring their own filesystem */
+        if(!is_fs_image(ROOTFS)) {
         sprintf(system_cmd, "mkfs.ext3 %sp%d -L root 1>/dev/null", argv[2], 1);
         system(system_cmd);
         fprintf(stderr, "%s\n", system_cmd);
+        }
 
-        if(!keep_userzone) {
+        if(!keep_userzone && !is_fs_image(HOMEFS)) {
             draw_string_zh("ڸʽû...\n");
             draw_string_en("Formatting home partition...\n");
             sprintf(system_cmd, "mkfs.ext3 %sp%d -L home 1>/dev/null", argv[2], 2);
@@ -925,26 +1321,16 @@ int main( int argc, char *argv[] )
     }
 
     /* write the sd procedure into the INAND beginning at the last 18 block position */
-    lseek(fd_sd, (fw_fh->qi).file.offset, SEEK_SET);
-    lseek(fd_inand, -18 * INAND_BLOCK_SIZE, SEEK_END);
     if(sb->bytes_per_pixel == 4) 
-        loading(" (qi)", "loading (qi)", (fw_fh->qi).file.size, &COLOR_BAR, &COLOR_TRIM);
+        ret = load_section("qi", " (qi)", "loading (qi)", (fw_fh->qi).file.offset,
+                -18, (fw_fh->qi).file.size, (fw_fh->qi).check_sum, QI,
+                &COLOR_BAR, &COLOR_TRIM);
     else
-        loading(" (qi)", "loading (qi)", (fw_fh->qi).file.size, &COLOR_BAR_16, &COLOR_TRIM_16);
-    /* calculate the checksum of qi */
-    lseek(fd_inand, -18 * INAND_BLOCK_SIZE, SEEK_END);
-    inand_check_sum = get_check_sum((fw_fh->qi).file.size);
-    if(inand_check_sum != (fw_fh->qi).check_sum) { 
-        char err[120];
-        sprintf(err, "qi xsum failed: expected = %d, calc'ed = %d", 
-           (fw_fh->qi).check_sum, inand_check_sum); 
-        fprintf(stderr,"%s\n", err);
-#warning missing chinese
-        draw_string_en(err);
-        sleep(5);
-
+        ret = load_section("qi", " (qi)", "loading (qi)", (fw_fh->qi).file.offset,
+                -18, (fw_fh->qi).file.size, (fw_fh->qi).check_sum, QI,
+                &COLOR_BAR_16, &COLOR_TRIM_16);
+    if(ret)
         return -1;
-    }
 
     /* write the last 2 blocks of INAND to 0 */
     lseek(fd_inand, -2 * INAND_BLOCK_SIZE, SEEK_END);
@@ -967,8 +1353,11 @@ int main( int argc, char *argv[] )
         draw_string_en("Upgrade failed!\n");
     }
     close(fd_sd);
+    if(fd_verify != -1)
+        close(fd_verify);
     free(buffer);
 fail2:
+    free(fw_ext);
     free(fw_fh);
     close_font();
 fail1:
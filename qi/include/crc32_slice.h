@@ -0,0 +1 @@
+../../u-boot/include/crc32_slice.h
\ No newline at end of file
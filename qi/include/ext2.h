@@ -72,9 +72,21 @@ typedef enum
   MAX_ERR_NUM
 } ext2fs_error_t;
 
+/* htree directory hashes, see ext2_hash.c */
+#define DX_HASH_LEGACY			0
+#define DX_HASH_HALF_MD4		1
+#define DX_HASH_TEA			2
+#define DX_HASH_LEGACY_UNSIGNED		3
+#define DX_HASH_HALF_MD4_UNSIGNED	4
+#define DX_HASH_TEA_UNSIGNED		5
+
 
 extern int ext2fs_ls(char *dirname);
 extern int ext2fs_open(const char *filename);
 extern int ext2fs_read(char *buf, unsigned len);
+extern int ext2fs_read_at(char *buf, unsigned pos, unsigned len);
 extern int ext2fs_mount(void);
 extern int ext2fs_close(void);
+extern void ext2fs_devread_stats(void);
+extern u32 ext2fs_dirhash(int version, const u32 seed[4], const char *name,
+								      int len);
@@ -0,0 +1 @@
+../../u-boot/include/memops.h
\ No newline at end of file
@@ -108,6 +108,7 @@ struct board_api {
 	u8 (*get_ui_keys)(void);
 	u8 (*get_ui_debug)(void);
 	void (*set_ui_indication)(enum ui_indication);
+	unsigned int (*get_us)(void); /* a microsecond clock, for the profile */
 
 	struct kernel_source kernel_source[8];
 };
@@ -124,6 +125,7 @@ void printhex(unsigned char v);
 void print8(unsigned char u);
 void print32(unsigned int u);
 void printdec(int n);
+unsigned int udivmod(unsigned int n, unsigned int d, unsigned int *rem);
 void hexdump(unsigned char *start, int len);
 void udelay(int n);
 
@@ -131,6 +133,8 @@ void udelay(int n);
 void setnybble(char *p, unsigned char n);
 void set8(char *p, unsigned char n);
 void set32(char *p, unsigned int u);
+void malloc_reset(void);
+void malloc_stats(void);
 
 unsigned long crc32(unsigned long crc, const unsigned char *buf,
 							      unsigned int len);
@@ -0,0 +1,23 @@
+/*
+ * Bus clocks and a microsecond clock for s3c64xx
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef __TIMER_S3C64XX_H__
+#define __TIMER_S3C64XX_H__
+
+extern unsigned int get_hclk_s3c64xx(void);
+extern unsigned int get_pclk_s3c64xx(void);
+extern void timer_init_s3c64xx(void);
+extern unsigned int timer_us_s3c64xx(void);
+
+#endif
@@ -0,0 +1 @@
+../../u-boot/include/unlz4.h
\ No newline at end of file
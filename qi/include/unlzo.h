@@ -0,0 +1 @@
+../../u-boot/include/unlzo.h
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <neo_gta03.h>
 #include <s3c6410.h>
 #include <serial-s3c64xx.h>
+#include <timer-s3c64xx.h>
 
 #define GTA03_DEBUG_UART 3
 
@@ -85,6 +86,7 @@ const struct board_api board_api_gta03 = {
 	.noboot = "boot/noboot-GTA03",
 	.append = "boot/append-GTA03",
 	.get_ui_keys = get_ui_keys_gta03,
+	.get_us = timer_us_s3c64xx,
 	.commandline_board = "console=tty0 " \
 			     "console=ttySAC3,115200 " \
 			     "init=/bin/sh " \
@@ -20,6 +20,7 @@
 
 #include "hs_mmc.h"
 #include <mmc.h>
+#include <timer-s3c64xx.h>
 
 #define SDI_Tx_buffer_HSMMC		(0x51000000)
 #define SDI_Rx_buffer_HSMMC		(0x51000000+(0x300000))
@@ -31,11 +32,8 @@
 
 /*  Global variables */
 
-static u32 HS_DMA_END = 0;
 static u32 rca = 0;
 
-static ulong HCLK;
-
 int movi_hc = 1; /* sdhc style block indexing */
 enum card_type card_type;
 
@@ -43,13 +41,16 @@ enum card_type card_type;
 extern ulong get_HCLK(void);
 
 
-#define s3c_hsmmc_readl(x)	*((unsigned int *)(((ELFIN_HSMMC_BASE + (HSMMC_CHANNEL * 0x100000)) + (x))))
-#define s3c_hsmmc_readw(x)	*((unsigned short *)(((ELFIN_HSMMC_BASE + (HSMMC_CHANNEL * 0x100000)) + (x))))
-#define s3c_hsmmc_readb(x)	*((unsigned char *)(((ELFIN_HSMMC_BASE + (HSMMC_CHANNEL * 0x100000)) + (x))))
+/* the controller the card is on, HSMMC_CHANNEL unless we were told another */
+static u32 hsmmc_base = ELFIN_HSMMC_BASE + (HSMMC_CHANNEL * 0x100000);
+
+#define s3c_hsmmc_readl(x)	*((unsigned int *)(hsmmc_base + (x)))
+#define s3c_hsmmc_readw(x)	*((unsigned short *)(hsmmc_base + (x)))
+#define s3c_hsmmc_readb(x)	*((unsigned char *)(hsmmc_base + (x)))
 
-#define s3c_hsmmc_writel(v,x)	*((unsigned int *) (((ELFIN_HSMMC_BASE + (HSMMC_CHANNEL * 0x100000)) + (x)))) = v
-#define s3c_hsmmc_writew(v,x)	*((unsigned short *)(((ELFIN_HSMMC_BASE + (HSMMC_CHANNEL * 0x100000)) + (x)))) = v
-#define s3c_hsmmc_writeb(v,x)	*((unsigned char *)(((ELFIN_HSMMC_BASE + (HSMMC_CHANNEL * 0x100000)) + (x)))) = v
+#define s3c_hsmmc_writel(v,x)	*((unsigned int *) (hsmmc_base + (x))) = v
+#define s3c_hsmmc_writew(v,x)	*((unsigned short *)(hsmmc_base + (x))) = v
+#define s3c_hsmmc_writeb(v,x)	*((unsigned char *)(hsmmc_base + (x))) = v
 
 #define readl(x)	*((unsigned int *)(x))
 #define writel(v, x)	*((unsigned int *)(x)) = v
@@ -71,7 +72,7 @@ extern ulong get_HCLK(void);
 static int wait_for_cmd_done (void)
 {
 	u32 i;
-	ushort n_int, e_int;
+	u16 n_int, e_int;
 
 	dbg("wait_for_cmd_done\n");
 	for (i = 0; i < 0x20000000; i++) {
@@ -106,7 +107,7 @@ static void ClearCommandCompleteStatus(void)
 	}
 }
 
-static void card_irq_enable(ushort temp)
+static void card_irq_enable(u16 temp)
 {
 	s3c_hsmmc_writew((s3c_hsmmc_readw(HM_NORINTSTSEN) & 0xFEFF) | (temp << 8), HM_NORINTSTSEN);
 }
@@ -140,7 +141,7 @@ static void set_arg_register (u32 arg)
 	s3c_hsmmc_writel(arg, HM_ARGUMENT);
 }
 
-static void set_blkcnt_register(ushort uBlkCnt)
+static void set_blkcnt_register(u16 uBlkCnt)
 {
 	s3c_hsmmc_writew(uBlkCnt, HM_BLKCNT);
 }
@@ -150,7 +151,7 @@ static void SetSystemAddressReg(u32 SysAddr)
 	s3c_hsmmc_writel(SysAddr, HM_SYSAD);
 }
 
-static void set_blksize_register(ushort uDmaBufBoundary, ushort uBlkSize)
+static void set_blksize_register(u16 uDmaBufBoundary, u16 uBlkSize)
 {
 	s3c_hsmmc_writew((uDmaBufBoundary << 12) | (uBlkSize), HM_BLKSIZE);
 }
@@ -163,7 +164,7 @@ static void ClearErrInterruptStatus(void)
 	}
 }
 
-static void InterruptEnable(ushort NormalIntEn, ushort ErrorIntEn)
+static void InterruptEnable(u16 NormalIntEn, u16 ErrorIntEn)
 {
 	ClearErrInterruptStatus();
 	s3c_hsmmc_writew(NormalIntEn, HM_NORINTSTSEN);
@@ -215,9 +216,9 @@ static void set_clock (u32 clksrc, u32 div)
 	hsmmc_clock_onoff(1);
 }
 
-static void set_cmd_register (ushort cmd, u32 data, u32 flags)
+static void set_cmd_register (u16 cmd, u32 data, u32 flags)
 {
-	ushort val = (cmd << 8);
+	u16 val = (cmd << 8);
 
 	if (cmd == 12)
 		val |= (3 << 6);
@@ -244,7 +245,7 @@ static void set_cmd_register (ushort cmd, u32 data, u32 flags)
 	s3c_hsmmc_writew(val, HM_CMDREG);
 }
 
-static int issue_command (ushort cmd, u32 arg, u32 data, u32 flags)
+static int issue_command (u16 cmd, u32 arg, u32 data, u32 flags)
 {
 	int i;
 
@@ -347,6 +348,7 @@ static int set_bus_width (u32 width)
 		}
 	}
 
+	reg &= ~((1 << 5) | (1 << 1));
 	if (bitmode == 2)
 		reg |= 1 << 5;
 	else
@@ -360,38 +362,158 @@ static int set_bus_width (u32 width)
 	return 0;
 }
 
-static void clock_config (u32 Divisior)
+/*
+ * SDCLK from HCLK, as fast as the divider gets it without passing max.
+ * Above 25MHz the host has to drive the card in high speed timing too.
+ * Returns the clock set.
+ */
+static u32 clock_config (u32 max)
 {
-	if (100000000 / (Divisior * 2) > 25000000) 	// Higher than 25MHz, it is necessary to enable high speed mode of the host controller.
+	u32 hclk = get_hclk_s3c64xx();
+	u32 div = 1;	/* SDCLK = HCLK / (2 * div), div a power of 2 */
+	int shift = 1;	/* so SDCLK = HCLK >> shift */
+
+	while ((hclk >> shift) > max && div < 0x80) {
+		div <<= 1;
+		shift++;
+	}
+
+	if (max > 25000000)
 		set_hostctl_speed(HIGH);
 	else
 		set_hostctl_speed(NORMAL);
 
 	hsmmc_clock_onoff(0);		// when change the sd clock frequency, need to stop sd clock.
-	set_clock(SD_EPLL, Divisior);
+	set_clock(SD_HCLK, div);
+
+	return hclk >> shift;
 }
 
-static void check_dma_int (void)
+/*
+ * SDMA stops at each boundary of system memory set in HM_BLKSIZE and
+ * raises the DMA interrupt status; writing the next address to HM_SYSAD
+ * lets it carry on inside the same command.  Nothing is signalled to the
+ * CPU, we poll for that, for transfer complete and for errors.  addr is
+ * where the transfer started, the timeout restarts at every boundary.
+ */
+#define SDMA_BOUNDARY_SEL	7	/* 512KB */
+#define SDMA_BOUNDARY		(4096 << SDMA_BOUNDARY_SEL)
+
+static int wait_for_dma(u32 addr)
 {
 	u32 i;
+	u16 n_int;
 
 	for (i = 0; i < 0x10000000; i++) {
-		if (s3c_hsmmc_readw(HM_NORINTSTS) & 0x0002) {
-			HS_DMA_END = 1;
-			s3c_hsmmc_writew(s3c_hsmmc_readw(HM_NORINTSTS) | 0x0002, HM_NORINTSTS);
-			return;
+		n_int = s3c_hsmmc_readw(HM_NORINTSTS);
+		if (n_int & 0x8000)
+			/* any error */
+			break;
+		if (n_int & 0x0002) {
+			/* transfer complete */
+			s3c_hsmmc_writew(0x0002 | 0x0008, HM_NORINTSTS);
+			return 0;
+		}
+		if (n_int & 0x0008) {
+			/* DMA boundary: go on from the next one */
+			addr = (addr & ~(SDMA_BOUNDARY - 1)) + SDMA_BOUNDARY;
+			s3c_hsmmc_writew(0x0008, HM_NORINTSTS);
+			SetSystemAddressReg(addr);
+			i = 0;
 		}
-		if (s3c_hsmmc_readw(HM_NORINTSTS) & 0x8000) {
-			puts("error found: ");
-			print32(s3c_hsmmc_readw(HM_ERRINTSTS));
-			return;
+	}
+
+	if (i == 0x10000000)
+		puts("wait_for_dma: timeout\n");
+	else {
+		puts("DMA error: 0x");
+		print32(s3c_hsmmc_readw(HM_ERRINTSTS));
+		puts("\n");
+	}
+	s3c_hsmmc_writew(s3c_hsmmc_readw(HM_ERRINTSTS), HM_ERRINTSTS);
+	s3c_hsmmc_writew(s3c_hsmmc_readw(HM_NORINTSTS), HM_NORINTSTS);
+	/* the command and data lines, for the next attempt */
+	s3c_hsmmc_writeb(0x6, HM_SWRST);
+
+	return -1;
+}
+
+/* polls for a normal interrupt status bit and acks it, -1 on error */
+static int wait_for_int(u16 bit)
+{
+	u32 i;
+
+	for (i = 0; i < 0x1000000; i++) {
+		if (s3c_hsmmc_readw(HM_NORINTSTS) & 0x8000)
+			break;
+		if (s3c_hsmmc_readw(HM_NORINTSTS) & bit) {
+			s3c_hsmmc_writew(bit, HM_NORINTSTS);
+			return 0;
 		}
 	}
+	ClearErrInterruptStatus();
 
-	puts("check_dma_int: timeout\n");
+	return -1;
 }
 
+/*
+ * CMD6 in switch mode, asking for function 1 (high speed) of group 1.
+ * The 64 byte status it returns says which function group 1 is on now,
+ * in bits 379:376; a card without CMD6 (SD 1.0x) doesn't answer at all.
+ * 1 if the card switched.
+ */
+static int sd_switch_high_speed(void)
+{
+	u32 status[16];
+	int n;
+
+	set_blksize_register(SDMA_BOUNDARY_SEL, 64);
+	set_blkcnt_register(1);
+	set_transfer_mode_register(0, 1, 0, 0, 0);
+
+	if (!issue_command(SD_SWITCH, 0x80fffff1, 1, MMC_RSP_R1))
+		return 0;
 
+	if (wait_for_int(0x0020))	/* buffer read ready */
+		return 0;
+	for (n = 0; n < 16; n++)
+		status[n] = s3c_hsmmc_readl(HM_BDATA);
+	if (wait_for_int(0x0002))	/* transfer complete */
+		return 0;
+
+	return (status[4] & 0xf) == 1;
+}
+
+/*
+ * Runs a selected card on the widest, fastest bus it takes: 4 bits if
+ * ACMD6 gets it there, then SD high speed up to 50MHz if CMD6 switches
+ * it, otherwise normal speed up to 25MHz.  One bit still works for a
+ * card refusing 4, it's just slow.
+ */
+static void set_bus_mode(int verbose)
+{
+	int width = 4;
+	int hs;
+	u32 freq;
+
+	if (set_bus_width(4)) {
+		width = 1;
+		set_bus_width(1);
+	}
+
+	hs = sd_switch_high_speed();
+	freq = clock_config(hs ? 50000000 : 25000000);
+
+	if (!verbose)
+		return;
+	puts("    SD bus: ");
+	printdec(width);
+	puts(" bit, ");
+	printdec(udivmod(freq, 1000000, NULL));
+	puts(hs ? " MHz high speed\n" : " MHz\n");
+}
+
+#ifndef HHTECH_MINIPMP
 static void print_sd_cid(const struct sd_cid *cid)
 {
 	puts("    Card Type: ");
@@ -442,7 +564,6 @@ static void print_sd_cid(const struct sd_cid *cid)
 unsigned int s3c6410_mmc_init (int verbose)
 {
 	u32 reg;
-	u32 width;
 	int resp;
 	int hcs;
 	int retries = 50;
@@ -460,9 +581,6 @@ unsigned int s3c6410_mmc_init (int verbose)
 
 	hsmmc_reset();
 
-	width = 4;
-
-	HCLK = 33000000; /* FIXME */
 	hsmmc_clock_onoff(0);
 
 	reg = readl(SCLK_GATE);
@@ -588,10 +706,7 @@ unsigned int s3c6410_mmc_init (int verbose)
 	if (!resp)
 		return 1;
 
-	/* Operating Clock setting */
-	clock_config(2);	// Divisor 1 = Base clk /2      ,Divisor 2 = Base clk /4, Divisor 4 = Base clk /8 ...
-
-	while (set_bus_width(width));
+	set_bus_mode(verbose);
 	while (!check_card_status());
 
 	/* MMC_SET_BLOCKLEN */
@@ -602,49 +717,96 @@ unsigned int s3c6410_mmc_init (int verbose)
 	return sd_sectors;
 }
 
-unsigned long s3c6410_mmc_bread(int dev_num, unsigned long start_blk, unsigned long blknum,
-								      void *dst)
+#endif
+
+/*
+ * Takes over the card the iROM has brought up and selected already, to read
+ * it here rather than through the iROM's copy routine: the channel it is on
+ * and whether it is block addressed.  The iROM doesn't tell us the RCA, so
+ * the card is deselected and asked for a new one: in stand-by state an SD
+ * card answers CMD3 with a fresh RCA (see the card state transition table of
+ * the SD Physical Layer Simplified Specification), which CMD7 then selects.
+ * SD only, as set_bus_mode() is: the same CMD3 sets an MMC's RCA to its
+ * argument instead, so it gets a nonzero one, and an R1 with no RCA in it
+ * (or no answer in stand-by) tells us it isn't SD.
+ * -1 if the card isn't SD or doesn't end up in transfer state; the iROM's
+ * routine has to set it up again from scratch then.
+ */
+int s3c6410_mmc_attach(int channel, int hc)
 {
-	u32 blksize; //j, , Addr_temp = start_blk;
-	u32 dma = 0, cmd, multi; //, TotalReadByte, read_blk_cnt = 0;
+	hsmmc_base = ELFIN_HSMMC_BASE + (channel * 0x100000);
+	InterruptEnable(0xff, 0xff);
 
-	HS_DMA_END = 0;
+	/* RCA 0 deselects the card, which doesn't answer that */
+	issue_command(MMC_SELECT_CARD, 0, 0, MMC_RSP_NONE);
+	if (!issue_command(SD_SEND_RELATIVE_ADDR, MMC_DEFAULT_RCA, 0, MMC_RSP_R6))
+		return -1;
+	rca = s3c_hsmmc_readl(HM_RSPREG0) >> 16;
+	if (!rca)
+		return -1;
+	if (!issue_command(MMC_SELECT_CARD, rca << 16, 0, MMC_RSP_R1))
+		return -1;
+
+	if (!issue_command(MMC_SEND_STATUS, rca << 16, 0, MMC_RSP_R1))
+		return -1;
+	if (((s3c_hsmmc_readl(HM_RSPREG0) >> 9) & 0xf) != 4)
+		return -1;
 
-	blksize = Card_OneBlockSize_ver1;
+	movi_hc = hc;
+	set_bus_mode(1);
 
-	while (!check_card_status());
+	return 0;
+}
 
-	s3c_hsmmc_writew(s3c_hsmmc_readw(HM_NORINTSTSEN) & ~(DMA_STS_INT_EN | BLOCKGAP_EVENT_STS_INT_EN), HM_NORINTSTSEN);
+/*
+ * Reads blknum blocks of any size as few multiple block reads as the 16 bit
+ * block count allows, each one a single SDMA run across the boundaries.
+ */
+unsigned long s3c6410_mmc_bread(int dev_num, unsigned long start_blk, unsigned long blknum,
+								      void *dst)
+{
+	u32 addr = (u32)dst;
+	unsigned long done, n;
+	u32 cmd, multi;
+
+	s3c_hsmmc_writew(s3c_hsmmc_readw(HM_NORINTSTSEN) & ~BLOCKGAP_EVENT_STS_INT_EN, HM_NORINTSTSEN);
+	s3c_hsmmc_writew(s3c_hsmmc_readw(HM_NORINTSTSEN) | DMA_STS_INT_EN, HM_NORINTSTSEN);
 	s3c_hsmmc_writew((HM_NORINTSIGEN & ~(0xffff)) | TRANSFERCOMPLETE_SIG_INT_EN, HM_NORINTSIGEN);
 
-	SetSystemAddressReg((unsigned long)dst);	// AHB System Address For Write
-	dma = 1;
+	set_blksize_register(SDMA_BOUNDARY_SEL, Card_OneBlockSize_ver1);
 
-	set_blksize_register(7, 512);	// Maximum DMA Buffer Size, Block Size
-	set_blkcnt_register(blknum);	// Block Numbers to Write
+	for (done = 0; done < blknum; done += n) {
+		n = blknum - done;
+		if (n > 0xffff)
+			n = 0xffff;
 
-	if (movi_hc)
-		set_arg_register(start_blk);		// Card Start Block Address to Write
-	else
-		set_arg_register(start_blk * 512);	// Card Start Block Address to Write
+		while (!check_card_status());
 
-	cmd = (blknum > 1) ? 18 : 17;
-	multi = (blknum > 1);
+		SetSystemAddressReg(addr);	// AHB System Address For Write
+		set_blkcnt_register(n);	// Block Numbers to Write
 
-	set_transfer_mode_register(multi, 1, multi, 1, dma);
-	set_cmd_register(cmd, 1, MMC_RSP_R1);
+		if (movi_hc)
+			set_arg_register(start_blk + done);		// Card Start Block Address to Write
+		else
+			set_arg_register((start_blk + done) * 512);	// Card Start Block Address to Write
 
-	if (wait_for_cmd_done()) {
-		puts("Command NOT Complete\n");
-		return -1;
-	} else
-		ClearCommandCompleteStatus();
+		cmd = (n > 1) ? 18 : 17;
+		multi = (n > 1);
 
+		set_transfer_mode_register(multi, 1, multi, 1, 1);
+		set_cmd_register(cmd, 1, MMC_RSP_R1);
 
-	check_dma_int();
-	while (!HS_DMA_END);
+		if (wait_for_cmd_done()) {
+			puts("Command NOT Complete\n");
+			return -1;
+		} else
+			ClearCommandCompleteStatus();
 
-	HS_DMA_END = 0;
+		if (wait_for_dma(addr))
+			return -1;
+
+		addr += n * Card_OneBlockSize_ver1;
+	}
 
 	return blknum;
 }
@@ -1,6 +1,7 @@
 #include <qi.h>
 #include <neo_smdk6410.h>
 #include <serial-s3c64xx.h>
+#include <timer-s3c64xx.h>
 
 #define SMDK6410_DEBUG_UART 0
 
@@ -51,6 +52,7 @@ const struct board_api board_api_smdk6410 = {
 	.get_board_variant = get_board_variant_smdk6410,
 	.is_this_board = is_this_board_smdk6410,
 	.putc = putc_smdk6410,
+	.get_us = timer_us_s3c64xx,
 	.commandline_board = "console=ttySAC0,115200 " \
 			     "loglevel=3 " \
 			     "init=/bin/sh ",
@@ -47,6 +47,39 @@ const struct board_api *boards[] = {
 struct board_api const * this_board;
 extern int is_jtag;
 
+#include <serial-s3c64xx.h>
+#include <timer-s3c64xx.h>
+
+/* blocks read from the card and how long it took, for the boot log */
+static unsigned int sd_blocks;
+static unsigned int sd_us;
+
+static void print_sd_rate(void)
+{
+	unsigned int blocks = sd_blocks, us = sd_us;
+	unsigned int rate, tenths;
+
+	/* 5120 * blocks has to fit 32 bits: scale both past 400MB */
+	while (blocks > 0xffffffff / 5120) {
+		blocks >>= 1;
+		us >>= 1;
+	}
+	if (!us)
+		return;
+	rate = udivmod(blocks * 5120, us, NULL);	/* MB/s * 10 */
+	rate = udivmod(rate, 10, &tenths);
+
+	puts("    ");
+	printdec(sd_blocks >> 1);
+	puts(" KiB in ");
+	printdec(udivmod(sd_us, 1000, NULL));
+	puts(" ms, ");
+	printdec(rate);
+	puts(".");
+	printdec(tenths);
+	puts(" MB/s\n");
+}
+
 #ifdef HHTECH_MINIPMP
 #define RD_MEM_ADDR          (0x53000000) // u-boot run here
 #define UBOOT_BLKS           (256*2)      // max size is 256K
@@ -78,9 +111,34 @@ static inline int CopyMMCtoMem(int chan, u32 startBlkAddr,
 #include <s3c6410.h>
 void led_set(int on);
 int do_load_uboot(void);
-#endif
 
-#include <serial-s3c64xx.h>
+extern int s3c6410_mmc_attach(int channel, int hc);
+extern unsigned long s3c6410_mmc_bread(int dev_num, unsigned long start_blk,
+				       unsigned long blknum, void *dst);
+
+/* set once our own reader has the card from the iROM */
+static int hsmmc_attached;
+/* set if the iROM routine has to bring the card up again for us */
+static int rom_reinit;
+
+/* returns 1 on success, like the iROM routine */
+static int read_sd(u32 start, u32 blocks, void *buf)
+{
+	unsigned int t = timer_us_s3c64xx();
+	int ret;
+
+	if (hsmmc_attached)
+		ret = s3c6410_mmc_bread(0, start, blocks, buf) == blocks;
+	else
+		ret = CopyMMCtoMem(CHANNEL, start, blocks, buf, rom_reinit);
+	rom_reinit = 0;
+
+	sd_us += timer_us_s3c64xx() - t;
+	sd_blocks += blocks;
+
+	return ret;
+}
+#endif
 
 void start_qi(void)
 {
@@ -135,17 +193,24 @@ void start_qi(void)
 
 	puts(stringify2(BUILD_DATE) "  Copyright (C) 2008 Openmoko, Inc.\n\n");
 
+	timer_init_s3c64xx();
+
 #ifdef HHTECH_MINIPMP
-	if( (flag = do_load_uboot()) != 1) {
-	    unsigned int channel = CHANNEL;
+	/*
+	 * The iROM has the card up and selected already.  Read it through
+	 * our own DMA reader on the widest, fastest bus the card takes, or
+	 * the iROM's copy routine if we couldn't take the card over.
+	 */
+	hsmmc_attached = !s3c6410_mmc_attach(CHANNEL, SDHC);
+	rom_reinit = !hsmmc_attached;
 
+	if( (flag = do_load_uboot()) != 1) {
 	    // uboot max size is 256K
 	    // SDHC globalBlockSizeHide = sact sd blk num - 1024
 	    if(SDHC) sd_sectors = globalBlockSizeHide - UBOOT_BLKS - 16 - 1 - 1;
 	    else     sd_sectors = globalBlockSizeHide - UBOOT_BLKS - 16 - 1 - 1;
 
-	    flag = CopyMMCtoMem(channel, sd_sectors, UBOOT_BLKS,
-		(u32*)RD_MEM_ADDR, 0);
+	    flag = read_sd(sd_sectors, UBOOT_BLKS, (u32*)RD_MEM_ADDR);
 	}
 
 ////    DEBUG
@@ -166,6 +231,7 @@ void start_qi(void)
 	print32(sd_sectors);
 	if(flag) puts("] uboot success\n");
 	else     puts("] uboot fail\n");
+	print_sd_rate();
 	led_set(1);
 
 	// jump to bootloader running
@@ -198,8 +264,12 @@ void start_qi(void)
 				unsigned long start_blk, unsigned long blknum,
 								     void *dst);
 		sd_sectors = s3c6410_mmc_init(1);
+		sd_us = timer_us_s3c64xx();
 		s3c6410_mmc_bread(0, sd_sectors - 1026 - 16 - (256 * 2),
 						     32 * 2, (u8 *)0x53000000);
+		sd_us = timer_us_s3c64xx() - sd_us;
+		sd_blocks = 32 * 2;
+		print_sd_rate();
 	}
 
 	/* all of Qi is in memory now, stuff outside steppingstone too */
@@ -233,7 +303,8 @@ static int do_read_inand(int ch, unsigned long offset_end_blk)
     FWFileHdr *fh = (FWFileHdr*)RD_MEM_ADDR;
     start = globalBlockSizeHide - offset_end_blk;
 
-    ret = CopyMMCtoMem(ch, start, 2, (u32*)fh, 0);
+    /* the header fits a block, the iROM routine was always asked for 2 */
+    ret = read_sd(start, hsmmc_attached ? 1 : 2, (u32*)fh);
     if(fh->magic != HEAD_MAGIC) {
 	puts("Error magic "); print32(fh->magic);puts("\n");
 	return -1;
@@ -243,7 +314,7 @@ static int do_read_inand(int ch, unsigned long offset_end_blk)
     cnt   = (fh->u_boot.nand.size / NANDBLKSIZE) + 1;
 
 
-    return CopyMMCtoMem(ch, start, cnt, (u32*)fh, 0);
+    return read_sd(start, cnt, (u32*)fh);
 }
 
 int do_load_uboot(void)
@@ -0,0 +1,81 @@
+/*
+ * Bus clocks and a microsecond clock for s3c64xx
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stddef.h>
+#include <qi.h>
+#include <s3c6410.h>
+#include <timer-s3c64xx.h>
+
+#define FIN		12000000	/* as start.S */
+
+/* what start.S left HCLKX2 running at, from APLL in sync mode else MPLL */
+static unsigned int get_hclkx2(void)
+{
+	unsigned int con, fout;
+
+	con = (OTHERS_REG & (1 << 6)) ? APLL_CON_REG : MPLL_CON_REG;
+
+	fout = udivmod(FIN, ((con >> 8) & 0x3f) << (con & 7), NULL) *
+	       ((con >> 16) & 0x3ff);
+	return udivmod(fout, ((CLK_DIV0_REG >> 9) & 7) + 1, NULL);
+}
+
+unsigned int get_hclk_s3c64xx(void)
+{
+	return get_hclkx2() >> ((CLK_DIV0_REG >> 8) & 1);
+}
+
+unsigned int get_pclk_s3c64xx(void)
+{
+	return udivmod(get_hclkx2(), ((CLK_DIV0_REG >> 12) & 0xf) + 1, NULL);
+}
+
+/*
+ * PWM timer 4, which has no pin, free running at PCLK / 256 / 16: a
+ * tick is 62us at 66.5MHz PCLK and a turn of the 16 bit count 4s.
+ * timer_us_s3c64xx() folds the ticks since it was last called into a
+ * 32 bit count of microseconds, so it must be called at least once a
+ * turn to keep up.
+ */
+static unsigned int pclk16;	/* PCLK in 62.5kHz units */
+static unsigned int timer_last;
+static unsigned int timer_rem;
+static unsigned int timer_us;
+
+void timer_init_s3c64xx(void)
+{
+	pclk16 = udivmod(get_pclk_s3c64xx(), 62500, NULL);
+
+	TCFG0_REG = (TCFG0_REG & ~0xff00) | (0xff << 8);
+	TCFG1_REG = (TCFG1_REG & ~0xf0000) | (4 << 16);
+	TCNTB4_REG = 0xffff;
+	TCON_REG = (TCON_REG & ~(7 << 20)) | TCON_4_UPDATE;
+	TCON_REG = (TCON_REG & ~(7 << 20)) | TCON_4_AUTO | TCON_4_ONOFF;
+
+	timer_last = 0xffff;
+	timer_rem = 0;
+	timer_us = 0;
+}
+
+unsigned int timer_us_s3c64xx(void)
+{
+	unsigned int now = TCNTO4_REG & 0xffff;
+	/* a tick is 4096 PCLKs, 65536 / pclk16 us; fits 32 bits */
+	unsigned int n = (((timer_last - now) & 0xffff) << 16) + timer_rem;
+
+	timer_last = now;
+	timer_us += udivmod(n, pclk16, &timer_rem);
+
+	return timer_us;
+}
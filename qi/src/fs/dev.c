@@ -32,10 +32,86 @@ extern unsigned long partition_offset_blocks;
 extern unsigned long partition_length_blocks;
 
 
+/*
+ * Metadata reads (superblock, group descriptors, inodes, indirect blocks
+ * and directory entries, the latter a header and a name at a time) are
+ * small and keep landing in the same few filesystem blocks.  They go
+ * through a small direct-mapped cache of 4KB lines; a miss reads the
+ * whole line, which is read-ahead of the filesystem blocks around it.
+ * Runs of whole lines, ie. file data, go straight into the caller's
+ * buffer in one block_read as before.
+ */
+#define DEVCACHE_LINE_BITS	3
+#define DEVCACHE_LINE_SECTORS	(1 << DEVCACHE_LINE_BITS)
+#define DEVCACHE_LINE_SIZE	(DEVCACHE_LINE_SECTORS * SECTOR_SIZE)
+#define DEVCACHE_LINES		32
+
+/*
+ * The most one block_read may be asked for: the SD host's block count
+ * register is 16 bits.  Longer runs are split here, in whole lines.
+ */
+#define DEVREAD_MAX_SECTORS	(0xffff & ~(DEVCACHE_LINE_SECTORS - 1))
+
+struct devcache_tag {
+	/* NULL when the line holds nothing */
+	int (*block_read)(unsigned char *buf, unsigned long start512,
+							       int blocks512);
+	unsigned long start512;
+};
+
+static struct devcache_tag devcache_tags[DEVCACHE_LINES];
+static u32 devcache_data[DEVCACHE_LINES][DEVCACHE_LINE_SIZE / 4];
+static unsigned int devcache_hits;
+static unsigned int devcache_misses;
+
+/* the line starting at partition sector "sector", read in if need be */
+static u8 *devcache_get(unsigned long sector)
+{
+	int n = (sector >> DEVCACHE_LINE_BITS) % DEVCACHE_LINES;
+	struct devcache_tag *tag = &devcache_tags[n];
+	unsigned long start512 = partition_offset_blocks + sector;
+	int count = DEVCACHE_LINE_SECTORS;
+
+	if (tag->block_read == this_kernel->block_read &&
+	    tag->start512 == start512) {
+		devcache_hits++;
+		return (u8 *)devcache_data[n];
+	}
+	devcache_misses++;
+
+	/* don't read ahead past the end of the partition */
+	if (sector + count > partition_length_blocks)
+		count = partition_length_blocks - sector;
+
+	tag->block_read = NULL;
+	if (this_kernel->block_read((u8 *)devcache_data[n], start512,
+								  count) < 0) {
+		puts(" ** ext2fs_devread() read error ");
+		printdec(start512);
+		puts("\n");
+		return NULL;
+	}
+	tag->block_read = this_kernel->block_read;
+	tag->start512 = start512;
+
+	return (u8 *)devcache_data[n];
+}
+
+void ext2fs_devread_stats(void)
+{
+	puts("    devread cache: ");
+	printdec(devcache_hits);
+	puts(" hits, ");
+	printdec(devcache_misses);
+	puts(" misses\n");
+}
+
 int ext2fs_devread(int sector, int filesystem_block_log2, int byte_offset, int byte_len, u8 *buf)
 {
-	unsigned char sec_buf[SECTOR_SIZE];
-	unsigned block_len;
+	unsigned long line;
+	unsigned int offset;
+	unsigned int n;
+	u8 *data;
 
 	sector = sector << filesystem_block_log2;
 
@@ -65,69 +141,40 @@ int ext2fs_devread(int sector, int filesystem_block_log2, int byte_offset, int b
 	sector += byte_offset >> SECTOR_BITS;
 	byte_offset &= SECTOR_SIZE - 1;
 
-	if (byte_offset) {
-		int minimum = SECTOR_SIZE - byte_offset;
-
-		if (byte_len < minimum)
-			minimum = byte_len;
-
-		/* read first part which isn't aligned with start of sector */
-		if ((this_kernel->block_read)(sec_buf,
-				partition_offset_blocks + sector, 1) < 0) {
-			puts(" ** ext2fs_devread() read error **\n");
-			return 0;
-		}
-		memcpy(buf, sec_buf + byte_offset,
-			minimum);
-		buf += minimum;
-		byte_len -= minimum;
-		sector++;
-	}
-
-	if (!byte_len)
-		return 1;
-
-	/*  read sector aligned part */
-	block_len = byte_len & ~(SECTOR_SIZE - 1);
-
-	if (block_len == 0) {
-		u8 p[SECTOR_SIZE];
-
-		block_len = SECTOR_SIZE;
-		this_kernel->block_read(p,partition_offset_blocks + sector, 1);
-		memcpy(buf, p, byte_len);
-		return 1;
-	}
-
-	if (this_kernel->block_read(buf, partition_offset_blocks + sector,
-			  block_len / SECTOR_SIZE) < 0) {
-		puts(" ** ext2fs_devread() read error - block\n");
-		printdec(partition_offset_blocks + sector);
-		puts(" ");
-		print32(block_len);
-		puts(" ");
-		print32(sector);
-		return 0;
-	}
-	block_len = byte_len & ~(SECTOR_SIZE - 1);
-	buf += block_len;
-	byte_len -= block_len;
-	sector += block_len / SECTOR_SIZE;
-
-	if (byte_len) {
-		/* read rest of data which are not in whole sector */
-		if (this_kernel->block_read(sec_buf,
-				partition_offset_blocks + sector, 1) != 1) {
-			puts(" ** ext2fs_devread() read error - last part\n");
-			printdec(partition_offset_blocks + sector);
-			puts(" ");
-			print32(block_len);
-			puts(" ");
-			print32(sector);
-			return 0;
+	line = sector & ~(DEVCACHE_LINE_SECTORS - 1);
+	offset = ((sector - line) << SECTOR_BITS) + byte_offset;
+
+	while (byte_len > 0) {
+		if (!offset && byte_len >= DEVCACHE_LINE_SIZE) {
+			/* read the whole lines there are directly */
+			n = byte_len & ~(DEVCACHE_LINE_SIZE - 1);
+			if (n > DEVREAD_MAX_SECTORS << SECTOR_BITS)
+				n = DEVREAD_MAX_SECTORS << SECTOR_BITS;
+			if (this_kernel->block_read(buf,
+					partition_offset_blocks + line,
+					n >> SECTOR_BITS) < 0) {
+				puts(" ** ext2fs_devread() read error - block\n");
+				printdec(partition_offset_blocks + line);
+				puts(" ");
+				print32(n);
+				puts(" ");
+				print32(line);
+				return 0;
+			}
+		} else {
+			/* a part of a line: through the cache */
+			data = devcache_get(line);
+			if (!data)
+				return 0;
+			n = DEVCACHE_LINE_SIZE - offset;
+			if (n > byte_len)
+				n = byte_len;
+			memcpy(buf, data + offset, n);
 		}
-		memcpy (buf, sec_buf, byte_len);
+		buf += n;
+		byte_len -= n;
+		line += (offset + n) >> SECTOR_BITS;
+		offset = 0;
 	}
 	return 1;
 }
-
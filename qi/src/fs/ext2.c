@@ -69,7 +69,9 @@ extern int ext2fs_devread(int sector, int log2blksize, int byte_offset, int byte
 #define EXT2_DYNAMIC_REV        1       /* V2 format w/ dynamic inode sizes */
 
 #define EXT2_GOOD_OLD_INODE_SIZE 128
+#define EXT2_MIN_DESC_SIZE	32	/* of a group descriptor */
 uint32_t ext2_inode_size = EXT2_GOOD_OLD_INODE_SIZE;
+uint32_t ext2_desc_size = EXT2_MIN_DESC_SIZE;
 
 /* The ext2 superblock.  */
 struct ext2_sblock {
@@ -108,8 +110,56 @@ struct ext2_sblock {
 	char volume_name[16];
 	char last_mounted_on[64];
 	uint32_t compression_info;
+	uint8_t prealloc_blocks;
+	uint8_t prealloc_dir_blocks;
+	uint16_t reserved_gdt_blocks;
+	uint32_t journal_uuid[4];
+	uint32_t journal_inum;
+	uint32_t journal_dev;
+	uint32_t last_orphan;
+	uint32_t hash_seed[4];
+	uint8_t def_hash_version;
+	uint8_t journal_backup_type;
+	uint16_t desc_size;		/* of a group descriptor, with 64BIT */
+	uint32_t default_mount_opts;
+	uint32_t first_meta_bg;
+	uint32_t mkfs_time;
+	uint32_t journal_blocks[17];
+	uint32_t total_blocks_hi;
+	uint32_t reserved_blocks_hi;
+	uint32_t free_blocks_hi;
+	uint16_t min_extra_isize;
+	uint16_t want_extra_isize;
+	uint32_t flags;
 };
 
+/* Superblock features this reader cares about.  */
+#define EXT2_FEATURE_COMPAT_DIR_INDEX	0x0020
+#define EXT2_FEATURE_INCOMPAT_FILETYPE	0x0002
+#define EXT3_FEATURE_INCOMPAT_RECOVER	0x0004
+#define EXT4_FEATURE_INCOMPAT_EXTENTS	0x0040
+#define EXT4_FEATURE_INCOMPAT_64BIT	0x0080
+#define EXT4_FEATURE_INCOMPAT_MMP	0x0100
+#define EXT4_FEATURE_INCOMPAT_FLEX_BG	0x0200
+#define EXT4_FEATURE_INCOMPAT_CSUM_SEED	0x2000
+
+/*
+ * What can be read without knowing more: a journal needing recovery only
+ * matters to writers, and flex_bg just moves the bitmaps and inode tables,
+ * which are found through the group descriptors anyway.  Anything else,
+ * like meta_bg or inline data, refuses the mount.
+ */
+#define EXT2_FEATURE_INCOMPAT_SUPP	(EXT2_FEATURE_INCOMPAT_FILETYPE | \
+					 EXT3_FEATURE_INCOMPAT_RECOVER | \
+					 EXT4_FEATURE_INCOMPAT_EXTENTS | \
+					 EXT4_FEATURE_INCOMPAT_64BIT | \
+					 EXT4_FEATURE_INCOMPAT_MMP | \
+					 EXT4_FEATURE_INCOMPAT_FLEX_BG | \
+					 EXT4_FEATURE_INCOMPAT_CSUM_SEED)
+
+/* sblock.flags: which of the htree hashes to use on char */
+#define EXT2_FLAGS_UNSIGNED_HASH	0x0002
+
 /* The ext2 blockgroup.  */
 struct ext2_block_group {
 	uint32_t block_id;
@@ -119,6 +169,10 @@ struct ext2_block_group {
 	uint16_t free_inodes;
 	uint16_t pad;
 	uint32_t reserved[3];
+	/* the rest only with 64BIT, when desc_size is 64 or more */
+	uint32_t block_id_hi;
+	uint32_t inode_id_hi;
+	uint32_t inode_table_id_hi;
 };
 
 /* The ext2 inode.  */
@@ -151,6 +205,42 @@ struct ext2_inode {
 	uint32_t osd2[3];
 };
 
+/* inode.flags */
+#define EXT2_INDEX_FL		0x00001000	/* hashed (htree) directory */
+#define EXT4_EXTENTS_FL		0x00080000	/* b.blocks holds an extent tree */
+
+/*
+ * ext4 extent tree: a header then entries, in the 60 bytes of b.blocks
+ * for the root and in whole blocks below it.  Above the leaves they are
+ * indexes of the blocks one level down, sorted by the first file block
+ * each covers; the leaves hold the extents.
+ */
+#define EXT4_EXT_MAGIC		0xf30a
+#define EXT4_EXT_MAX_DEPTH	5
+#define EXT4_EXT_INIT_MAX_LEN	32768	/* longer: unwritten, reads as 0 */
+
+struct ext4_extent_header {
+	uint16_t magic;
+	uint16_t entries;
+	uint16_t max;
+	uint16_t depth;		/* 0 for a leaf */
+	uint32_t generation;
+};
+
+struct ext4_extent {
+	uint32_t block;		/* first file block */
+	uint16_t len;
+	uint16_t start_hi;
+	uint32_t start;		/* first disk block */
+};
+
+struct ext4_extent_idx {
+	uint32_t block;		/* first file block below */
+	uint32_t leaf;		/* disk block of the next level */
+	uint16_t leaf_hi;
+	uint16_t unused;
+};
+
 /* The header of an ext2 directory entry.  */
 struct ext2_dirent {
 	uint32_t inode;
@@ -189,11 +279,24 @@ int indir2_blkno = -1;
 
 static int ext2fs_blockgroup
 	(struct ext2_data *data, int group, struct ext2_block_group *blkgrp) {
-	return ext2fs_devread
+	int len = EXT2_MIN_DESC_SIZE;
+
+	memset(blkgrp, 0, sizeof(struct ext2_block_group));
+	if (ext2_desc_size > EXT2_MIN_DESC_SIZE)
+		len = sizeof(struct ext2_block_group);
+
+	if (!ext2fs_devread
 		((__le32_to_cpu(data->sblock.first_data_block) +
 		   1), LOG2_EXT2_BLOCK_SIZE(data),
-		 group * sizeof(struct ext2_block_group),
-		 sizeof(struct ext2_block_group),(char *) blkgrp);
+		 group * ext2_desc_size, len,(char *) blkgrp))
+		return 0;
+
+	/* block numbers here are 32 bits, as in ext2fs_devread() */
+	if (blkgrp->inode_table_id_hi) {
+		puts("** ext2fs inode table beyond 2^32 blocks **\n");
+		return 0;
+	}
+	return 1;
 }
 
 
@@ -242,254 +345,512 @@ void ext2fs_free_node(ext2fs_node_t node, ext2fs_node_t currroot) {
 }
 
 
-static int ext2fs_read_block(ext2fs_node_t node, int fileblock) {
-	struct ext2_data *data = node->data;
-	struct ext2_inode *inode = &node->inode;
-	int blknr;
+/*
+ * Have *block hold filesystem block blkno, a block of block numbers,
+ * reading it in unless it does already.
+ */
+static uint32_t *ext2fs_read_indir(struct ext2_data *data, uint32_t **block,
+				   int *size, int *cached, uint32_t blkno) {
 	int blksz = EXT2_BLOCK_SIZE(data);
 	int log2_blksz = LOG2_EXT2_BLOCK_SIZE(data);
-	int status;
 
-	/* Direct blocks.  */
-	if (fileblock < INDIRECT_BLOCKS) {
-		blknr = __le32_to_cpu(inode->b.blocks.dir_blocks[fileblock]);
+	if (*block != NULL && *size != blksz) {
+		free(*block);
+		*block = NULL;
 	}
-	/* Indirect.  */
-	else if (fileblock <(INDIRECT_BLOCKS +(blksz / 4))) {
-		if (indir1_block == NULL) {
-			indir1_block =(uint32_t *) malloc(blksz);
-			if (indir1_block == NULL) {
-				puts("** ext2fs read block(indir 1) malloc failed. **\n");
-				return -1;
-			}
-			indir1_size = blksz;
-			indir1_blkno = -1;
-		}
-		if (blksz != indir1_size) {
-			free(indir1_block);
-			indir1_block = NULL;
-			indir1_size = 0;
-			indir1_blkno = -1;
-			indir1_block =(uint32_t *) malloc(blksz);
-			if (indir1_block == NULL) {
-				puts("** ext2fs read block(indir 1) malloc failed. **\n");
-				return -1;
-			}
-			indir1_size = blksz;
+	if (*block == NULL) {
+		*block = (uint32_t *) malloc(blksz);
+		if (*block == NULL) {
+			puts("** ext2fs read indirect block malloc failed. **\n");
+			return NULL;
 		}
-		if ((__le32_to_cpu(inode->b.blocks.indir_block) <<
-		     log2_blksz) != indir1_blkno) {
-			status = ext2fs_devread(__le32_to_cpu(inode->b.blocks.indir_block), log2_blksz,
-						 0, blksz,
-						(char *) indir1_block);
-			if (status == 0) {
-				puts("** ext2fs read block(indir 1) failed. **\n");
-				return 0;
-			}
-			indir1_blkno =
-				__le32_to_cpu(inode->b.blocks.
-					       indir_block) << log2_blksz;
-		}
-		blknr = __le32_to_cpu(indir1_block
-				       [fileblock - INDIRECT_BLOCKS]);
+		*size = blksz;
+		*cached = -1;
 	}
-	/* Double indirect.  */
-	else if (fileblock <
-		(INDIRECT_BLOCKS +(blksz / 4 *(blksz / 4 + 1)))) {
-		unsigned int perblock = blksz / 4;
-		unsigned int rblock = fileblock -(INDIRECT_BLOCKS
-						   + blksz / 4);
-
-		if (indir1_block == NULL) {
-			indir1_block =(uint32_t *) malloc(blksz);
-			if (indir1_block == NULL) {
-				puts("** ext2fs read block(indir 2 1) malloc failed. **\n");
-				return -1;
-			}
-			indir1_size = blksz;
-			indir1_blkno = -1;
-		}
-		if (blksz != indir1_size) {
-			free(indir1_block);
-			indir1_block = NULL;
-			indir1_size = 0;
-			indir1_blkno = -1;
-			indir1_block =(uint32_t *) malloc(blksz);
-			if (indir1_block == NULL) {
-				puts("** ext2fs read block(indir 2 1) malloc failed. **\n");
-				return -1;
-			}
-			indir1_size = blksz;
-		}
-		if ((__le32_to_cpu(inode->b.blocks.double_indir_block) <<
-		     log2_blksz) != indir1_blkno) {
-			status = ext2fs_devread(__le32_to_cpu(inode->b.blocks.double_indir_block), log2_blksz,
-						0, blksz,
-						(char *) indir1_block);
-			if (status == 0) {
-				puts("** ext2fs read block(indir 2 1) failed. **\n");
-				return -1;
-			}
-			indir1_blkno =
-				__le32_to_cpu(inode->b.blocks.double_indir_block) << log2_blksz;
+	if ((int)(blkno << log2_blksz) != *cached) {
+		if (!ext2fs_devread(blkno, log2_blksz, 0, blksz,
+				    (char *) *block)) {
+			puts("** ext2fs read indirect block failed. **\n");
+			*cached = -1;
+			return NULL;
 		}
+		*cached = blkno << log2_blksz;
+	}
+	return *block;
+}
 
-		if (indir2_block == NULL) {
-			indir2_block =(uint32_t *) malloc(blksz);
-			if (indir2_block == NULL) {
-				puts("** ext2fs read block(indir 2 2) malloc failed. **\n");
-				return -1;
-			}
-			indir2_size = blksz;
-			indir2_blkno = -1;
+
+/*
+ * ext2fs_read_run() for an extent mapped inode: the run is the rest of the
+ * extent holding fileblock, or the hole up to the next extent.  Each level
+ * of the tree is read through one of the indirect block buffers, so the
+ * blocks on the way down to the current leaf stay cached as a file is read
+ * front to back.
+ */
+static int ext4fs_read_run(ext2fs_node_t node, int fileblock, int *run) {
+	struct ext2_data *data = node->data;
+	struct ext4_extent_header *eh;
+	struct ext4_extent_idx *ix;
+	struct ext4_extent *ex;
+	uint32_t end = 0xffffffff;	/* first file block past this node */
+	uint32_t block = fileblock;
+	int size = sizeof(node->inode.b.blocks);
+	int level, n, i, len;
+
+	eh = (struct ext4_extent_header *) node->inode.b.blocks.dir_blocks;
+	for (level = 0; ; level++) {
+		n = __le16_to_cpu(eh->entries);
+		if (__le16_to_cpu(eh->magic) != EXT4_EXT_MAGIC ||
+		    sizeof(*eh) + n * sizeof(*ex) > size ||
+		    level > EXT4_EXT_MAX_DEPTH) {
+			puts("** ext4fs bad extent tree **\n");
+			return -1;
 		}
-		if (blksz != indir2_size) {
-			free(indir2_block);
-			indir2_block = NULL;
-			indir2_size = 0;
-			indir2_blkno = -1;
-			indir2_block =(uint32_t *) malloc(blksz);
-			if (indir2_block == NULL) {
-				puts("** ext2fs read block(indir 2 2) malloc failed. **\n");
-				return -1;
-			}
-			indir2_size = blksz;
+		if (!eh->depth)
+			break;
+
+		/* the last index starting at or before block */
+		ix = (struct ext4_extent_idx *)(eh + 1);
+		for (i = 0; i + 1 < n &&
+			    __le32_to_cpu(ix[i + 1].block) <= block; i++)
+			;
+		if (!n || __le32_to_cpu(ix[i].block) > block) {
+			/* nothing below maps it */
+			if (n)
+				end = __le32_to_cpu(ix[i].block);
+			goto hole;
 		}
-		if ((__le32_to_cpu(indir1_block[rblock / perblock]) <<
-		     log2_blksz) != indir2_blkno) {
-			status = ext2fs_devread(__le32_to_cpu(indir1_block[rblock / perblock]), log2_blksz,
-						 0, blksz,
-						(char *) indir2_block);
-			if (status == 0) {
-				puts("** ext2fs read block(indir 2 2) failed. **\n");
-				return -1;
-			}
-			indir2_blkno =
-				__le32_to_cpu(indir1_block[rblock / perblock]) << log2_blksz;
+		if (i + 1 < n)
+			end = __le32_to_cpu(ix[i + 1].block);
+		if (ix[i].leaf_hi) {
+			puts("** ext4fs extent beyond 2^32 blocks **\n");
+			return -1;
 		}
-		blknr = __le32_to_cpu(indir2_block[rblock % perblock]);
+		if (level & 1)
+			eh = (struct ext4_extent_header *) ext2fs_read_indir(
+				data, &indir2_block, &indir2_size,
+				&indir2_blkno, __le32_to_cpu(ix[i].leaf));
+		else
+			eh = (struct ext4_extent_header *) ext2fs_read_indir(
+				data, &indir1_block, &indir1_size,
+				&indir1_blkno, __le32_to_cpu(ix[i].leaf));
+		if (eh == NULL)
+			return -1;
+		size = EXT2_BLOCK_SIZE(data);
+	}
+
+	/* the first extent ending after block */
+	ex = (struct ext4_extent *)(eh + 1);
+	for (i = 0; i < n; i++) {
+		len = __le16_to_cpu(ex[i].len);
+		if (len > EXT4_EXT_INIT_MAX_LEN)
+			len -= EXT4_EXT_INIT_MAX_LEN;
+		if (__le32_to_cpu(ex[i].block) + len > block)
+			break;
+	}
+	if (i == n)
+		goto hole;
+	if (__le32_to_cpu(ex[i].block) > block) {
+		end = __le32_to_cpu(ex[i].block);
+		goto hole;
+	}
+	if (ex[i].start_hi) {
+		puts("** ext4fs extent beyond 2^32 blocks **\n");
+		return -1;
+	}
+
+	*run = __le32_to_cpu(ex[i].block) + len - block;
+	if (__le16_to_cpu(ex[i].len) > EXT4_EXT_INIT_MAX_LEN)
+		return 0;
+	return __le32_to_cpu(ex[i].start) + block - __le32_to_cpu(ex[i].block);
+
+hole:
+	*run = end - block > 0x7fffffff ? 0x7fffffff : end - block;
+	return 0;
+}
+
+
+/*
+ * Map file block "fileblock" to a disk block, and count the file blocks
+ * from it on that follow it on disk (or that are holes as well), up to the
+ * end of the map holding it: the direct blocks, the indirect block or one
+ * block of the double indirect tree.  A missing map is one long hole.
+ * The next run starts where this one ends, so each block number in a map
+ * is looked at once.  Returns the disk block, 0 for a hole or -1, and the
+ * length of the run in *run.
+ */
+static int ext2fs_read_run(ext2fs_node_t node, int fileblock, int *run) {
+	struct ext2_data *data = node->data;
+	struct ext2_inode *inode = &node->inode;
+	int perblock = EXT2_BLOCK_SIZE(data) / 4;
+	uint32_t *map;
+	uint32_t blknr;
+	int i, n, count;
+
+	if (__le32_to_cpu(inode->flags) & EXT4_EXTENTS_FL)
+		return ext4fs_read_run(node, fileblock, run);
+
+	/* Direct blocks.  */
+	if (fileblock < INDIRECT_BLOCKS) {
+		map = inode->b.blocks.dir_blocks;
+		i = fileblock;
+		count = INDIRECT_BLOCKS;
+	}
+	/* Indirect.  */
+	else if (fileblock < INDIRECT_BLOCKS + perblock) {
+		i = fileblock - INDIRECT_BLOCKS;
+		count = perblock;
+		blknr = __le32_to_cpu(inode->b.blocks.indir_block);
+		if (!blknr)
+			goto hole;
+		map = ext2fs_read_indir(data, &indir1_block, &indir1_size,
+					&indir1_blkno, blknr);
+		if (map == NULL)
+			return -1;
+	}
+	/* Double indirect.  */
+	else if (fileblock < INDIRECT_BLOCKS + perblock * (perblock + 1)) {
+		unsigned int rblock = fileblock - (INDIRECT_BLOCKS + perblock);
+
+		i = rblock;
+		count = perblock * perblock;
+		blknr = __le32_to_cpu(inode->b.blocks.double_indir_block);
+		if (!blknr)
+			goto hole;
+		map = ext2fs_read_indir(data, &indir1_block, &indir1_size,
+					&indir1_blkno, blknr);
+		if (map == NULL)
+			return -1;
+
+		i = rblock % perblock;
+		count = perblock;
+		blknr = __le32_to_cpu(map[rblock / perblock]);
+		if (!blknr)
+			goto hole;
+		map = ext2fs_read_indir(data, &indir2_block, &indir2_size,
+					&indir2_blkno, blknr);
+		if (map == NULL)
+			return -1;
 	}
 	/* Triple indirect.  */
 	else {
 		puts("** ext2fs doesn't support triple indirect blocks. **\n");
 		return -1;
 	}
-#ifdef DEBUG
-	printf("ext2fs_read_block %08x\n", blknr);
-#endif
+
+	blknr = __le32_to_cpu(map[i]);
+	for (n = 1; i + n < count; n++)
+		if (__le32_to_cpu(map[i + n]) != (blknr ? blknr + n : 0))
+			break;
+	*run = n;
+
 	return blknr;
+
+hole:
+	/* no map at all: a hole to the end of what it would have mapped */
+	*run = count - i;
+	return 0;
 }
 
 
 int ext2fs_read_file(ext2fs_node_t node, int pos, unsigned int len, char *buf) {
 	int i;
+	int run;
 	int blockcnt;
 	int log2blocksize = LOG2_EXT2_BLOCK_SIZE(node->data);
 	int blocksize = 1 <<(log2blocksize + DISK_SECTOR_BITS);
 	unsigned int filesize = __le32_to_cpu(node->inode.size);
-	int previous_block_number = -1;
+	int skipfirst = pos % blocksize;
 	int delayed_start = 0;
 	int delayed_extent = 0;
 	int delayed_skipfirst = 0;
-	int delayed_next = 0;
+	int delayed_next = -1;
 	char * delayed_buf = NULL;
 	int status;
 
 	/* Adjust len so it we can't read past the end of the file.  */
-	if (len > filesize) {
-		len = filesize;
+	if (pos >= filesize)
+		return 0;
+	if (len > filesize - pos) {
+		len = filesize - pos;
 	}
 	blockcnt = ((len + pos) + blocksize - 1) / blocksize;
 
-	for(i = pos / blocksize; i < blockcnt; i++) {
+	/*
+	 * A run at a time; runs that carry on where the previous one ended
+	 * on disk are gathered into one ext2fs_devread(), which leaves only
+	 * discontiguities in the file (and the block maps between its data)
+	 * to split the transfer.
+	 */
+	for (i = pos / blocksize; i < blockcnt; i += run) {
 		int blknr;
-		int blockoff = pos % blocksize;
-		int blockend = blocksize;
-
-		int skipfirst = 0;
+		int extent;
 
-		blknr = ext2fs_read_block(node, i);
+		blknr = ext2fs_read_run(node, i, &run);
 		if (blknr < 0)
 			return -1;
+		if (run > blockcnt - i)
+			run = blockcnt - i;
 
-		blknr = blknr << log2blocksize;
-
+		extent = (run << (log2blocksize + DISK_SECTOR_BITS)) - skipfirst;
 		/* Last block.  */
-		if (i == blockcnt - 1) {
-			blockend =(len + pos) % blocksize;
-
-			/* The last portion is exactly blocksize.  */
-			if (!blockend) {
-				blockend = blocksize;
-			}
-		}
+		if (i + run == blockcnt)
+			extent -= blockcnt * blocksize - (len + pos);
 
-		/* First block.  */
-		if (i == pos / blocksize) {
-			skipfirst = blockoff;
-			blockend -= skipfirst;
-		}
+		blknr = blknr << log2blocksize;
 
 		/* If the block number is 0 this block is not stored on disk but
 		   is zero filled instead.  */
-		if (blknr) {
-			int status;
-
-			if (previous_block_number != -1) {
-				if (delayed_next == blknr) {
-					delayed_extent += blockend;
-					delayed_next += blockend >> SECTOR_BITS;
-				} else { /* spill */
-					status = ext2fs_devread(delayed_start,
-						0, delayed_skipfirst,
-						delayed_extent, delayed_buf);
-					if (status == 0)
-						return -1;
-					previous_block_number = blknr;
-					delayed_start = blknr;
-					delayed_extent = blockend;
-					delayed_skipfirst = skipfirst;
-					delayed_buf = buf;
-					delayed_next = blknr + (blockend >> SECTOR_BITS);
-				}
-			} else {
-				previous_block_number = blknr;
-				delayed_start = blknr;
-				delayed_extent = blockend;
-				delayed_skipfirst = skipfirst;
-				delayed_buf = buf;
-				delayed_next = blknr + (blockend >> SECTOR_BITS);
-			}
-
+		if (blknr && blknr == delayed_next) {
+			delayed_extent += extent;
+			delayed_next += run << log2blocksize;
 		} else {
-			if (previous_block_number != -1) {
-				/* spill */
+			if (delayed_next != -1) { /* spill */
 				status = ext2fs_devread(delayed_start,
 						0, delayed_skipfirst,
 						delayed_extent, delayed_buf);
 				if (status == 0)
 					return -1;
-				previous_block_number = -1;
+				delayed_next = -1;
 			}
-			memset(buf, 0, blocksize - skipfirst);
+			if (blknr) {
+				delayed_start = blknr;
+				delayed_extent = extent;
+				delayed_skipfirst = skipfirst;
+				delayed_buf = buf;
+				delayed_next = blknr + (run << log2blocksize);
+			} else
+				memset(buf, 0, extent);
 		}
-		buf += blocksize - skipfirst;
+		buf += extent;
+		skipfirst = 0;
 	}
 
-	if (previous_block_number != -1) {
+	if (delayed_next != -1) {
 		/* spill */
 		status = ext2fs_devread(delayed_start,
 				0, delayed_skipfirst,
 				delayed_extent, delayed_buf);
 		if (status == 0)
 			return -1;
-		previous_block_number = -1;
 	}
 
 	return(len);
 }
 
 
+/*
+ * A node for the file "dirent" in diro names, and its type in *type: from
+ * the entry when the filesystem keeps it there, else from the inode.
+ */
+static ext2fs_node_t ext2fs_dirent_node(ext2fs_node_t diro,
+				struct ext2_dirent *dirent, int *type) {
+	ext2fs_node_t fdiro;
+	int status;
+
+	*type = FILETYPE_UNKNOWN;
+
+	fdiro = malloc(sizeof(struct ext2fs_node));
+	if (!fdiro) {
+		puts("malloc fail\n");
+		return NULL;
+	}
+
+	fdiro->data = diro->data;
+	fdiro->ino = __le32_to_cpu(dirent->inode);
+
+	if (dirent->filetype != FILETYPE_UNKNOWN) {
+		fdiro->inode_read = 0;
+
+		if (dirent->filetype == FILETYPE_DIRECTORY) {
+			*type = FILETYPE_DIRECTORY;
+		} else if (dirent->filetype == FILETYPE_SYMLINK) {
+			*type = FILETYPE_SYMLINK;
+		} else if (dirent->filetype == FILETYPE_REG) {
+			*type = FILETYPE_REG;
+		}
+	} else {
+		/* The filetype can not be read from the dirent, get it from inode */
+
+		status = ext2fs_read_inode(diro->data,
+					    __le32_to_cpu(dirent->inode),
+					    &fdiro->inode);
+		if (status == 0) {
+			puts("inner ext2fs_read_inode fail\n");
+			free(fdiro);
+			return NULL;
+		}
+		fdiro->inode_read = 1;
+
+		if ((__le16_to_cpu(fdiro->inode.mode) &
+		     FILETYPE_INO_MASK) == FILETYPE_INO_DIRECTORY) {
+			*type = FILETYPE_DIRECTORY;
+		} else if ((__le16_to_cpu(fdiro->inode.mode) &
+			    FILETYPE_INO_MASK) == FILETYPE_INO_SYMLINK) {
+			*type = FILETYPE_SYMLINK;
+		} else if ((__le16_to_cpu(fdiro->inode.mode) &
+			    FILETYPE_INO_MASK) == FILETYPE_INO_REG) {
+			*type = FILETYPE_REG;
+		}
+	}
+	return fdiro;
+}
+
+
+/*
+ * htree directories: block 0 holds "." and "..", the latter covering the
+ * rest of the block, which is a dx_root_info and an array of dx_entries.
+ * Entry 0 has the entry count in place of a hash and covers hashes below
+ * entry 1's.  Each entry leads to a block of the directory one level down,
+ * whose index nodes again hide behind an empty dirent; the bottom level
+ * are ordinary directory blocks holding the names in their hash range.
+ */
+#define DX_ROOT_INFO_OFFSET	24	/* past the "." and ".." dirents */
+#define DX_NODE_OFFSET		8	/* past the empty dirent */
+#define DX_MAX_LEVELS		3
+
+struct dx_root_info {
+	uint32_t reserved_zero;
+	uint8_t hash_version;
+	uint8_t info_length;
+	uint8_t indirect_levels;
+	uint8_t unused_flags;
+};
+
+struct dx_entry {
+	uint32_t hash;		/* entry 0: uint16_t limit, count */
+	uint32_t block;
+};
+
+static char *dx_block = NULL;
+static int dx_size = 0;
+
+/* directory block blk of diro, in dx_block */
+static char *ext2fs_dx_read(ext2fs_node_t diro, uint32_t blk) {
+	int blksz = EXT2_BLOCK_SIZE(diro->data);
+
+	if (dx_block != NULL && dx_size != blksz) {
+		free(dx_block);
+		dx_block = NULL;
+	}
+	if (dx_block == NULL) {
+		dx_block = malloc(blksz);
+		if (dx_block == NULL) {
+			puts("** ext2fs htree malloc failed. **\n");
+			return NULL;
+		}
+		dx_size = blksz;
+	}
+	if (ext2fs_read_file(diro, blk * blksz, blksz, dx_block) != blksz)
+		return NULL;
+	return dx_block;
+}
+
+/*
+ * Look name up in htree directory diro.  Returns 1 with *fnode and *ftype
+ * set when it's there, 0 when it isn't, or -1 when the index is not one
+ * we can use, so the caller scans the directory instead.
+ */
+static int ext2fs_dx_lookup(ext2fs_node_t diro, const char *name,
+			    ext2fs_node_t *fnode, int *ftype) {
+	struct ext2_sblock *sblock = &diro->data->sblock;
+	int blksz = EXT2_BLOCK_SIZE(diro->data);
+	int namelen = strlen(name);
+	struct dx_root_info *info;
+	struct dx_entry *entries;
+	struct ext2_dirent *dirent;
+	uint32_t seed[4], hash, index_blk = 0;
+	int version, levels, offset, count, lo, hi, i, pos, n;
+	char *block;
+
+	block = ext2fs_dx_read(diro, 0);
+	if (block == NULL)
+		return 0;
+
+	info = (struct dx_root_info *)(block + DX_ROOT_INFO_OFFSET);
+	version = info->hash_version;
+	levels = info->indirect_levels;
+	if (info->reserved_zero || info->info_length < sizeof(*info) ||
+	    version > DX_HASH_TEA || levels >= DX_MAX_LEVELS)
+		return -1;
+	if (__le32_to_cpu(sblock->flags) & EXT2_FLAGS_UNSIGNED_HASH)
+		version += DX_HASH_LEGACY_UNSIGNED;
+
+	for (i = 0; i < 4; i++)
+		seed[i] = __le32_to_cpu(sblock->hash_seed[i]);
+	hash = ext2fs_dirhash(version, seed, name, namelen);
+
+	/* down the index to the entry covering hash */
+	offset = DX_ROOT_INFO_OFFSET + info->info_length;
+	for (;;) {
+		entries = (struct dx_entry *)(block + offset);
+		count = __le16_to_cpu(((uint16_t *)entries)[1]);
+		if (!count || offset + count * sizeof(*entries) > blksz)
+			return -1;
+
+		/* the last entry whose hash is at most ours */
+		lo = 1;
+		hi = count - 1;
+		while (lo <= hi) {
+			i = (lo + hi) / 2;
+			if (__le32_to_cpu(entries[i].hash) > hash)
+				hi = i - 1;
+			else
+				lo = i + 1;
+		}
+		i = lo - 1;
+
+		if (!levels--)
+			break;
+		index_blk = __le32_to_cpu(entries[i].block) & 0x0fffffff;
+		block = ext2fs_dx_read(diro, index_blk);
+		if (block == NULL)
+			return 0;
+		offset = DX_NODE_OFFSET;
+	}
+
+	/*
+	 * Search the leaf, and the ones after it for as long as they carry
+	 * on our hash: names with the same hash may spill into the next
+	 * block, whose entry then has the low bit set.
+	 */
+	for (;;) {
+		block = ext2fs_dx_read(diro,
+				__le32_to_cpu(entries[i].block) & 0x0fffffff);
+		if (block == NULL)
+			return 0;
+
+		for (pos = 0; pos + sizeof(*dirent) <= blksz; pos += n) {
+			dirent = (struct ext2_dirent *)(block + pos);
+			n = __le16_to_cpu(dirent->direntlen);
+			if (n < sizeof(*dirent) || pos + n > blksz)
+				return -1;
+			if (!dirent->inode || dirent->namelen != namelen ||
+			    sizeof(*dirent) + namelen > n)
+				continue;
+			for (lo = 0; lo < namelen; lo++)
+				if (block[pos + sizeof(*dirent) + lo] != name[lo])
+					break;
+			if (lo < namelen)
+				continue;
+
+			*fnode = ext2fs_dirent_node(diro, dirent, ftype);
+			return *fnode != NULL;
+		}
+
+		if (++i >= count)
+			return 0;
+		/* back to the index node for the next entry */
+		block = ext2fs_dx_read(diro, index_blk);
+		if (block == NULL)
+			return 0;
+		entries = (struct dx_entry *)(block + offset);
+		if ((__le32_to_cpu(entries[i].hash) & ~1) != hash)
+			return 0;
+	}
+}
+
+
 static int ext2fs_iterate_dir(ext2fs_node_t dir, char *name, ext2fs_node_t * fnode, int *ftype)
 {
 	unsigned int fpos = 0;
@@ -510,6 +871,16 @@ static int ext2fs_iterate_dir(ext2fs_node_t dir, char *name, ext2fs_node_t * fno
 		}
 	}
 
+	/* An indexed directory: straight to the block holding name.  */
+	if ((name != NULL) && (fnode != NULL) && (ftype != NULL) &&
+	    (__le32_to_cpu(diro->inode.flags) & EXT2_INDEX_FL) &&
+	    (__le32_to_cpu(diro->data->sblock.feature_compatibility) &
+	     EXT2_FEATURE_COMPAT_DIR_INDEX)) {
+		status = ext2fs_dx_lookup(diro, name, fnode, ftype);
+		if (status >= 0)
+			return status;
+	}
+
 	/* Search the file.  */
 	while (fpos < __le32_to_cpu(diro->inode.size)) {
 		struct ext2_dirent dirent;
@@ -525,7 +896,7 @@ static int ext2fs_iterate_dir(ext2fs_node_t dir, char *name, ext2fs_node_t * fno
 		if (dirent.namelen != 0) {
 			char filename[256];
 			ext2fs_node_t fdiro;
-			int type = FILETYPE_UNKNOWN;
+			int type;
 
 			status = ext2fs_read_file(diro,
 						   fpos + sizeof(struct ext2_dirent),
@@ -535,56 +906,11 @@ static int ext2fs_iterate_dir(ext2fs_node_t dir, char *name, ext2fs_node_t * fno
 				return(0);
 			}
 
-			fdiro = malloc(sizeof(struct ext2fs_node));
-			if (!fdiro) {
-				puts("malloc fail\n");
-				return(0);
-			}
-
-
-			fdiro->data = diro->data;
-			fdiro->ino = __le32_to_cpu(dirent.inode);
-
 			filename[dirent.namelen] = '\0';
 
-			if (dirent.filetype != FILETYPE_UNKNOWN) {
-				fdiro->inode_read = 0;
-
-				if (dirent.filetype == FILETYPE_DIRECTORY) {
-					type = FILETYPE_DIRECTORY;
-				} else if (dirent.filetype ==
-					   FILETYPE_SYMLINK) {
-					type = FILETYPE_SYMLINK;
-				} else if (dirent.filetype == FILETYPE_REG) {
-					type = FILETYPE_REG;
-				}
-			} else {
-				/* The filetype can not be read from the dirent, get it from inode */
-
-				status = ext2fs_read_inode(diro->data,
-							    __le32_to_cpu(dirent.inode),
-							    &fdiro->inode);
-				if (status == 0) {
-					puts("inner ext2fs_read_inode fail\n");
-					free(fdiro);
-					return(0);
-				}
-				fdiro->inode_read = 1;
-
-				if ((__le16_to_cpu(fdiro->inode.mode) &
-				     FILETYPE_INO_MASK) ==
-				    FILETYPE_INO_DIRECTORY) {
-					type = FILETYPE_DIRECTORY;
-				} else if ((__le16_to_cpu(fdiro->inode.mode)
-					    & FILETYPE_INO_MASK) ==
-					   FILETYPE_INO_SYMLINK) {
-					type = FILETYPE_SYMLINK;
-				} else if ((__le16_to_cpu(fdiro->inode.mode)
-					    & FILETYPE_INO_MASK) ==
-					   FILETYPE_INO_REG) {
-					type = FILETYPE_REG;
-				}
-			}
+			fdiro = ext2fs_dirent_node(diro, &dirent, &type);
+			if (!fdiro)
+				return(0);
 #ifdef DEBUG
 			printf("iterate >%s<\n", filename);
 #endif /* of DEBUG */
@@ -818,6 +1144,50 @@ int ext2fs_ls(char *dirname) {
 }
 
 
+/*
+ * The directory the last file was opened from, until the next mount.  The
+ * noboot, append, kernel and initramfs files of a boot attempt are usually
+ * side by side, so only the first of them walks the path to it.
+ */
+#define DIRCACHE_PATH	64
+static char dircache_path[DIRCACHE_PATH];
+static struct ext2fs_node dircache_node;
+static int dircache_valid;
+
+static int ext2fs_find_file_cached(const char *path, ext2fs_node_t *foundnode,
+				   int expecttype) {
+	char dirpath[DIRCACHE_PATH];
+	ext2fs_node_t dirnode;
+	int n, slash = -1;
+
+	for (n = 0; path[n]; n++)
+		if (path[n] == '/')
+			slash = n;
+
+	/* nothing to cache, or too long a directory to */
+	if (slash <= 0 || !path[slash + 1] || slash >= DIRCACHE_PATH)
+		return ext2fs_find_file(path, &ext2fs_root->diropen, foundnode,
+					expecttype);
+
+	strncpy(dirpath, path, slash);
+	dirpath[slash] = '\0';
+
+	if (!dircache_valid || strcmp(dirpath, dircache_path)) {
+		dircache_valid = 0;
+		if (!ext2fs_find_file(dirpath, &ext2fs_root->diropen, &dirnode,
+				      FILETYPE_DIRECTORY))
+			return 0;
+		dircache_node = *dirnode;
+		ext2fs_free_node(dirnode, &ext2fs_root->diropen);
+		strcpy(dircache_path, dirpath);
+		dircache_valid = 1;
+	}
+
+	return ext2fs_find_file(path + slash + 1, &dircache_node, foundnode,
+				expecttype);
+}
+
+
 int ext2fs_open(const char *filename) {
 	ext2fs_node_t fdiro = NULL;
 	int status;
@@ -827,9 +1197,11 @@ int ext2fs_open(const char *filename) {
 	if (ext2fs_root == NULL)
 		goto fail;
 
-	ext2fs_file = NULL;
-	status = ext2fs_find_file(filename, &ext2fs_root->diropen, &fdiro,
-				   FILETYPE_REG);
+	if (ext2fs_file != NULL) {
+		ext2fs_free_node(ext2fs_file, &ext2fs_root->diropen);
+		ext2fs_file = NULL;
+	}
+	status = ext2fs_find_file_cached(filename, &fdiro, FILETYPE_REG);
 	if (status == 0) {
 		ret = -2;
 		goto fail;
@@ -864,6 +1236,7 @@ int ext2fs_close(void
 		free(ext2fs_root);
 		ext2fs_root = NULL;
 	}
+	dircache_valid = 0;
 	if (indir1_block != NULL) {
 		free(indir1_block);
 		indir1_block = NULL;
@@ -876,11 +1249,22 @@ int ext2fs_close(void
 		indir2_size = 0;
 		indir2_blkno = -1;
 	}
+	if (dx_block != NULL) {
+		free(dx_block);
+		dx_block = NULL;
+		dx_size = 0;
+	}
 	return(0);
 }
 
 
 int ext2fs_read(char *buf, unsigned len) {
+	return ext2fs_read_at(buf, 0, len);
+}
+
+
+/* read len bytes of the open file from pos on, so it can be read piecewise */
+int ext2fs_read_at(char *buf, unsigned pos, unsigned len) {
 	int status;
 
 	if (ext2fs_root == NULL)
@@ -889,7 +1273,7 @@ int ext2fs_read(char *buf, unsigned len) {
 	if (ext2fs_file == NULL)
 		return 0;
 
-	status = ext2fs_read_file(ext2fs_file, 0, len, buf);
+	status = ext2fs_read_file(ext2fs_file, pos, len, buf);
 	return status;
 }
 
@@ -898,6 +1282,9 @@ int ext2fs_mount(void) {
 	struct ext2_data *data;
 	int status;
 
+	/* whatever was mounted before goes, with its nodes and caches */
+	ext2fs_close();
+
 	data = malloc(sizeof(struct ext2_data));
 	if (!data)
 		return 0;
@@ -917,6 +1304,25 @@ int ext2fs_mount(void) {
 	else
 		ext2_inode_size = __le16_to_cpu (data->sblock.inode_size);
 
+	if (__le32_to_cpu(data->sblock.feature_incompat) &
+	    ~EXT2_FEATURE_INCOMPAT_SUPP) {
+		puts("** ext2fs unsupported features ");
+		print32(__le32_to_cpu(data->sblock.feature_incompat));
+		puts(" **\n");
+		goto fail;
+	}
+	ext2_desc_size = EXT2_MIN_DESC_SIZE;
+	if (__le32_to_cpu(data->sblock.feature_incompat) &
+	    EXT4_FEATURE_INCOMPAT_64BIT)
+		ext2_desc_size = __le16_to_cpu(data->sblock.desc_size);
+	if (ext2_desc_size < EXT2_MIN_DESC_SIZE)
+		goto fail;
+
+	/* block numbers cached from another filesystem mean nothing here */
+	indir1_blkno = -1;
+	indir2_blkno = -1;
+	dircache_valid = 0;
+
 	data->diropen.data = data;
 	data->diropen.ino = 2;
 	data->diropen.inode_read = 1;
@@ -0,0 +1,203 @@
+/*
+ * Directory name hashes of ext3/ext4 htree directories, for the indexed
+ * lookup in ext2.c.  From linux fs/ext4/hash.c:
+ *
+ *  Copyright (C) 2002 by Theodore Ts'o
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include <qi.h>
+#include <ext2.h>
+
+#define DELTA 0x9E3779B9
+
+static void tea_transform(u32 buf[2], u32 const in[4])
+{
+	u32 sum = 0;
+	u32 b0 = buf[0], b1 = buf[1];
+	u32 a = in[0], b = in[1], c = in[2], d = in[3];
+	int n = 16;
+
+	do {
+		sum += DELTA;
+		b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+		b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+	} while (--n);
+
+	buf[0] += b0;
+	buf[1] += b1;
+}
+
+/* F, G and H are basic MD4 functions: selection, majority, parity */
+#define F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define H(x, y, z) ((x) ^ (y) ^ (z))
+
+#define ROL(x, s) ((x) << (s) | (x) >> (32 - (s)))
+#define ROUND(f, a, b, c, d, x, s) \
+	(a += f(b, c, d) + (x), a = ROL(a, s))
+#define K1 0
+#define K2 013240474631UL
+#define K3 015666365641UL
+
+/* basic cut-down MD4 transform */
+static void half_md4_transform(u32 buf[4], u32 const in[8])
+{
+	u32 a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+	/* Round 1 */
+	ROUND(F, a, b, c, d, in[0] + K1,  3);
+	ROUND(F, d, a, b, c, in[1] + K1,  7);
+	ROUND(F, c, d, a, b, in[2] + K1, 11);
+	ROUND(F, b, c, d, a, in[3] + K1, 19);
+	ROUND(F, a, b, c, d, in[4] + K1,  3);
+	ROUND(F, d, a, b, c, in[5] + K1,  7);
+	ROUND(F, c, d, a, b, in[6] + K1, 11);
+	ROUND(F, b, c, d, a, in[7] + K1, 19);
+
+	/* Round 2 */
+	ROUND(G, a, b, c, d, in[1] + K2,  3);
+	ROUND(G, d, a, b, c, in[3] + K2,  5);
+	ROUND(G, c, d, a, b, in[5] + K2,  9);
+	ROUND(G, b, c, d, a, in[7] + K2, 13);
+	ROUND(G, a, b, c, d, in[0] + K2,  3);
+	ROUND(G, d, a, b, c, in[2] + K2,  5);
+	ROUND(G, c, d, a, b, in[4] + K2,  9);
+	ROUND(G, b, c, d, a, in[6] + K2, 13);
+
+	/* Round 3 */
+	ROUND(H, a, b, c, d, in[3] + K3,  3);
+	ROUND(H, d, a, b, c, in[7] + K3,  9);
+	ROUND(H, c, d, a, b, in[2] + K3, 11);
+	ROUND(H, b, c, d, a, in[6] + K3, 15);
+	ROUND(H, a, b, c, d, in[1] + K3,  3);
+	ROUND(H, d, a, b, c, in[5] + K3,  9);
+	ROUND(H, c, d, a, b, in[0] + K3, 11);
+	ROUND(H, b, c, d, a, in[4] + K3, 15);
+
+	buf[0] += a;
+	buf[1] += b;
+	buf[2] += c;
+	buf[3] += d;
+}
+
+/* The old legacy hash */
+static u32 dx_hack_hash(const char *name, int len, int is_unsigned)
+{
+	u32 hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+	int c;
+
+	while (len--) {
+		if (is_unsigned)
+			c = *(const unsigned char *)name++;
+		else
+			c = *(const signed char *)name++;
+		hash = hash1 + (hash0 ^ (c * 7152373));
+
+		if (hash & 0x80000000)
+			hash -= 0x7fffffff;
+		hash1 = hash0;
+		hash0 = hash;
+	}
+	return hash0 << 1;
+}
+
+/* up to num words of msg, padded with its length, as the hashes take it */
+static void str2hashbuf(const char *msg, int len, u32 *buf, int num,
+			int is_unsigned)
+{
+	u32 pad, val;
+	int i, c;
+
+	pad = (u32)len | ((u32)len << 8);
+	pad |= pad << 16;
+
+	val = pad;
+	if (len > num * 4)
+		len = num * 4;
+	for (i = 0; i < len; i++) {
+		if (is_unsigned)
+			c = ((const unsigned char *)msg)[i];
+		else
+			c = ((const signed char *)msg)[i];
+		val = c + (val << 8);
+		if ((i % 4) == 3) {
+			*buf++ = val;
+			val = pad;
+			num--;
+		}
+	}
+	if (--num >= 0)
+		*buf++ = val;
+	while (--num >= 0)
+		*buf++ = pad;
+}
+
+/*
+ * The major hash of name under hash version "version" (DX_HASH_*, with
+ * the unsigned variants already picked) and the filesystem's seed, which
+ * is what the htree index is sorted by.  Returns 0 for a version we don't
+ * know, which the caller has ruled out.
+ */
+u32 ext2fs_dirhash(int version, const u32 seed[4], const char *name, int len)
+{
+	u32 buf[4], in[8], hash;
+	int is_unsigned = version >= DX_HASH_LEGACY_UNSIGNED;
+
+	/* the default seed, unless the filesystem has one */
+	buf[0] = 0x67452301;
+	buf[1] = 0xefcdab89;
+	buf[2] = 0x98badcfe;
+	buf[3] = 0x10325476;
+	if (seed[0] || seed[1] || seed[2] || seed[3]) {
+		buf[0] = seed[0];
+		buf[1] = seed[1];
+		buf[2] = seed[2];
+		buf[3] = seed[3];
+	}
+
+	switch (version) {
+	case DX_HASH_LEGACY:
+	case DX_HASH_LEGACY_UNSIGNED:
+		hash = dx_hack_hash(name, len, is_unsigned);
+		break;
+	case DX_HASH_HALF_MD4:
+	case DX_HASH_HALF_MD4_UNSIGNED:
+		while (len > 0) {
+			str2hashbuf(name, len, in, 8, is_unsigned);
+			half_md4_transform(buf, in);
+			len -= 32;
+			name += 32;
+		}
+		hash = buf[1];
+		break;
+	case DX_HASH_TEA:
+	case DX_HASH_TEA_UNSIGNED:
+		while (len > 0) {
+			str2hashbuf(name, len, in, 4, is_unsigned);
+			tea_transform(buf, in);
+			len -= 16;
+			name += 16;
+		}
+		hash = buf[0];
+		break;
+	default:
+		return 0;
+	}
+
+	/* the low bit marks collisions in the index, the top value its end */
+	hash &= ~1;
+	if (hash == 0xfffffffe)
+		hash = 0xfffffffc;
+
+	return hash;
+}
@@ -27,6 +27,8 @@
 #include <string.h>
 #define __ARM__
 #include <image.h>
+#include <unlzo.h>
+#include <unlz4.h>
 #include <setup.h>
 #include <ext2.h>
 
@@ -40,6 +42,97 @@ struct kernel_source const * this_kernel = 0;
 
 static const int INITRD_OFFSET = (8 * 1024 * 1024);
 
+/*
+ * The kernel is read through a single open of its file: the first
+ * KERNEL_HEAD bytes to find out what it is, then the rest in KERNEL_CHUNK
+ * pieces, each CRC'd as soon as it has landed.  ext2 turns each piece into
+ * a few large reads of contiguous blocks.
+ */
+#define KERNEL_HEAD	4096
+#define KERNEL_CHUNK	(256 * 1024)
+#define RAW_FILE_LEN	0x7fffffff	/* raw partitions don't know */
+
+/*
+ * An LZO or LZ4 compressed uImage is read to UNPACK_OFFSET, past the
+ * largest initramfs and below qi itself at 48MB, and decompressed from
+ * there to where the kernel runs, up to the initramfs.
+ */
+#define UNPACK_OFFSET	(INITRD_OFFSET + 16 * 1024 * 1024)
+#define UNPACK_MAX	(24 * 1024 * 1024)
+
+/*
+ * Where the time of the boot goes, summed over the attempts and printed
+ * before the kernel is started, on boards that give us a clock.
+ */
+enum boot_phase {
+	PHASE_INIT,	/* block device init and partition table */
+	PHASE_MOUNT,
+	PHASE_LOOKUP,	/* path walks to the files */
+	PHASE_LOAD,
+	PHASE_CRC,
+	PHASE_UNPACK,	/* LZO or LZ4 decompression */
+	PHASE_COUNT
+};
+
+static const char * const phase_names[PHASE_COUNT] = {
+	"init   ", "mount  ", "lookup ", "load   ", "CRC    ", "unpack "
+};
+static unsigned int phase_us[PHASE_COUNT];
+static unsigned int load_bytes;
+static unsigned int boot_start_us;
+
+static unsigned int now_us(void)
+{
+	if (!this_board->get_us)
+		return 0;
+
+	return (this_board->get_us)();
+}
+
+/* adds the time since start to phase, returns now for the next one */
+static unsigned int phase_done(enum boot_phase phase, unsigned int start)
+{
+	unsigned int now = now_us();
+
+	phase_us[phase] += now - start;
+
+	return now;
+}
+
+static void print_profile(void)
+{
+	unsigned int total = now_us() - boot_start_us;
+	int n;
+
+	if (!this_board->get_us)
+		return;
+
+	puts("    Boot profile:\n");
+	for (n = 0; n < PHASE_COUNT; n++) {
+		puts("      ");
+		puts(phase_names[n]);
+		printdec(phase_us[n] / 1000);
+		puts(" ms");
+		if (n == PHASE_LOAD && phase_us[n] >= 1000) {
+			puts(", ");
+			printdec(load_bytes / (phase_us[n] / 1000));
+			puts(" KB/s");
+		}
+		puts("\n");
+	}
+	puts("      total  ");
+	printdec(total / 1000);
+	puts(" ms\n");
+}
+
+/*
+ * The filesystem that is mounted and where, so that the probes of one
+ * boot attempt, and the next attempt on the same partition, mount once.
+ */
+static int (*mounted_read)(unsigned char *buf, unsigned long start512,
+							       int blocks512);
+static unsigned long mounted_offset;
+
 
 int raise(int n)
 {
@@ -52,31 +145,41 @@ static void indicate(enum ui_indication ui_indication)
 		(this_board->set_ui_indication)(ui_indication);
 }
 
-static int read_file(const char * filepath, u8 * destination, int size)
+/*
+ * Make filepath the file read_chunk() reads from.  Returns its length,
+ * -1 if it isn't there or -2 if the filesystem can't be mounted.
+ */
+static int open_file(const char * filepath)
 {
-	int len = size;
-	int ret;
+	int len = RAW_FILE_LEN;
+	unsigned int t = now_us();
 
 	switch (this_kernel->filesystem) {
 	case FS_EXT2:
-		if (!ext2fs_mount()) {
-			puts("Unable to mount ext2 filesystem\n");
-			indicate(UI_IND_MOUNT_FAIL);
-			return -2; /* death */
+		if (mounted_read != this_kernel->block_read ||
+		    mounted_offset != partition_offset_blocks) {
+			/* nothing allocated for the last mount is wanted now */
+			mounted_read = NULL;
+			ext2fs_close();
+			malloc_reset();
+			if (!ext2fs_mount()) {
+				puts("Unable to mount ext2 filesystem\n");
+				indicate(UI_IND_MOUNT_FAIL);
+				return -2; /* death */
+			}
+			mounted_read = this_kernel->block_read;
+			mounted_offset = partition_offset_blocks;
+			t = phase_done(PHASE_MOUNT, t);
 		}
 		puts("    EXT2 open: ");
 		puts(filepath);
 		len = ext2fs_open(filepath);
+		phase_done(PHASE_LOOKUP, t);
 		if (len < 0) {
 			puts(" Open failed\n");
 			return -1;
 		}
 		puts(" OK\n");
-		ret = ext2fs_read((char *)destination, size);
-		if (ret < 0) {
-			puts(" Read failed\n");
-			return -1;
-		}
 		break;
 
 	case FS_FAT:
@@ -88,17 +191,97 @@ static int read_file(const char * filepath, u8 * destination, int size)
 		puts("     RAW open: +");
 		printdec(partition_offset_blocks);
 		puts(" 512-byte blocks\n");
+		break;
+	}
+
+	return len;
+}
+
+/* read size bytes of the open file from pos on, which must all be there */
+static int read_chunk(u8 * destination, int pos, int size)
+{
+	unsigned int t = now_us();
+
+	switch (this_kernel->filesystem) {
+	case FS_EXT2:
+		if (ext2fs_read_at((char *)destination, pos, size) != size) {
+			puts(" Read failed\n");
+			return -1;
+		}
+		break;
+
+	case FS_FAT:
+	case FS_RAW:
+		/* whole blocks: pos is one of KERNEL_HEAD/KERNEL_CHUNK */
 		if (this_kernel->block_read(destination,
-				      partition_offset_blocks, size >> 9) < 0) {
+				      partition_offset_blocks + (pos >> 9),
+				      (size + 511) >> 9) < 0) {
 			puts("Bad kernel header\n");
 			return -1;
 		}
 		break;
 	}
 
+	phase_done(PHASE_LOAD, t);
+	load_bytes += size;
+
+	return 0;
+}
+
+static int read_file(const char * filepath, u8 * destination, int size)
+{
+	int len;
+	int pos;
+	int n;
+
+	len = open_file(filepath);
+	if (len < 0)
+		return len;
+	if (size > len)
+		size = len;
+	/* in pieces, to keep the clock ticking over on big files */
+	for (pos = 0; pos < size; pos += n) {
+		n = size - pos;
+		if (n > KERNEL_CHUNK)
+			n = KERNEL_CHUNK;
+		if (read_chunk(destination + pos, pos, n) < 0)
+			return -1;
+	}
+#ifdef DEBUG
+	if (this_kernel->filesystem == FS_EXT2)
+		ext2fs_devread_stats();
+#endif
+
 	return len;
 }
 
+/* the rest of the open kernel file after the head, crc'ing it as it comes */
+static int read_kernel_rest(u8 * kernel_dram, int size, unsigned long *crc)
+{
+	unsigned int t;
+	int pos;
+	int n;
+
+	for (pos = KERNEL_HEAD; pos < size; pos += n) {
+		n = size - pos;
+		if (n > KERNEL_CHUNK)
+			n = KERNEL_CHUNK;
+		if (read_chunk(kernel_dram + pos, pos, n) < 0)
+			return -1;
+		if (crc) {
+			t = now_us();
+			*crc = crc32(*crc, kernel_dram + pos, n);
+			phase_done(PHASE_CRC, t);
+		}
+	}
+#ifdef DEBUG
+	if (this_kernel->filesystem == FS_EXT2)
+		ext2fs_devread_stats();
+#endif
+
+	return 0;
+}
+
 static int do_block_init(void)
 {
 	static void * last_block_init = NULL;
@@ -131,6 +314,11 @@ static int do_block_init(void)
 	return 1; /* happy */
 }
 
+/* the partition table entries last read and the device they came from */
+static int (*mbr_read)(unsigned char *buf, unsigned long start512,
+							       int blocks512);
+static unsigned char mbr_entries[4 * 0x10];
+
 static int do_partitions(void *kernel_dram)
 {
 	unsigned char *p = kernel_dram;
@@ -144,19 +332,24 @@ static int do_partitions(void *kernel_dram)
 		return 1;
 	}
 
-	if ((int)this_kernel->block_read(kernel_dram, 0, 4) < 0) {
-		puts("Bad partition read\n");
-		indicate(UI_IND_MOUNT_FAIL);
-		return 0;
-	}
+	if (mbr_read != this_kernel->block_read) {
+		if ((int)this_kernel->block_read(kernel_dram, 0, 4) < 0) {
+			puts("Bad partition read\n");
+			indicate(UI_IND_MOUNT_FAIL);
+			return 0;
+		}
 
-	if ((p[0x1fe] != 0x55) || (p[0x1ff] != 0xaa)) {
-		puts("partition signature missing\n");
-		indicate(UI_IND_MOUNT_FAIL);
-		return 0;
+		if ((p[0x1fe] != 0x55) || (p[0x1ff] != 0xaa)) {
+			puts("partition signature missing\n");
+			indicate(UI_IND_MOUNT_FAIL);
+			return 0;
+		}
+
+		memcpy(mbr_entries, p + 0x1be, sizeof(mbr_entries));
+		mbr_read = this_kernel->block_read;
 	}
 
-	p += 0x1be + 8 + (0x10 * (this_kernel->partition_index - 1));
+	p = mbr_entries + 8 + (0x10 * (this_kernel->partition_index - 1));
 
 	partition_offset_blocks = (((u32)p[3]) << 24) |
 				  (((u32)p[2]) << 16) |
@@ -276,17 +469,13 @@ static void do_params(unsigned initramfs_len,
 	params->hdr.size = 0;
 }
 
-static int do_crc(const image_header_t *hdr, const void *kernel_dram)
+static int check_crc(const image_header_t *hdr, unsigned long crc)
 {
-	unsigned long crc;
-
 	/*
 	 * It's good for now to know that our kernel is intact from
-	 * the storage before we jump into it and maybe crash silently
-	 * even though it costs us some time
+	 * the storage before we jump into it and maybe crash silently;
+	 * summing it as it is read costs next to no extra time
 	 */
-	crc = crc32(0, kernel_dram + sizeof(image_header_t),
-						   __be32_to_cpu(hdr->ih_size));
 	if (crc == __be32_to_cpu(hdr->ih_dcrc))
 		return 1;
 
@@ -299,10 +488,43 @@ static int do_crc(const image_header_t *hdr, const void *kernel_dram)
 	return 0;
 }
 
-static the_kernel_fn load_uimage(void *kernel_dram)
+/* decompress the checked uImage at hdr to the kernel's place */
+static the_kernel_fn unpack_uimage(image_header_t *hdr, void *kernel_dram)
+{
+	const u8 *src = (const u8 *)hdr + sizeof(image_header_t);
+	size_t src_len = __be32_to_cpu(hdr->ih_size);
+	size_t len = INITRD_OFFSET - 0x8000;
+	unsigned int t = now_us();
+	int r;
+
+	puts("    Unpacking: ");
+	if (hdr->ih_comp == IH_COMP_LZO) {
+		puts("LZO");
+		r = unlzop(src, src_len, kernel_dram, &len);
+	} else {
+		puts("LZ4");
+		r = unlz4(src, src_len, kernel_dram, &len);
+	}
+	phase_done(PHASE_UNPACK, t);
+
+	if (r) {
+		puts(" failed ");
+		printdec(-r);
+		puts("\n");
+		return NULL;
+	}
+	puts(", ");
+	printdec(len >> 10);
+	puts(" KiB\n");
+
+	return (the_kernel_fn) kernel_dram;
+}
+
+static the_kernel_fn load_uimage(void *kernel_dram, int len)
 {
 	image_header_t	*hdr;
 	u32 kernel_size;
+	unsigned long crc;
 
 	hdr = (image_header_t *)kernel_dram;
 
@@ -319,27 +541,57 @@ static the_kernel_fn load_uimage(void *kernel_dram)
 	printdec(__be32_to_cpu(hdr->ih_size) >> 10);
 	puts(" KiB\n");
 
-	kernel_size = ((__be32_to_cpu(hdr->ih_size) +
-			  sizeof(image_header_t) + 2048) & ~(2048 - 1));
+	kernel_size = __be32_to_cpu(hdr->ih_size) + sizeof(image_header_t);
+	if (kernel_size > len) {
+		puts("short kernel\n");
+		return NULL;
+	}
+
+	switch (hdr->ih_comp) {
+	case IH_COMP_NONE:
+		break;
+	case IH_COMP_LZO:
+	case IH_COMP_LZ4:
+		if (kernel_size > UNPACK_MAX) {
+			puts("kernel too big to unpack\n");
+			return NULL;
+		}
+		/* read it all to the side, the head we have too */
+		hdr = (image_header_t *)(this_board->linux_mem_start +
+							      UNPACK_OFFSET);
+		memcpy(hdr, kernel_dram, KERNEL_HEAD);
+		break;
+	default:
+		puts("unknown compression ");
+		printdec(hdr->ih_comp);
+		puts("\n");
+		return NULL;
+	}
 
-	if (read_file(this_kernel->filepath, kernel_dram, kernel_size) < 0) {
+	/* what of the payload is in the head read already */
+	crc = crc32(0, (u8 *)hdr + sizeof(image_header_t),
+		    (kernel_size < KERNEL_HEAD ? kernel_size : KERNEL_HEAD) -
+						      sizeof(image_header_t));
+	if (read_kernel_rest((u8 *)hdr, kernel_size, &crc) < 0) {
 		indicate(UI_IND_KERNEL_PULL_FAIL);
 		return NULL;
 	}
 
 	indicate(UI_IND_KERNEL_PULL_OK);
 
-	if (!do_crc(hdr, kernel_dram))
+	if (!check_crc(hdr, crc))
 		return NULL;
 
+	if (hdr->ih_comp != IH_COMP_NONE)
+		return unpack_uimage(hdr, kernel_dram);
+
 	return (the_kernel_fn) (((char *)hdr) + sizeof(image_header_t));
 }
 
-static the_kernel_fn load_zimage(void *kernel_dram)
+static the_kernel_fn load_zimage(void *kernel_dram, int len)
 {
 	u32 magic = *(u32 *) (kernel_dram + 0x24);
 	u32 size = *(u32 *) (kernel_dram + 0x2c);
-	int got;
 
 	if (magic != 0x016f2818) {
 		puts("bad magic ");
@@ -352,14 +604,13 @@ static the_kernel_fn load_zimage(void *kernel_dram)
 	printdec(size >> 10);
 	puts(" KiB\n");
 
-	got = read_file(this_kernel->filepath, kernel_dram, size);
-	if (got < 0) {
-		indicate(UI_IND_KERNEL_PULL_FAIL);
+	if (size > len) {
+		puts("short kernel\n");
 		return NULL;
 	}
 
-	if (got != size) {
-		puts("short kernel\n");
+	if (read_kernel_rest(kernel_dram, size, NULL) < 0) {
+		indicate(UI_IND_KERNEL_PULL_FAIL);
 		return NULL;
 	}
 
@@ -374,6 +625,8 @@ static void try_this_kernel(void)
 	unsigned int initramfs_len = 0;
 	static char commandline_rootfs_append[512] = "";
 	int ret;
+	int len;
+	unsigned int t;
 	void * kernel_dram = (void *)this_board->linux_mem_start + 0x8000;
 
 	partition_offset_blocks = 0;
@@ -385,11 +638,13 @@ static void try_this_kernel(void)
 
 	indicate(UI_IND_MOUNT_PART);
 
+	t = now_us();
 	if (!do_block_init())
 		return;
 
 	if (!do_partitions(kernel_dram))
 		return;
+	phase_done(PHASE_INIT, t);
 
 	/* does he want us to skip this? */
 
@@ -412,14 +667,17 @@ static void try_this_kernel(void)
 
 	indicate(UI_IND_KERNEL_PULL);
 
-	/* pull the kernel image */
+	/* pull the kernel image: open it once, look at the head */
 
-	if (read_file(this_kernel->filepath, kernel_dram, 4096) < 0)
+	len = open_file(this_kernel->filepath);
+	if (len < 0)
+		return;
+	if (read_chunk(kernel_dram, 0, len < KERNEL_HEAD ? len : KERNEL_HEAD) < 0)
 		return;
 
-	the_kernel = load_uimage(kernel_dram);
+	the_kernel = load_uimage(kernel_dram, len);
 	if (!the_kernel)
-		the_kernel = load_zimage(kernel_dram);
+		the_kernel = load_zimage(kernel_dram, len);
 	if (!the_kernel)
 		return;
 
@@ -446,6 +704,8 @@ static void try_this_kernel(void)
 	if (this_board->close)
 		(this_board->close)();
 
+	print_profile();
+	malloc_stats();
 	puts("Starting --->\n\n");
 	indicate(UI_IND_KERNEL_START);
 
@@ -466,6 +726,8 @@ void bootloader_second_phase(void)
 	if (this_board->post_serial_init)
 		(this_board->post_serial_init)();
 
+	boot_start_us = now_us();
+
 	/* we try the possible kernels for this board in order */
 
 	for (this_kernel = this_board->kernel_source; this_kernel->name;
@@ -475,6 +737,8 @@ void bootloader_second_phase(void)
 	/* none of the kernels worked out */
 
 	puts("\nNo usable kernel image found\n");
+	print_profile();
+	malloc_stats();
 
 	/*
 	 * sit there doing a memory test in this case.
@@ -29,31 +29,118 @@ extern void (*putc_func)(char);
  * malloc pool needs to be in phase 2 bss section, we have phase 1 bss in
  * steppingstone to allow full memory range testing in C
  */
-u8 malloc_pool[MALLOC_POOL_EXTENT];
-void * malloc_pointer = &malloc_pool[0];
+u8 malloc_pool[MALLOC_POOL_EXTENT] __attribute__((aligned(8)));
 
-
-/* improbably simple malloc and free for small and non-intense allocation
- * just moves the allocation ptr forward each time and ignores free
+/*
+ * Small and simple malloc and free for phase 2.  A block is an 8 byte
+ * header and 16 << class bytes for the caller, carved off the top of the
+ * pool the first time a block of its class is wanted.  free() puts it on
+ * the free list of its class for the next malloc of that class to take,
+ * so probing the kernels of one partition after another reuses the same
+ * few blocks instead of walking off the end of the pool.
+ *
+ * Blocks don't move between classes, they only leave the pool all
+ * together when malloc_reset() forgets everything, which phase 2 does when
+ * it drops one mount for another.  If the top of the pool is used up a
+ * free block of a bigger class is taken whole before giving up.
  */
+#define MALLOC_CLASSES	13	/* 16 bytes .. 64KB */
+#define MALLOC_MAGIC	0x4d616c63
+
+struct malloc_head {
+	u32 class;
+	u32 magic;	/* MALLOC_MAGIC while allocated */
+};
+
+static void *free_list[MALLOC_CLASSES];
+static u8 *malloc_pointer = &malloc_pool[0];
+static unsigned int malloc_in_use;
+static unsigned int malloc_peak;
 
 void *malloc(size_t size)
 {
-	void *p = malloc_pointer;
+	struct malloc_head *head;
+	int class = 0;
+	int n;
 
-	malloc_pointer += (size & ~3) + 4;
+	while (class < MALLOC_CLASSES && (16 << class) < size)
+		class++;
+	if (class == MALLOC_CLASSES) {
+		puts("malloc too big\n");
+		return NULL;
+	}
+
+	for (n = class; n < MALLOC_CLASSES; n++) {
+		if (!free_list[n])
+			continue;
+		head = (struct malloc_head *)free_list[n] - 1;
+		free_list[n] = *(void **)free_list[n];
+		goto got;
+	}
 
-	if (((u8 *)malloc_pointer - &malloc_pool[0]) > sizeof(malloc_pool)) {
+	n = class;
+	if (malloc_pointer + sizeof(*head) + (16 << n) >
+				     &malloc_pool[sizeof(malloc_pool)]) {
 		puts("Ran out of malloc pool\n");
-		while (1)
-			;
+		return NULL;
 	}
+	head = (struct malloc_head *)malloc_pointer;
+	head->class = n;
+	malloc_pointer += sizeof(*head) + (16 << n);
 
-	return p;
+	if (malloc_pointer - &malloc_pool[0] > malloc_peak)
+		malloc_peak = malloc_pointer - &malloc_pool[0];
+got:
+	head->magic = MALLOC_MAGIC;
+	malloc_in_use += 16 << head->class;
+
+	return head + 1;
 }
 
 void free(void *ptr)
 {
+	struct malloc_head *head;
+
+	if (!ptr)
+		return;
+
+	head = (struct malloc_head *)ptr - 1;
+
+	if ((u8 *)ptr < &malloc_pool[sizeof(*head)] ||
+	    (u8 *)ptr >= malloc_pointer || head->magic != MALLOC_MAGIC) {
+		puts("free of bad pointer ");
+		print32((unsigned int)ptr);
+		puts("\n");
+		return;
+	}
+
+	head->magic = 0;
+	malloc_in_use -= 16 << head->class;
+	*(void **)ptr = free_list[head->class];
+	free_list[head->class] = ptr;
+}
+
+/* forget every allocation, the caller must have no pointers left into it */
+void malloc_reset(void)
+{
+	int n;
+
+	for (n = 0; n < MALLOC_CLASSES; n++)
+		free_list[n] = NULL;
+	malloc_pointer = &malloc_pool[0];
+	malloc_in_use = 0;
+}
+
+/* how much of the pool is in use and the most of it ever carved up */
+void malloc_stats(void)
+{
+	puts("    malloc: ");
+	printdec(malloc_in_use);
+	puts(" bytes in use, peak ");
+	printdec(malloc_peak);
+	puts(" of ");
+	printdec(sizeof(malloc_pool));
+	puts("\n");
 }
 
 char *strncpy(char *dest, const char *src, size_t n)
@@ -22,6 +22,7 @@
 
 #include <qi.h>
 #include <string.h>
+#include <memops.h>
 
 void (*putc_func)(char) = NULL;
 
@@ -120,25 +121,46 @@ void printdec(int n)
 	}
 }
 
-void *memcpy(void *dest, const void *src, size_t n)
+/*
+ * n / d by shift and subtract, the remainder to rem if it isn't NULL.
+ * The ARM1176 has no divide instruction: gcc calls libgcc for a '/',
+ * and that is linked outside the steppingstone.
+ */
+unsigned int udivmod(unsigned int n, unsigned int d, unsigned int *rem)
 {
-	u8 const * ps = src;
-	u8 * pd = dest;
+	unsigned int q = 0;
+	unsigned int bit = 1;
 
-	while (n--)
-		*pd++ = *ps++;
+	if (d)
+		while (d < n && !(d & 0x80000000)) {
+			d <<= 1;
+			bit <<= 1;
+		}
+	else
+		bit = 0;
+
+	while (bit) {
+		if (n >= d) {
+			n -= d;
+			q |= bit;
+		}
+		d >>= 1;
+		bit >>= 1;
+	}
+	if (rem)
+		*rem = n;
 
-	return dest;
+	return q;
 }
 
-void *memset(void *s, int c, size_t n)
+void *memcpy(void *dest, const void *src, size_t n)
 {
-	u8 * p = s;
-
-	while (n--)
-		*p++ = c;
+	return memops_copy(dest, src, n);
+}
 
-	return s;
+void *memset(void *s, int c, size_t n)
+{
+	return memops_fill(s, c, n);
 }
 
 int q;
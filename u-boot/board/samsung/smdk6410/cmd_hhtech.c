@@ -299,7 +299,8 @@ static int do_readsd_upgrade(int dev, char *file)
     size = load_sd_file(dev, file, (u32)fh, INAND_BLOCK_SIZE);
 
     PFUNC("vendor = %s\n", fh->vendor);
-    if(size > 0 && fh->magic != HEAD_MAGIC) {
+    /* zImage and initramfs are stored as they are in either */
+    if(size > 0 && fh->magic != HEAD_MAGIC && fh->magic != HEAD_MAGIC_EXT) {
 	printf("magic error\n");
 	return -2;
     }
@@ -314,7 +315,7 @@ static int do_readsd_upgrade(int dev, char *file)
     else
 	size = fh->zimage.file.offset + fh->zimage.file.size;
     size = load_sd_file(dev, file, (u32)fh, size);
-    if(size > 0 && fh->magic != HEAD_MAGIC) {
+    if(size > 0 && fh->magic != HEAD_MAGIC && fh->magic != HEAD_MAGIC_EXT) {
 	printf("magic error\n");
 	return -2;
     }
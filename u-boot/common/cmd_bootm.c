@@ -150,6 +150,90 @@ image_header_t header;
 
 ulong load_addr = CFG_LOAD_ADDR;		/* Default Load Address */
 
+/* Whether the image is for the CPU we run on */
+static int
+image_arch_ok (image_header_t *hdr)
+{
+#if defined(__PPC__)
+	return hdr->ih_arch == IH_CPU_PPC;
+#elif defined(__ARM__)
+	return hdr->ih_arch == IH_CPU_ARM;
+#elif defined(__I386__)
+	return hdr->ih_arch == IH_CPU_I386;
+#elif defined(__mips__)
+	return hdr->ih_arch == IH_CPU_MIPS;
+#elif defined(__nios__)
+	return hdr->ih_arch == IH_CPU_NIOS;
+#elif defined(__M68K__)
+	return hdr->ih_arch == IH_CPU_M68K;
+#elif defined(__microblaze__)
+	return hdr->ih_arch == IH_CPU_MICROBLAZE;
+#elif defined(__nios2__)
+	return hdr->ih_arch == IH_CPU_NIOS2;
+#elif defined(__blackfin__)
+	return hdr->ih_arch == IH_CPU_BLACKFIN;
+#elif defined(__avr32__)
+	return hdr->ih_arch == IH_CPU_AVR32;
+#else
+# error Unknown CPU type
+#endif
+}
+
+/*
+ * Hand over to the OS of the image in `header', see boot_os_Fcn;
+ * only returns if that fails.
+ */
+static void
+boot_os (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[],
+	 ulong addr, ulong *len_ptr, int verify)
+{
+	image_header_t *hdr = &header;
+
+	switch (hdr->ih_os) {
+	default:			/* handled by (original) Linux case */
+	case IH_OS_LINUX:
+#ifdef CONFIG_SILENT_CONSOLE
+	    fixup_silent_linux();
+#endif
+	    do_bootm_linux  (cmdtp, flag, argc, argv,
+			     addr, len_ptr, verify);
+	    break;
+	case IH_OS_NETBSD:
+	    do_bootm_netbsd (cmdtp, flag, argc, argv,
+			     addr, len_ptr, verify);
+	    break;
+
+#ifdef CONFIG_LYNXKDI
+	case IH_OS_LYNXOS:
+	    do_bootm_lynxkdi (cmdtp, flag, argc, argv,
+			     addr, len_ptr, verify);
+	    break;
+#endif
+
+	case IH_OS_RTEMS:
+	    do_bootm_rtems (cmdtp, flag, argc, argv,
+			     addr, len_ptr, verify);
+	    break;
+
+#if (CONFIG_COMMANDS & CFG_CMD_ELF)
+	case IH_OS_VXWORKS:
+	    do_bootm_vxworks (cmdtp, flag, argc, argv,
+			      addr, len_ptr, verify);
+	    break;
+	case IH_OS_QNX:
+	    do_bootm_qnxelf (cmdtp, flag, argc, argv,
+			      addr, len_ptr, verify);
+	    break;
+#endif /* CFG_CMD_ELF */
+#ifdef CONFIG_ARTOS
+	case IH_OS_ARTOS:
+	    do_bootm_artos  (cmdtp, flag, argc, argv,
+			     addr, len_ptr, verify);
+	    break;
+#endif
+	}
+}
+
 int do_bootm (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
 {
 	ulong	iflag;
@@ -261,30 +345,7 @@ int do_bootm (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
 
 	len_ptr = (ulong *)data;
 
-#if defined(__PPC__)
-	if (hdr->ih_arch != IH_CPU_PPC)
-#elif defined(__ARM__)
-	if (hdr->ih_arch != IH_CPU_ARM)
-#elif defined(__I386__)
-	if (hdr->ih_arch != IH_CPU_I386)
-#elif defined(__mips__)
-	if (hdr->ih_arch != IH_CPU_MIPS)
-#elif defined(__nios__)
-	if (hdr->ih_arch != IH_CPU_NIOS)
-#elif defined(__M68K__)
-	if (hdr->ih_arch != IH_CPU_M68K)
-#elif defined(__microblaze__)
-	if (hdr->ih_arch != IH_CPU_MICROBLAZE)
-#elif defined(__nios2__)
-	if (hdr->ih_arch != IH_CPU_NIOS2)
-#elif defined(__blackfin__)
-	if (hdr->ih_arch != IH_CPU_BLACKFIN)
-#elif defined(__avr32__)
-	if (hdr->ih_arch != IH_CPU_AVR32)
-#else
-# error Unknown CPU type
-#endif
-	{
+	if (!image_arch_ok (hdr)) {
 		printf ("Unsupported Architecture 0x%x\n", hdr->ih_arch);
 		SHOW_BOOT_PROGRESS (-4);
 		return 1;
@@ -373,9 +434,10 @@ int do_bootm (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
 	case IH_COMP_BZIP2:
 		printf ("   Uncompressing %s ... ", name);
 		/*
-		 * If we've got less than 4 MB of malloc() space,
-		 * use slower decompression algorithm which requires
-		 * at most 2300 KB of memory.
+		 * The fast decoder's 3.6MB work area goes at the top of
+		 * the unc_len output space if the kernel leaves it free.
+		 * Otherwise, with less than 4 MB of malloc() space, use
+		 * the slower algorithm which requires at most 2300 KB.
 		 */
 		i = BZ2_bzBuffToBuffDecompress ((char*)ntohl(hdr->ih_load),
 						&unc_len, (char *)data, len,
@@ -388,6 +450,29 @@ int do_bootm (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
 		}
 		break;
 #endif /* CONFIG_BZIP2 */
+#ifdef CONFIG_LZO
+	case IH_COMP_LZO:
+		printf ("   Uncompressing %s ... ", name);
+		i = lzop_decompress ((void *)ntohl(hdr->ih_load), unc_len,
+				     (uchar *)data, &len);
+		if (i != 0) {
+			printf ("LZO ERROR %d - must RESET board to recover\n", i);
+			SHOW_BOOT_PROGRESS (-6);
+			do_reset (cmdtp, flag, argc, argv);
+		}
+		break;
+#endif /* CONFIG_LZO */
+#ifdef CONFIG_LZ4
+	case IH_COMP_LZ4:
+		printf ("   Uncompressing %s ... ", name);
+		if (lz4_decompress ((void *)ntohl(hdr->ih_load), unc_len,
+				    (uchar *)data, &len) != 0) {
+			puts ("LZ4 ERROR - must RESET board to recover\n");
+			SHOW_BOOT_PROGRESS (-6);
+			do_reset (cmdtp, flag, argc, argv);
+		}
+		break;
+#endif /* CONFIG_LZ4 */
 	default:
 		if (iflag)
 			enable_interrupts();
@@ -431,49 +516,7 @@ int do_bootm (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
 #if defined(CONFIG_ZIMAGE_BOOT) || defined(CONFIG_IMAGE_BOOT)
 after_header_check:
 #endif
-	switch (hdr->ih_os) {
-	default:			/* handled by (original) Linux case */
-	case IH_OS_LINUX:
-#ifdef CONFIG_SILENT_CONSOLE
-	    fixup_silent_linux();
-#endif
-	    do_bootm_linux  (cmdtp, flag, argc, argv,
-			     addr, len_ptr, verify);
-	    break;
-	case IH_OS_NETBSD:
-	    do_bootm_netbsd (cmdtp, flag, argc, argv,
-			     addr, len_ptr, verify);
-	    break;
-
-#ifdef CONFIG_LYNXKDI
-	case IH_OS_LYNXOS:
-	    do_bootm_lynxkdi (cmdtp, flag, argc, argv,
-			     addr, len_ptr, verify);
-	    break;
-#endif
-
-	case IH_OS_RTEMS:
-	    do_bootm_rtems (cmdtp, flag, argc, argv,
-			     addr, len_ptr, verify);
-	    break;
-
-#if (CONFIG_COMMANDS & CFG_CMD_ELF)
-	case IH_OS_VXWORKS:
-	    do_bootm_vxworks (cmdtp, flag, argc, argv,
-			      addr, len_ptr, verify);
-	    break;
-	case IH_OS_QNX:
-	    do_bootm_qnxelf (cmdtp, flag, argc, argv,
-			      addr, len_ptr, verify);
-	    break;
-#endif /* CFG_CMD_ELF */
-#ifdef CONFIG_ARTOS
-	case IH_OS_ARTOS:
-	    do_bootm_artos  (cmdtp, flag, argc, argv,
-			     addr, len_ptr, verify);
-	    break;
-#endif
-	}
+	boot_os (cmdtp, flag, argc, argv, addr, len_ptr, verify);
 
 	SHOW_BOOT_PROGRESS (-9);
 #ifdef DEBUG
@@ -1408,6 +1451,8 @@ print_type (image_header_t *hdr)
 	case IH_COMP_NONE:	comp = "uncompressed";		break;
 	case IH_COMP_GZIP:	comp = "gzip compressed";	break;
 	case IH_COMP_BZIP2:	comp = "bzip2 compressed";	break;
+	case IH_COMP_LZO:	comp = "lzo compressed";	break;
+	case IH_COMP_LZ4:	comp = "lz4 compressed";	break;
 	default:		comp = "unknown compression";	break;
 	}
 
@@ -1441,12 +1486,11 @@ static void zfree(void *x, void *addr, unsigned nb)
 
 #define DEFLATED	8
 
-int gunzip(void *dst, int dstlen, unsigned char *src, unsigned long *lenp)
+/* Length of the gzip header at src, or -1 if that is no gzip file */
+static int gzip_header_len(unsigned char *src, unsigned long len)
 {
-	z_stream s;
-	int r, i, flags;
+	int i, flags;
 
-	/* skip header */
 	i = 10;
 	flags = src[3];
 	if (src[2] != DEFLATED || (flags & RESERVED) != 0) {
@@ -1463,10 +1507,22 @@ int gunzip(void *dst, int dstlen, unsigned char *src, unsigned long *lenp)
 			;
 	if ((flags & HEAD_CRC) != 0)
 		i += 2;
-	if (i >= *lenp) {
+	if (i >= len) {
 		puts ("Error: gunzip out of data in header\n");
 		return (-1);
 	}
+	return i;
+}
+
+int gunzip(void *dst, int dstlen, unsigned char *src, unsigned long *lenp)
+{
+	z_stream s;
+	int r, i;
+
+	/* skip header */
+	i = gzip_header_len(src, *lenp);
+	if (i < 0)
+		return (-1);
 
 	s.zalloc = zalloc;
 	s.zfree = zfree;
@@ -1503,6 +1559,433 @@ void bz_internal_error(int errcode)
 }
 #endif /* CONFIG_BZIP2 */
 
+#ifdef CONFIG_BOOTDEV
+/*
+ * bootdev: boot an image straight from a block device, a file on a FAT
+ * partition or raw blocks, rather than loading it first and then
+ * checking and uncompressing it.
+ *
+ * The image is read CFG_BOOTDEV_CHUNK bytes at a time.  While the next
+ * chunk is read (by DMA, if the driver has block_read_start) the last
+ * one is added to the data CRC and inflated or bunzipped to the load
+ * address, from one of two buffers in turn.  An uncompressed image is
+ * read to the load address itself.  The LZO and LZ4 decoders want all
+ * of their input at once, so such an image gathers CFG_BOOTM_LEN past
+ * the load address, just beyond the largest kernel, and is unpacked
+ * from there at the end; bzip2's work area goes there too.  Reads are
+ * whole sectors: up to one sector past the end of the image may land
+ * there too.
+ */
+#include <part.h>
+#include <fat.h>
+
+extern block_dev_desc_t *get_dev (char*, int);	/* cmd_fat.c */
+
+#ifndef CFG_BOOTDEV_CHUNK
+#define CFG_BOOTDEV_CHUNK	(64 * 1024)	/* must hold a FAT cluster */
+#endif
+
+typedef struct {
+	block_dev_desc_t *dev;
+	fat_file_t	*file;		/* NULL for raw blocks */
+	ulong		sect;		/* the next sector to read */
+	ulong		nsect;		/* of the file, that follow there */
+	ulong		left;		/* bytes of the image not read yet */
+	int		reads;
+} bootdev_src;
+
+/* Start reading the next chunk to buf; return its length or -1 */
+static long
+bootdev_start (bootdev_src *src, uchar *buf)
+{
+	block_dev_desc_t *dev = src->dev;
+	ulong len, n;
+	long r;
+
+	if (src->file && src->nsect == 0) {
+		r = file_fat_extent (src->file, &src->sect,
+				     CFG_BOOTDEV_CHUNK / SECTOR_SIZE);
+		if (r <= 0)
+			return -1;
+		src->nsect = r;
+	}
+
+	len = src->left < CFG_BOOTDEV_CHUNK ? src->left : CFG_BOOTDEV_CHUNK;
+	n = (len + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	if (src->file) {
+		if (n > src->nsect) {
+			n = src->nsect;
+			len = n * SECTOR_SIZE;
+		}
+		src->nsect -= n;
+	}
+
+	if (dev->block_read_start)
+		r = dev->block_read_start (dev->dev, src->sect, n, (ulong *)buf);
+	else
+		r = dev->block_read (dev->dev, src->sect, n, (ulong *)buf) ?
+		    0 : -1;
+	if (r < 0)
+		return -1;
+
+	src->sect += n;
+	src->left -= len;
+	src->reads++;
+	return len;
+}
+
+/* Wait for the read bootdev_start() started */
+static int
+bootdev_wait (bootdev_src *src)
+{
+	if (src->dev->block_read_wait)
+		return src->dev->block_read_wait (src->dev->dev);
+	return 0;
+}
+
+int do_bootdev (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
+{
+	block_dev_desc_t *dev_desc;
+	fat_file_t file;
+	bootdev_src src;
+	image_header_t *hdr = &header;
+	z_stream zs;
+#ifdef CONFIG_BZIP2
+	bz_stream bz;
+#endif
+	uchar	*buf[2] = { NULL, NULL };
+	uchar	*p, *next, *to = NULL;
+	ulong	load, total, checksum, dcrc = 0, start;
+	ulong	len = 0, unc_len = CFG_BOOTM_LEN;
+	long	n, rd = 0, size = 0;
+	int	dev, part = 1, skip, cur = 0, gzhead = 0, ended = 0;
+	int	i, verify;
+	char	*ep, *s;
+
+	s = getenv ("verify");
+	verify = (s && (*s == 'n')) ? 0 : 1;
+
+	if (argc < 4 || (strcmp (argv[3], "-b") == 0 && argc < 5)) {
+		printf ("Usage:\n%s\n", cmdtp->usage);
+		return 1;
+	}
+	dev = (int)simple_strtoul (argv[2], &ep, 16);
+	dev_desc = get_dev (argv[1], dev);
+	if (dev_desc == NULL) {
+		puts ("\n** Invalid boot device **\n");
+		return 1;
+	}
+	if (*ep) {
+		if (*ep != ':') {
+			puts ("\n** Invalid boot device, use `dev[:part]' **\n");
+			return 1;
+		}
+		part = (int)simple_strtoul (++ep, NULL, 16);
+	}
+
+	memset (&src, 0, sizeof(src));
+	src.dev = dev_desc;
+	if (strcmp (argv[3], "-b") == 0) {
+		src.sect = simple_strtoul (argv[4], NULL, 16);
+		src.left = CFG_BOOTDEV_CHUNK;	/* until the header tells */
+		skip = 5;
+		printf ("## Booting image at %s %d block %lx ...\n",
+			argv[1], dev, src.sect);
+	} else {
+		if (fat_register_device (dev_desc, part) != 0) {
+			printf ("\n** Unable to use %s %d:%d for bootdev **\n",
+				argv[1], dev, part);
+			return 1;
+		}
+		size = file_fat_open (argv[3], &file);
+		if (size < 0) {
+			printf ("\n** Unable to read \"%s\" from %s %d:%d **\n",
+				argv[3], argv[1], dev, part);
+			return 1;
+		}
+		src.file = &file;
+		src.left = size;
+		skip = 4;
+		printf ("## Booting image %s from %s %d:%d ...\n",
+			argv[3], argv[1], dev, part);
+	}
+
+	buf[0] = malloc (CFG_BOOTDEV_CHUNK);
+	buf[1] = malloc (CFG_BOOTDEV_CHUNK);
+	if (buf[0] == NULL || buf[1] == NULL) {
+		puts ("Out of memory\n");
+		goto fail;
+	}
+
+	start = get_timer (0);
+	n = bootdev_start (&src, buf[0]);
+	if (n < 0 || bootdev_wait (&src) < 0) {
+		puts ("** Read error **\n");
+		goto fail;
+	}
+	if (n < (long)sizeof(image_header_t)) {
+		puts ("Bad Magic Number\n");
+		goto fail;
+	}
+
+	/* the same checks as bootm */
+	memmove (&header, buf[0], sizeof(image_header_t));
+	if (ntohl(hdr->ih_magic) != IH_MAGIC) {
+		puts ("Bad Magic Number\n");
+		goto fail;
+	}
+	checksum = ntohl(hdr->ih_hcrc);
+	hdr->ih_hcrc = 0;
+	if (crc32 (0, (uchar *)hdr, sizeof(image_header_t)) != checksum) {
+		puts ("Bad Header Checksum\n");
+		goto fail;
+	}
+	print_image_hdr ((image_header_t *)buf[0]);
+
+	if (!image_arch_ok (hdr)) {
+		printf ("Unsupported Architecture 0x%x\n", hdr->ih_arch);
+		goto fail;
+	}
+	if (hdr->ih_type != IH_TYPE_KERNEL) {
+		printf ("Wrong Image Type for %s command\n", cmdtp->name);
+		goto fail;
+	}
+
+	total = sizeof(image_header_t) + ntohl(hdr->ih_size);
+	if (src.file && size < total) {
+		puts ("File shorter than the image\n");
+		goto fail;
+	}
+	src.left = total > n ? total - n : 0;
+	if (n > (long)total)
+		n = total;
+	p = buf[0] + sizeof(image_header_t);
+	n -= sizeof(image_header_t);
+	load = ntohl(hdr->ih_load);
+
+	switch (hdr->ih_comp) {
+	case IH_COMP_NONE:
+		to = (uchar *)load;
+		break;
+	case IH_COMP_GZIP:
+		gzhead = gzip_header_len (p, n);
+		if (gzhead < 0)
+			goto fail;
+		break;
+#ifdef CONFIG_BZIP2
+	case IH_COMP_BZIP2:
+		break;
+#endif
+#ifdef CONFIG_LZO
+	case IH_COMP_LZO:
+		to = (uchar *)load + unc_len;
+		break;
+#endif
+#ifdef CONFIG_LZ4
+	case IH_COMP_LZ4:
+		to = (uchar *)load + unc_len;
+		break;
+#endif
+	default:
+		printf ("Unimplemented compression type %d\n", hdr->ih_comp);
+		goto fail;
+	}
+
+	/*
+	 * The point of no return, as in bootm: from here on the load
+	 * address is written.
+	 */
+	disable_interrupts();
+
+	if (hdr->ih_comp == IH_COMP_GZIP) {
+		zs.zalloc = zalloc;
+		zs.zfree = zfree;
+#if defined(CONFIG_HW_WATCHDOG) || defined(CONFIG_WATCHDOG)
+		zs.outcb = (cb_func)WATCHDOG_RESET;
+#else
+		zs.outcb = Z_NULL;
+#endif
+		i = inflateInit2 (&zs, -MAX_WBITS);
+		if (i != Z_OK) {
+			printf ("Error: inflateInit2() returned %d", i);
+			goto broken;
+		}
+		zs.next_out = (uchar *)load;
+		zs.avail_out = unc_len;
+	}
+#ifdef CONFIG_BZIP2
+	if (hdr->ih_comp == IH_COMP_BZIP2) {
+		bz.bzalloc = NULL;
+		bz.bzfree = NULL;
+		bz.opaque = NULL;
+		/* as in bootm, small if there is under 4MB to malloc */
+		i = BZ2_bzDecompressInit (&bz, 0,
+					  CFG_MALLOC_LEN < (4096 * 1024));
+		if (i == BZ_OK)
+			i = BZ2_bzDecompressWorkspace (&bz, (char *)load + unc_len,
+						       900000 * sizeof(int));
+		if (i != BZ_OK) {
+			printf ("BUNZIP2 ERROR %d", i);
+			goto broken;
+		}
+		bz.next_out = (char *)load;
+		bz.avail_out = unc_len;
+	}
+#endif
+
+	printf ("   %s Kernel Image ... ",
+		hdr->ih_comp == IH_COMP_NONE ? "Loading" : "Uncompressing");
+	if (to) {
+		memmove (to, p, n);
+		p = to;
+		to += n;
+	}
+
+	for (;;) {
+		WATCHDOG_RESET();
+
+		/* the device fills the next chunk ... */
+		next = NULL;
+		if (src.left) {
+			next = to ? to : buf[cur ^ 1];
+			rd = bootdev_start (&src, next);
+			if (rd < 0) {
+				puts ("READ ERROR");
+				goto broken;
+			}
+			if (to)
+				to += rd;
+		}
+
+		/* ... while this one is checked and uncompressed */
+		if (verify)
+			dcrc = crc32 (dcrc, p, n);
+		p += gzhead;
+		n -= gzhead;
+		gzhead = 0;
+		if (n && !ended) {
+			if (hdr->ih_comp == IH_COMP_GZIP) {
+				zs.next_in = p;
+				zs.avail_in = n;
+				i = inflate (&zs, Z_NO_FLUSH);
+				if (i == Z_STREAM_END) {
+					ended = 1;
+				} else if (i != Z_OK) {
+					printf ("GUNZIP ERROR %d", i);
+					goto broken;
+				}
+			}
+#ifdef CONFIG_BZIP2
+			if (hdr->ih_comp == IH_COMP_BZIP2) {
+				bz.next_in = (char *)p;
+				bz.avail_in = n;
+				i = BZ2_bzDecompress (&bz);
+				if (i == BZ_STREAM_END) {
+					ended = 1;
+				} else if (i != BZ_OK) {
+					printf ("BUNZIP2 ERROR %d", i);
+					goto broken;
+				}
+			}
+#endif
+		}
+
+		if (next == NULL)
+			break;
+		if (bootdev_wait (&src) < 0) {
+			puts ("READ ERROR");
+			goto broken;
+		}
+		p = next;
+		n = rd;
+		cur ^= 1;
+	}
+
+	len = ntohl(hdr->ih_size);
+	switch (hdr->ih_comp) {
+	case IH_COMP_GZIP:
+		len = zs.next_out - (uchar *)load;
+		inflateEnd (&zs);
+		if (!ended) {
+			puts ("GUNZIP ERROR, data ends early or is too big");
+			goto broken;
+		}
+		break;
+#ifdef CONFIG_BZIP2
+	case IH_COMP_BZIP2:
+		len = bz.next_out - (char *)load;
+		BZ2_bzDecompressEnd (&bz);
+		if (!ended) {
+			puts ("BUNZIP2 ERROR, data ends early or is too big");
+			goto broken;
+		}
+		break;
+#endif
+#ifdef CONFIG_LZO
+	case IH_COMP_LZO:
+		i = lzop_decompress ((void *)load, unc_len,
+				     (uchar *)load + unc_len, &len);
+		if (i != 0) {
+			printf ("LZO ERROR %d", i);
+			goto broken;
+		}
+		break;
+#endif
+#ifdef CONFIG_LZ4
+	case IH_COMP_LZ4:
+		if (lz4_decompress ((void *)load, unc_len,
+				    (uchar *)load + unc_len, &len) != 0) {
+			puts ("LZ4 ERROR");
+			goto broken;
+		}
+		break;
+#endif
+	}
+	if (verify && dcrc != ntohl(hdr->ih_dcrc)) {
+		puts ("Bad Data CRC");
+		goto broken;
+	}
+	printf ("OK\n   %lu bytes, %d reads, %lu ms\n", len, src.reads,
+		get_timer (start) / (CFG_HZ / 1000));
+
+	free (buf[0]);
+	free (buf[1]);
+	if (src.file)
+		file_fat_close (src.file);
+
+	/* the args after the image, an initrd first, where bootm has them */
+	boot_os (cmdtp, flag, argc - (skip - 2), argv + (skip - 2),
+		 load, NULL, verify);
+
+	SHOW_BOOT_PROGRESS (-9);
+	return 1;
+
+fail:
+	free (buf[0]);
+	free (buf[1]);
+	if (src.file)
+		file_fat_close (src.file);
+	return 1;
+
+broken:
+	puts (" - must RESET board to recover\n");
+	SHOW_BOOT_PROGRESS (-6);
+	do_reset (cmdtp, flag, argc, argv);
+	return 1;
+}
+
+U_BOOT_CMD(
+	bootdev,	CFG_MAXARGS,	1,	do_bootdev,
+	"bootdev - boot application image from a block device\n",
+	"<interface> <dev[:part]> <filename> [arg ...]\n"
+	"    - boot image 'filename' from the dos filesystem on 'dev'\n"
+	"<interface> <dev> -b <block> [arg ...]\n"
+	"    - boot the image at 'block' of 'dev'\n"
+	"\tThe image is read, checked and uncompressed in one pass; as with\n"
+	"\tbootm, 'arg' can be the address of an initrd image\n"
+);
+#endif /* CONFIG_BOOTDEV */
+
 static void
 do_bootm_rtems (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[],
 		ulong addr, ulong *len_ptr, int verify)
@@ -118,6 +118,7 @@ int do_fat_fsload (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[])
 	}
 
 	printf ("\n%ld bytes read\n", size);
+	file_fat_print_stats();
 
 	sprintf(buf, "%lX", size);
 	setenv("filesize", buf);
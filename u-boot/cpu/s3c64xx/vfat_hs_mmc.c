@@ -969,7 +969,12 @@ static int mmc_decode_csd(u32 *raw_csd, mmc_csd_t *csd)
 }
 
 #define  DELAY_LOOPS (0x10000)
-unsigned long mmc_read_block(int dev_num, ulong start_blk, ulong blknum, ulong *addr)
+/*
+ * Read in two halves: mmc_read_start() sends the command and leaves the
+ * DMA running, mmc_read_wait() waits for it to end.  The caller may do
+ * anything in between that doesn't touch the card.
+ */
+int mmc_read_start(int dev_num, ulong start_blk, ulong blknum, ulong *addr)
 {
     uint blksize; //j, , Addr_temp = start_blk;
     uint cmd, multi; //, TotalReadByte, read_blk_cnt = 0;
@@ -1014,15 +1019,30 @@ unsigned long mmc_read_block(int dev_num, ulong start_blk, ulong blknum, ulong *
 	printf(("Command NOT Complete\n"));
     }
     ClearCommandCompleteStatus();
+    return 0;
+}
 
-    udelay(blknum*10);
-    if( check_dma_int())
-	printf("Wait DMA END error,blknum=%d\n", blknum);
+int mmc_read_wait(int dev_num)
+{
+    int ret = 0;
+
+    if( check_dma_int()) {
+	printf("Wait DMA END error\n");
+	ret = -1;
+    }
 
     ClearTransferCompleteStatus();
     s3c_hsmmc_writew(s3c_hsmmc_readw(HM_NORINTSTS) | (1 << 3), HM_NORINTSTS);
 
     HSMMC_DPRINT("func=%s,%d\n", __func__, __LINE__);
+    return ret;
+}
+
+unsigned long mmc_read_block(int dev_num, ulong start_blk, ulong blknum, ulong *addr)
+{
+    mmc_read_start(dev_num, start_blk, blknum, addr);
+    udelay(blknum*10);
+    mmc_read_wait(dev_num);
     return 1;
 }
 
@@ -1171,6 +1191,8 @@ int hsmmc_init (void)
 	sprintf((char*)mmc_dev.product,"%s", "HHTECH");
 	sprintf((char*)mmc_dev.revision,"%x %x", 2, 0);
 	mmc_dev.block_read = mmc_read_block;
+	mmc_dev.block_read_start = mmc_read_start;
+	mmc_dev.block_read_wait = mmc_read_wait;
 	mmc_dev.removable = 1;
 
 	dbg("Product Name : %c%c%c%c%c%c\n", ((s3c_hsmmc_readl(HM_RSPREG2) >> 24) & 0xFF),
@@ -30,6 +30,7 @@
 #include <fat.h>
 #include <asm/byteorder.h>
 #include <part.h>
+#include <malloc.h>
 
 #if (CONFIG_COMMANDS & CFG_CMD_FAT)
 
@@ -49,6 +50,12 @@ static  block_dev_desc_t *cur_dev = NULL;
 static unsigned long part_offset = 0;
 static int cur_part = 1;
 
+/* What a file read cost, as file_fat_read() reports it */
+static struct {
+	int	fat_reads, fat_sects;	/* Of the FAT */
+	int	data_reads, data_sects;	/* Of directories and file data */
+} fat_stats;
+
 #define DOS_PART_TBL_OFFSET	0x1be
 #define DOS_PART_MAGIC_OFFSET	0x1fe
 #define DOS_FS_TYPE_OFFSET	0x36
@@ -193,6 +200,119 @@ static void get_name (dir_entry *dirent, char *s_name)
 	downcase (s_name);
 }
 
+/*
+ * Set up the FAT cache of a read: as many windows of FATBUFSIZE as
+ * CFG_FAT_CACHE_SIZE has room for, or all of the FAT when it fits in
+ * that.  Without the memory get_fatent() makes do with fatbuf.
+ */
+static void
+fat_cache_init(fsdata *mydata)
+{
+	int windows = (mydata->fatlength + FATBUFBLOCKS - 1) / FATBUFBLOCKS;
+	int slots = CFG_FAT_CACHE_SIZE / FATBUFSIZE;
+	int i;
+
+	mydata->fatbufnum = -1;
+	mydata->fatclock = 0;
+	mydata->fatwhole = windows <= slots;
+	if (mydata->fatwhole)
+		slots = windows;
+	if (slots < 2)
+		return;
+
+	mydata->fatcache = malloc(slots * (FATBUFSIZE + sizeof(fatwindow)));
+	if (!mydata->fatcache)
+		return;
+	mydata->fatwin = (fatwindow *)(mydata->fatcache + slots * FATBUFSIZE);
+	mydata->fatslots = slots;
+	for (i = 0; i < slots; i++) {
+		mydata->fatwin[i].bufnum = -1;
+		mydata->fatwin[i].used = 0;
+	}
+}
+
+static void
+fat_cache_free(fsdata *mydata)
+{
+	if (mydata->fatcache)
+		free(mydata->fatcache);
+	mydata->fatcache = NULL;
+}
+
+/*
+ * Get window 'bufnum' of the FAT, FATBUFBLOCKS sectors of it, reading it
+ * in unless it is cached.  When all of the FAT is cached, the windows
+ * after it that aren't in yet come with it, up to FAT_READAHEAD.
+ * Return a pointer to it, or NULL on failure.
+ */
+static __u8 *
+get_fatwindow(fsdata *mydata, __u32 bufnum)
+{
+	__u32 startblock = bufnum * FATBUFBLOCKS;
+	int windows = 1;
+	int getsize;
+	__u8 *bufptr;
+	int i, slot = 0;
+
+	if (startblock >= mydata->fatlength) {
+		FAT_DPRINT("FAT window %d out of range\n", bufnum);
+		return NULL;
+	}
+
+	if (!mydata->fatcache) {
+		if (bufnum == mydata->fatbufnum)
+			return mydata->fatbuf;
+		mydata->fatbufnum = -1;
+		bufptr = mydata->fatbuf;
+	} else {
+		mydata->fatclock++;
+		if (mydata->fatwhole) {
+			slot = bufnum;
+		} else {
+			/* hit, else the least recently used slot */
+			for (i = 0; i < mydata->fatslots; i++) {
+				if (mydata->fatwin[i].bufnum == bufnum) {
+					slot = i;
+					break;
+				}
+				if (mydata->fatwin[i].used <
+				    mydata->fatwin[slot].used)
+					slot = i;
+			}
+		}
+		bufptr = mydata->fatcache + slot * FATBUFSIZE;
+		mydata->fatwin[slot].used = mydata->fatclock;
+		if (mydata->fatwin[slot].bufnum == bufnum)
+			return bufptr;
+		mydata->fatwin[slot].bufnum = -1;
+
+		if (mydata->fatwhole)
+			while (windows < FAT_READAHEAD &&
+			       slot + windows < mydata->fatslots &&
+			       mydata->fatwin[slot + windows].bufnum < 0)
+				windows++;
+	}
+
+	/* Read a new block of FAT entries into the cache. */
+	getsize = windows * FATBUFBLOCKS;
+	if (getsize > mydata->fatlength - startblock)
+		getsize = mydata->fatlength - startblock;
+	if (disk_read(mydata->fat_sect + startblock, getsize, bufptr) < 0) {
+		FAT_DPRINT("Error reading FAT blocks\n");
+		return NULL;
+	}
+	fat_stats.fat_reads++;
+	fat_stats.fat_sects += getsize;
+
+	if (!mydata->fatcache)
+		mydata->fatbufnum = bufnum;
+	else
+		for (i = 0; i < windows; i++)
+			mydata->fatwin[slot + i].bufnum = bufnum + i;
+
+	return bufptr;
+}
+
 /*
  * Get the entry at index 'entry' in a FAT (12/16/32) table.
  * On failure 0x00 is returned.
@@ -203,6 +323,7 @@ get_fatent(fsdata *mydata, __u32 entry)
 	__u32 bufnum;
 	__u32 offset;
 	__u32 ret = 0x00;
+	__u8 *fatbuf;
 
 	switch (mydata->fatsize) {
 	case 32:
@@ -223,31 +344,18 @@ get_fatent(fsdata *mydata, __u32 entry)
 		return ret;
 	}
 
-	/* Read a new block of FAT entries into the cache. */
-	if (bufnum != mydata->fatbufnum) {
-		int getsize = FATBUFSIZE/FS_BLOCK_SIZE;
-		__u8 *bufptr = mydata->fatbuf;
-		__u32 fatlength = mydata->fatlength;
-		__u32 startblock = bufnum * FATBUFBLOCKS;
-
-		fatlength *= SECTOR_SIZE;	/* We want it in bytes now */
-		startblock += mydata->fat_sect;	/* Offset from start of disk */
-
-		if (getsize > fatlength) getsize = fatlength;
-		if (disk_read(startblock, getsize, bufptr) < 0) {
-			FAT_DPRINT("Error reading FAT blocks\n");
-			return ret;
-		}
-		mydata->fatbufnum = bufnum;
-	}
+	fatbuf = get_fatwindow(mydata, bufnum);
+	if (!fatbuf)
+		return ret;
 
 	/* Get the actual entry from the table */
 	switch (mydata->fatsize) {
 	case 32:
-		ret = FAT2CPU32(((__u32*)mydata->fatbuf)[offset]);
+		/* The top four bits are reserved */
+		ret = FAT2CPU32(((__u32*)fatbuf)[offset]) & 0x0fffffff;
 		break;
 	case 16:
-		ret = FAT2CPU16(((__u16*)mydata->fatbuf)[offset]);
+		ret = FAT2CPU16(((__u16*)fatbuf)[offset]);
 		break;
 	case 12: {
 		__u32 off16 = (offset*3)/4;
@@ -255,25 +363,25 @@ get_fatent(fsdata *mydata, __u32 entry)
 
 		switch (offset & 0x3) {
 		case 0:
-			ret = FAT2CPU16(((__u16*)mydata->fatbuf)[off16]);
+			ret = FAT2CPU16(((__u16*)fatbuf)[off16]);
 			ret &= 0xfff;
 			break;
 		case 1:
-			val1 = FAT2CPU16(((__u16*)mydata->fatbuf)[off16]);
+			val1 = FAT2CPU16(((__u16*)fatbuf)[off16]);
 			val1 &= 0xf000;
-			val2 = FAT2CPU16(((__u16*)mydata->fatbuf)[off16+1]);
+			val2 = FAT2CPU16(((__u16*)fatbuf)[off16+1]);
 			val2 &= 0x00ff;
 			ret = (val2 << 4) | (val1 >> 12);
 			break;
 		case 2:
-			val1 = FAT2CPU16(((__u16*)mydata->fatbuf)[off16]);
+			val1 = FAT2CPU16(((__u16*)fatbuf)[off16]);
 			val1 &= 0xff00;
-			val2 = FAT2CPU16(((__u16*)mydata->fatbuf)[off16+1]);
+			val2 = FAT2CPU16(((__u16*)fatbuf)[off16+1]);
 			val2 &= 0x000f;
 			ret = (val2 << 8) | (val1 >> 8);
 			break;
 		case 3:
-			ret = FAT2CPU16(((__u16*)mydata->fatbuf)[off16]);;
+			ret = FAT2CPU16(((__u16*)fatbuf)[off16]);;
 			ret = (ret & 0xfff0) >> 4;
 			break;
 		default:
@@ -309,6 +417,8 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 		FAT_DPRINT("Error reading data\n");
 		return -1;
 	}
+	fat_stats.data_reads++;
+	fat_stats.data_sects += size/FS_BLOCK_SIZE;
 	if(size % FS_BLOCK_SIZE) {
 		__u8 tmpbuf[FS_BLOCK_SIZE];
 		idx= size/FS_BLOCK_SIZE;
@@ -316,6 +426,8 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 			FAT_DPRINT("Error reading data\n");
 			return -1;
 		}
+		fat_stats.data_reads++;
+		fat_stats.data_sects++;
 		buffer += idx*FS_BLOCK_SIZE;
 
 		memcpy(buffer, tmpbuf, size % FS_BLOCK_SIZE);
@@ -326,9 +438,29 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 }
 
 
+/*
+ * Whether 'clust', taken from a FAT chain, can't be a cluster of a file:
+ * free, reserved, bad or the end of the chain.
+ */
+static int
+bad_clust(fsdata *mydata, __u32 clust)
+{
+	switch (mydata->fatsize) {
+	case 12:
+		return clust <= 0x0001 || clust >= 0xff7;
+	case 16:
+		return clust <= 0x0001 || clust >= 0xfff7;
+	default:
+		return clust <= 0x0001 || clust >= 0x0ffffff7;
+	}
+}
+
+
 /*
  * Read at most 'maxsize' bytes from the file associated with 'dentptr'
- * into 'buffer'.
+ * into 'buffer'.  The cluster chain is followed for up to FAT_RUNS runs
+ * of consecutive clusters before any of them is read, so the FAT reads
+ * don't take turns with the data, and each run is read in one go.
  * Return the number of bytes read or -1 on fatal errors.
  */
 static long
@@ -338,8 +470,12 @@ get_contents(fsdata *mydata, dir_entry *dentptr, __u8 *buffer,
 	unsigned long filesize = FAT2CPU32(dentptr->size), gotsize = 0;
 	unsigned int bytesperclust = mydata->clust_size * SECTOR_SIZE;
 	__u32 curclust = START(dentptr);
-	__u32 endclust, newclust;
+	struct {
+		__u32 start, count;
+	} runs[FAT_RUNS];
+	unsigned long mapped = 0;	/* Bytes of the file in runs so far */
 	unsigned long actsize;
+	int nruns, i, bad = 0;
 
 	FAT_DPRINT("Filesize: %ld bytes\n", filesize);
 
@@ -347,57 +483,51 @@ get_contents(fsdata *mydata, dir_entry *dentptr, __u8 *buffer,
 
 	FAT_DPRINT("Reading: %ld bytes\n", filesize);
 
-	actsize=bytesperclust;
-	endclust=curclust;
-	do {
-		/* search for consecutive clusters */
-		while(actsize < filesize) {
-			newclust = get_fatent(mydata, endclust);
-			if((newclust -1)!=endclust)
-				goto getit;
-			if (newclust <= 0x0001 || newclust >= 0xfffffff0) {	// XXX:
-				FAT_DPRINT("curclust: 0x%x\n", newclust);
-				FAT_DPRINT("Invalid FAT entry\n");
-				return gotsize;
+	while (gotsize < filesize) {
+		/* gather the next runs of the chain */
+		nruns = 0;
+		while (mapped < filesize) {
+			if (bad_clust(mydata, curclust)) {
+				FAT_DPRINT("curclust: 0x%x\n", curclust);
+				bad = 1;
+				break;
 			}
-			endclust=newclust;
-			actsize+= bytesperclust;
-		}
-		/* actsize >= file size */
-		actsize -= bytesperclust;
-		/* get remaining clusters */
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			FAT_ERROR("Error reading cluster\n");
-			return -1;
-		}
-		/* get remaining bytes */
-		gotsize += (int)actsize;
-		filesize -= actsize;
-		buffer += actsize;
-		actsize= filesize;
-		if (get_cluster(mydata, endclust, buffer, (int)actsize) != 0) {
-			FAT_ERROR("Error reading cluster\n");
-			return -1;
+			if (nruns && runs[nruns - 1].start +
+				     runs[nruns - 1].count == curclust) {
+				runs[nruns - 1].count++;
+			} else if (nruns < FAT_RUNS) {
+				runs[nruns].start = curclust;
+				runs[nruns].count = 1;
+				nruns++;
+			} else {
+				break;
+			}
+			mapped += bytesperclust;
+			if (mapped < filesize)
+				curclust = get_fatent(mydata, curclust);
 		}
-		gotsize+=actsize;
-		return gotsize;
-getit:
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			FAT_ERROR("Error reading cluster\n");
-			return -1;
+
+		/* and read them, each with one request */
+		for (i = 0; i < nruns; i++) {
+			actsize = runs[i].count * bytesperclust;
+			if (actsize > filesize - gotsize)
+				actsize = filesize - gotsize;
+			if (get_cluster(mydata, runs[i].start, buffer,
+					actsize) != 0) {
+				FAT_ERROR("Error reading cluster\n");
+				return -1;
+			}
+			gotsize += actsize;
+			buffer += actsize;
 		}
-		gotsize += (int)actsize;
-		filesize -= actsize;
-		buffer += actsize;
-		curclust = get_fatent(mydata, endclust);
-		if (curclust <= 0x0001 || curclust >= 0xfffffff0) {		// XXX:
-			FAT_DPRINT("curclust: 0x%x\n", curclust);
+
+		if (bad) {
 			FAT_ERROR("Invalid FAT entry\n");
 			return gotsize;
 		}
-		actsize=bytesperclust;
-		endclust=curclust;
-	} while (1);
+	}
+
+	return gotsize;
 }
 
 
@@ -743,9 +873,14 @@ __u8* do_fat_read_block;
 #else
 __u8 do_fat_read_block[MAX_CLUSTSIZE];  /* Block buffer */
 #endif
-long
-do_fat_read (const char *filename, void *buffer, unsigned long maxsize,
-	     int dols)
+/*
+ * Look up 'filename' and read it into 'buffer', or list it.  With a
+ * 'dentp' the file is not read, its directory entry is copied there and
+ * its size returned.
+ */
+static long
+do_fat_read1 (fsdata *mydata, const char *filename, void *buffer,
+	      unsigned long maxsize, int dols, dir_entry *dentp)
 {
 #if CONFIG_NIOS /* NIOS CPU cannot access big automatic arrays */
     static
@@ -753,9 +888,8 @@ do_fat_read (const char *filename, void *buffer, unsigned long maxsize,
     char fnamecopy[2048];
     boot_sector bs;
     volume_info volinfo;
-    fsdata datablock;
-    fsdata *mydata = &datablock;
     dir_entry *dentptr;
+    dir_entry dent;	/* Outlives the loop below, get_contents() reads it */
     __u16 prevcksum = 0xffff;
     char *subname = "";
     int rootdir_size, cursect;
@@ -787,7 +921,7 @@ do_fat_read (const char *filename, void *buffer, unsigned long maxsize,
 	mydata->data_begin = mydata->rootdir_sect + rootdir_size
 		- (mydata->clust_size * 2);
     }
-    mydata->fatbufnum = -1;
+    fat_cache_init (mydata);
 
     FAT_DPRINT ("FAT%d, fatlength: %d\n", mydata->fatsize,
 		mydata->fatlength);
@@ -833,6 +967,8 @@ do_fat_read (const char *filename, void *buffer, unsigned long maxsize,
 	    FAT_DPRINT ("Error: reading rootdir block\n");
 	    return -1;
 	}
+	fat_stats.data_reads++;
+	fat_stats.data_sects += mydata->clust_size;
 	dentptr = (dir_entry *) do_fat_read_block;
 	for (i = 0; i < DIRENTSPERBLOCK; i++) {
 	    char s_name[14], l_name[256];
@@ -949,7 +1085,6 @@ do_fat_read (const char *filename, void *buffer, unsigned long maxsize,
     while (isdir) {
 	int startsect = mydata->data_begin
 		+ START (dentptr) * mydata->clust_size;
-	dir_entry dent;
 	char *nextname = NULL;
 
 	dent = *dentptr;
@@ -985,6 +1120,12 @@ do_fat_read (const char *filename, void *buffer, unsigned long maxsize,
 	    subname = nextname;
 	}
     }
+    if (dentp) {
+	if (dentptr->attr & ATTR_DIR)
+	    return -1;
+	*dentp = *dentptr;
+	return FAT2CPU32 (dentptr->size);
+    }
     ret = get_contents (mydata, dentptr, buffer, maxsize);
     FAT_DPRINT ("Size: %d, got: %ld\n", FAT2CPU32 (dentptr->size), ret);
 
@@ -992,6 +1133,21 @@ do_fat_read (const char *filename, void *buffer, unsigned long maxsize,
 }
 
 
+long
+do_fat_read (const char *filename, void *buffer, unsigned long maxsize,
+	     int dols)
+{
+    fsdata datablock;
+    long ret;
+
+    datablock.fatcache = NULL;
+    ret = do_fat_read1 (&datablock, filename, buffer, maxsize, dols, NULL);
+    fat_cache_free (&datablock);
+
+    return ret;
+}
+
+
 int
 file_fat_detectfs(void)
 {
@@ -1051,16 +1207,103 @@ file_fat_ls(const char *dir)
 long
 file_fat_read(const char *filename, void *buffer, unsigned long maxsize)
 {
+	long rtn;
+
+	memset(&fat_stats, 0, sizeof(fat_stats));
 #ifdef	CONFIG_HHTECH_MINIPMP
-	int rtn = 0;
 	printf("reading %s ...",filename);
 	rtn = do_fat_read(filename, buffer, maxsize, LS_NO);
 	free_complain_memory();
-	return rtn;
 #else
 	printf("reading %s\n",filename);
-	return do_fat_read(filename, buffer, maxsize, LS_NO);
+	rtn = do_fat_read(filename, buffer, maxsize, LS_NO);
 #endif
+	return rtn;
+}
+
+
+/* What the last file_fat_read() took from the device */
+void
+file_fat_print_stats(void)
+{
+	printf("%d FAT reads (%d sectors), %d data reads (%d sectors)\n",
+	       fat_stats.fat_reads, fat_stats.fat_sects,
+	       fat_stats.data_reads, fat_stats.data_sects);
+}
+
+
+/*
+ * Look up 'filename' for a caller that reads the data itself, a run
+ * of sectors at a time from file_fat_extent().  Return the file size
+ * or -1.  file_fat_close() frees what the lookup keeps.
+ */
+long
+file_fat_open(const char *filename, fat_file_t *f)
+{
+	fsdata *mydata = &f->data;
+	dir_entry dent;
+	long ret;
+
+	memset(&fat_stats, 0, sizeof(fat_stats));
+	mydata->fatcache = NULL;
+	ret = do_fat_read1(mydata, filename, NULL, 0, LS_NO, &dent);
+#ifdef	CONFIG_HHTECH_MINIPMP
+	free_complain_memory();
+#endif
+	if (ret < 0) {
+		fat_cache_free(mydata);
+		return -1;
+	}
+	f->curclust = START(&dent);
+	f->left = ret;
+	return ret;
+}
+
+
+/*
+ * Set '*sect' to the device sector where the next part of the file is
+ * and return how many sectors of it follow there, at most 'maxsects'
+ * (which must hold a cluster).  Return 0 at the end of the file and -1
+ * for a broken cluster chain.  The last sector may be partly past the
+ * end of the file.
+ */
+long
+file_fat_extent(fat_file_t *f, unsigned long *sect, unsigned long maxsects)
+{
+	fsdata *mydata = &f->data;
+	unsigned long bytesperclust = mydata->clust_size * SECTOR_SIZE;
+	unsigned long bytes = 0;
+	__u32 first = f->curclust;
+
+	if (f->left == 0)
+		return 0;
+	if (bad_clust(mydata, first)) {
+		FAT_ERROR("Invalid FAT entry\n");
+		return -1;
+	}
+	*sect = part_offset + mydata->data_begin + first * mydata->clust_size;
+
+	for (;;) {
+		if (f->left <= bytesperclust) {
+			bytes += f->left;
+			f->left = 0;
+			break;
+		}
+		bytes += bytesperclust;
+		f->left -= bytesperclust;
+		f->curclust = get_fatent(mydata, f->curclust);
+		if (f->curclust != first + bytes / bytesperclust ||
+		    bytes + bytesperclust > maxsects * SECTOR_SIZE)
+			break;
+	}
+	return (bytes + SECTOR_SIZE - 1) / SECTOR_SIZE;
+}
+
+
+void
+file_fat_close(fat_file_t *f)
+{
+	fat_cache_free(&f->data);
 }
 
 #endif /* #if (CONFIG_COMMANDS & CFG_CMD_FAT) */
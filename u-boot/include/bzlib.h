@@ -171,6 +171,16 @@ BZ_EXTERN int BZ_API(BZ2_bzDecompressEnd) (
       bz_stream *strm
    );
 
+/*-- U-Boot: memory of the caller's for the fast decoder's tt, which
+     needs 4 bytes for each byte of the block size (3600000 for -9).
+     Call it before the first BZ2_bzDecompress; with enough room there
+     the fast decoder runs even if small was asked for. --*/
+BZ_EXTERN int BZ_API(BZ2_bzDecompressWorkspace) (
+      bz_stream    *strm,
+      void         *buf,
+      unsigned int size
+   );
+
 
 /*-- High(er) level library functions --*/
 
@@ -574,6 +574,10 @@ int	vsprintf(char *buf, const char *fmt, va_list args);
 ulong crc32 (ulong, const unsigned char *, uint);
 ulong crc32_no_comp (ulong, const unsigned char *, uint);
 
+/* lib_generic/unlzo.c, lib_generic/unlz4.c */
+int lzop_decompress(void *dst, ulong dstlen, const uchar *src, ulong *lenp);
+int lz4_decompress(void *dst, ulong dstlen, const uchar *src, ulong *lenp);
+
 /* common/console.c */
 int	console_init_f(void);	/* Before relocation; uses the serial  stuff	*/
 int	console_init_r(void);	/* After  relocation; uses the console stuff	*/
@@ -60,6 +60,11 @@
 #define CONFIG_ZIMAGE_BOOT
 #define CONFIG_IMAGE_BOOT
 
+#define CONFIG_LZO		/* lzo and lz4 compressed uImages */
+#define CONFIG_LZ4
+
+#define CONFIG_BOOTDEV		/* boot straight from SD, see README */
+
 #define BOARD_LATE_INIT
 
 #define CONFIG_SETUP_MEMORY_TAGS
@@ -129,6 +134,7 @@
 
 #define CONFIG_DOS_PARTITION
 #define CONFIG_SUPPORT_VFAT
+#define CFG_FAT_CACHE_SIZE	(256*1024)	/* all of any FAT16 FAT */
 
 #undef CONFIG_USB_OHCI
 #undef CONFIG_USB_STORAGE
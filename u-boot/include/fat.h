@@ -49,6 +49,19 @@
 #define FAT16BUFSIZE	(FATBUFSIZE/2)
 #define FAT32BUFSIZE	(FATBUFSIZE/4)
 
+/*
+ * Bytes of malloc for caching the FAT while a file is read: the whole
+ * FAT if it fits, else that many FATBUFSIZE windows, least recently used
+ * going first.
+ */
+#ifndef CFG_FAT_CACHE_SIZE
+#define CFG_FAT_CACHE_SIZE	(8*FATBUFSIZE)
+#endif
+#define FAT_READAHEAD	8	/* Windows read at once into a whole FAT */
+
+/* Cluster runs get_contents() gathers from the FAT before reading them */
+#define FAT_RUNS	64
+
 
 /* Filesystem identifiers */
 #define FAT12_SIGN	"FAT12   "
@@ -175,13 +188,19 @@ typedef struct dir_slot {
 	__u8    name11_12[4];	/* Last 2 characters in name */
 } dir_slot;
 
+/* A FATBUFSIZE window of the FAT cache */
+typedef struct {
+	int	bufnum;		/* Which window of the FAT, -1 if none */
+	__u32	used;		/* When it was last used, for the LRU */
+} fatwindow;
+
 /* Private filesystem parameters
  *
  * Note: FAT buffer has to be 32 bit aligned
  * (see FAT32 accesses)
  */
 typedef struct {
-	__u8	fatbuf[FATBUFSIZE]; /* Current FAT buffer */
+	__u8	fatbuf[FATBUFSIZE]; /* Current FAT buffer, without a cache */
 	int	fatsize;	/* Size of FAT in bits */
 	__u16	fatlength;	/* Length of FAT in sectors */
 	__u16	fat_sect;	/* Starting sector of the FAT */
@@ -189,8 +208,20 @@ typedef struct {
 	__u16	clust_size;	/* Size of clusters in sectors */
 	short	data_begin;	/* The sector of the first cluster, can be negative */
 	int	fatbufnum;	/* Used by get_fatent, init to -1 */
+	__u8	*fatcache;	/* fatslots windows of FATBUFSIZE, or NULL */
+	fatwindow *fatwin;	/* What is in each of them */
+	int	fatslots;
+	int	fatwhole;	/* The whole FAT fits, window n is in slot n */
+	__u32	fatclock;	/* Ticks on every cache lookup */
 } fsdata;
 
+/* A file the caller reads itself, see file_fat_open() */
+typedef struct {
+	fsdata	data;
+	__u32	curclust;	/* Where file_fat_extent() goes on */
+	unsigned long left;	/* Bytes of the file from there */
+} fat_file_t;
+
 typedef int	(file_detectfs_func)(void);
 typedef int	(file_ls_func)(const char *dir);
 typedef long	(file_read_func)(const char *filename, void *buffer,
@@ -213,6 +244,10 @@ int file_cd(const char *path);
 int file_fat_detectfs(void);
 int file_fat_ls(const char *dir);
 long file_fat_read(const char *filename, void *buffer, unsigned long maxsize);
+void file_fat_print_stats(void);
+long file_fat_open(const char *filename, fat_file_t *f);
+long file_fat_extent(fat_file_t *f, unsigned long *sect, unsigned long maxsects);
+void file_fat_close(fat_file_t *f);
 const char *file_getfsname(int idx);
 int fat_register_device(block_dev_desc_t *dev_desc, int part_no);
 
@@ -0,0 +1,226 @@
+/*
+ * Word-wise memcpy/memmove/memset bodies shared by lib_generic/string.c
+ * and qi's src/utils.c (qi/include/memops.h is a link to this file).
+ *
+ * The head is done a byte at a time up to a word boundary of the
+ * destination, the middle a machine word at a time, eight to a loop
+ * where the source is aligned too (one ARM1176 cache line, which gcc
+ * turns into an ldm/stm pair), and the tail in bytes again.  A source
+ * that is misaligned against the destination is read as aligned words
+ * and shifted together on little-endian CPUs; elsewhere that case stays
+ * byte-wise.
+ *
+ * memops_copy_match() is the match copy of the LZ77 decoders (inflate in
+ * lib_generic/zlib.c, LZO and LZ4 in unlzo.h and unlz4.h), where the
+ * source may overlap the destination from below.
+ *
+ * Per CPU:
+ *   MEMOPS_PREFETCH	bytes ahead of the source to preload in the
+ *			eight-word loops (pld on ARMv5TE and later), or 0
+ *   MEMOPS_LE		1 when shifting words together is known to work
+ * Either can be overridden with a -D in the CPU's config.mk.
+ * tools/membench checks these against byte loops and times them.
+ */
+#ifndef _MEMOPS_H
+#define _MEMOPS_H
+
+#ifndef MEMOPS_PREFETCH
+#if defined(__ARM_ARCH_5TE__) || defined(__ARM_ARCH_5TEJ__) || \
+    defined(__ARM_ARCH_6__) || defined(__ARM_ARCH_6J__) || \
+    defined(__ARM_ARCH_6K__) || defined(__ARM_ARCH_6Z__) || \
+    defined(__ARM_ARCH_6ZK__) || defined(__ARM_ARCH_6KZ__) || \
+    defined(__ARM_ARCH_7A__)
+#define MEMOPS_PREFETCH	64	/* two lines ahead */
+#elif defined(__i386__) || defined(__x86_64__)
+#define MEMOPS_PREFETCH	256
+#else
+#define MEMOPS_PREFETCH	0
+#endif
+#endif
+
+#ifndef MEMOPS_LE
+#if defined(__ARMEL__) || defined(__i386__) || defined(__x86_64__)
+#define MEMOPS_LE	1
+#else
+#define MEMOPS_LE	0
+#endif
+#endif
+
+#if MEMOPS_PREFETCH
+#define MEMOPS_PLD(p)	__builtin_prefetch((const char *)(p) + MEMOPS_PREFETCH)
+#else
+#define MEMOPS_PLD(p)	do { } while (0)
+#endif
+
+typedef unsigned long __attribute__((__may_alias__)) memops_word;
+
+#define MEMOPS_W		sizeof(memops_word)
+#define MEMOPS_OFF(p)		((unsigned long)(p) & (MEMOPS_W - 1))
+
+static inline void *memops_copy(void *dest, const void *src, size_t n)
+{
+	unsigned char *d = dest;
+	const unsigned char *s = src;
+
+	while (n && MEMOPS_OFF(d)) {
+		*d++ = *s++;
+		n--;
+	}
+
+	if (!MEMOPS_OFF(s)) {
+		memops_word *dw = (memops_word *)d;
+		const memops_word *sw = (const memops_word *)s;
+		memops_word a, b, c, e, f, g, h, i;
+
+		while (n >= 8 * MEMOPS_W) {
+			MEMOPS_PLD(sw);
+			a = sw[0]; b = sw[1]; c = sw[2]; e = sw[3];
+			f = sw[4]; g = sw[5]; h = sw[6]; i = sw[7];
+			dw[0] = a; dw[1] = b; dw[2] = c; dw[3] = e;
+			dw[4] = f; dw[5] = g; dw[6] = h; dw[7] = i;
+			dw += 8;
+			sw += 8;
+			n -= 8 * MEMOPS_W;
+		}
+		while (n >= MEMOPS_W) {
+			*dw++ = *sw++;
+			n -= MEMOPS_W;
+		}
+		d = (unsigned char *)dw;
+		s = (const unsigned char *)sw;
+	} else if (MEMOPS_LE && n >= 2 * MEMOPS_W) {
+		/*
+		 * Each destination word is the top of one aligned source word
+		 * and the bottom of the next.  The aligned reads stay within
+		 * words holding source bytes, so they never touch another page.
+		 */
+		memops_word *dw = (memops_word *)d;
+		const memops_word *sw = (const memops_word *)(s - MEMOPS_OFF(s));
+		unsigned int rs = MEMOPS_OFF(s) * 8, ls = MEMOPS_W * 8 - rs;
+		size_t words = n / MEMOPS_W;
+		memops_word lo = *sw++, hi;
+
+		n -= words * MEMOPS_W;
+		s += words * MEMOPS_W;
+		d += words * MEMOPS_W;
+		while (words--) {
+			hi = *sw++;
+			*dw++ = lo >> rs | hi << ls;
+			lo = hi;
+		}
+	}
+
+	while (n--)
+		*d++ = *s++;
+
+	return dest;
+}
+
+/* for dest above an overlapping src: the same, from the top down */
+static inline void *memops_copy_down(void *dest, const void *src, size_t n)
+{
+	unsigned char *d = (unsigned char *)dest + n;
+	const unsigned char *s = (const unsigned char *)src + n;
+
+	if (MEMOPS_OFF(d) == MEMOPS_OFF(s)) {
+		while (n && MEMOPS_OFF(d)) {
+			*--d = *--s;
+			n--;
+		}
+		while (n >= MEMOPS_W) {
+			d -= MEMOPS_W;
+			s -= MEMOPS_W;
+			*(memops_word *)d = *(const memops_word *)s;
+			n -= MEMOPS_W;
+		}
+	}
+
+	while (n--)
+		*--d = *--s;
+
+	return dest;
+}
+
+static inline void *memops_fill(void *s, int c, size_t n)
+{
+	unsigned char *p = s;
+	memops_word w;
+
+	while (n && MEMOPS_OFF(p)) {
+		*p++ = c;
+		n--;
+	}
+
+	if (n >= MEMOPS_W) {
+		memops_word *pw = (memops_word *)p;
+
+		w = (unsigned char)c;
+		w |= w << 8;
+		w |= w << 16;
+		if (MEMOPS_W > 4)
+			w |= (w << 16) << 16;
+
+		while (n >= 8 * MEMOPS_W) {
+			pw[0] = w; pw[1] = w; pw[2] = w; pw[3] = w;
+			pw[4] = w; pw[5] = w; pw[6] = w; pw[7] = w;
+			pw += 8;
+			n -= 8 * MEMOPS_W;
+		}
+		while (n >= MEMOPS_W) {
+			*pw++ = w;
+			n -= MEMOPS_W;
+		}
+		p = (unsigned char *)pw;
+	}
+
+	while (n--)
+		*p++ = c;
+
+	return s;
+}
+
+/*
+ * Copy len bytes from from up to out and return the end, as a byte loop
+ * would: a source less than len back repeats itself.  Short copies are
+ * the common case and stay bytes.  A long overlapping one is copied a
+ * period at a time and then all of what is out again, which doubles
+ * each time and never overlaps.
+ */
+static inline unsigned char *memops_copy_match(unsigned char *out,
+					       const unsigned char *from,
+					       size_t len)
+{
+	size_t chunk = out - from;
+
+	if (len < 16 || chunk < 4) {
+		if (chunk == 1 && len >= 16) {
+			memops_fill(out, *from, len);
+			return out + len;
+		}
+		while (len > 2) {
+			out[0] = from[0];
+			out[1] = from[1];
+			out[2] = from[2];
+			out += 3;
+			from += 3;
+			len -= 3;
+		}
+		if (len) {
+			*out++ = *from++;
+			if (len > 1)
+				*out++ = *from++;
+		}
+		return out;
+	}
+
+	while (len > chunk) {
+		memops_copy(out, from, chunk);
+		out += chunk;
+		len -= chunk;
+		chunk = out - from;
+	}
+	memops_copy(out, from, len);
+	return out + len;
+}
+
+#endif /* _MEMOPS_H */
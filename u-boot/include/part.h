@@ -44,6 +44,13 @@ typedef struct block_dev_desc {
 				      unsigned long start,
 				      lbaint_t blkcnt,
 				      unsigned long *buffer);
+	/* optional: start a read and come back for it, so the CPU can
+	 * work on the previous one meanwhile (bootdev) */
+	int		(*block_read_start)(int dev,
+					    unsigned long start,
+					    lbaint_t blkcnt,
+					    unsigned long *buffer);
+	int		(*block_read_wait)(int dev);
 }block_dev_desc_t;
 
 /* Interface types: */
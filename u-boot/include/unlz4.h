@@ -0,0 +1,220 @@
+/*
+ * LZ4 decompression shared by lib_generic/unlz4.c (bootm) and qi's
+ * phase2.c (qi/include/unlz4.h is a link to this file).
+ *
+ * An LZ4 block is a run of sequences: a token with four bits of literal
+ * length and four of match length, the literals, and a two byte offset
+ * back into the output; the last sequence has literals only.  There is
+ * no entropy coding, so decoding is copies, which memops_copy() and
+ * memops_copy_match() do a word at a time.
+ *
+ * unlz4() takes what the lz4 tool writes, for mkimage -C lz4: frames of
+ * the current format ("lz4 Image"), with independent or linked blocks,
+ * or of the legacy one ("lz4 -l Image", what the Linux kernel build
+ * makes).  Skippable frames are skipped and so are the xxHash checks,
+ * the uImage data CRC covers the whole of it.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ */
+#ifndef _UNLZ4_H
+#define _UNLZ4_H
+
+#include <memops.h>
+
+#define LZ4_MAGIC		0x184d2204
+#define LZ4_LEGACY_MAGIC	0x184c2102
+#define LZ4_SKIP_MAGIC(m)	(((m) & 0xfffffff0) == 0x184d2a50)
+
+#define LZ4_FLG_VERSION		0xc0	/* must be 01 */
+#define LZ4_FLG_B_INDEP		0x20
+#define LZ4_FLG_B_CHECKSUM	0x10
+#define LZ4_FLG_C_SIZE		0x08
+#define LZ4_FLG_C_CHECKSUM	0x04
+#define LZ4_FLG_DICT_ID		0x01
+
+#define LZ4_BLOCK_RAW		0x80000000	/* stored, in a block size */
+
+/*
+ * Decompress the block in[0..in_len-1] to out, which has room for
+ * out_len bytes.  Matches may reach back as far as hist.  Returns the
+ * decompressed length or -1, without reading or writing outside the
+ * buffers whatever the input.
+ */
+static inline int unlz4_block(const unsigned char *in, size_t in_len,
+			      unsigned char *out, size_t out_len,
+			      const unsigned char *hist)
+{
+	const unsigned char *ip = in;
+	const unsigned char *const ip_end = in + in_len;
+	unsigned char *op = out;
+	unsigned char *const op_end = out + out_len;
+	unsigned int token, s;
+	size_t len, off;
+
+	for (;;) {
+		if (ip >= ip_end)
+			return -1;
+		token = *ip++;
+
+		len = token >> 4;
+		if (len == 15) {
+			do {
+				if (ip >= ip_end)
+					return -1;
+				s = *ip++;
+				len += s;
+			} while (s == 255);
+		}
+		if (len > (size_t)(ip_end - ip) || len > (size_t)(op_end - op))
+			return -1;
+		memops_copy(op, ip, len);
+		op += len;
+		ip += len;
+		if (ip == ip_end)
+			break;			/* the last literals */
+
+		if (ip_end - ip < 2)
+			return -1;
+		off = ip[0] | ip[1] << 8;
+		ip += 2;
+		if (off == 0 || off > (size_t)(op - hist))
+			return -1;
+
+		len = token & 15;
+		if (len == 15) {
+			do {
+				if (ip >= ip_end)
+					return -1;
+				s = *ip++;
+				len += s;
+			} while (s == 255);
+		}
+		len += 4;
+		if (len > (size_t)(op_end - op))
+			return -1;
+		op = memops_copy_match(op, op - off, len);
+	}
+
+	return op - out;
+}
+
+static inline unsigned int lz4_le32(const unsigned char *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+}
+
+/*
+ * Decompress the lz4 file src[0..src_len-1] to dst, which has room for
+ * *dst_len bytes; *dst_len is set to the decompressed size.  Returns 0
+ * or -1 for bad or truncated data, or data that does not fit.
+ */
+static inline int unlz4(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len)
+{
+	const unsigned char *p = src;
+	const unsigned char *const end = src + src_len;
+	unsigned char *op = dst;
+	unsigned char *const op_end = dst + *dst_len;
+	unsigned int magic, flg, size;
+	size_t skip;
+	int n;
+
+	if (src_len < 4)
+		return -1;
+
+	while (end - p >= 4) {
+		magic = lz4_le32(p);
+		p += 4;
+
+		if (magic == LZ4_LEGACY_MAGIC) {
+			/* compressed sizes and blocks of 8MB or less */
+			while (end - p >= 4) {
+				size = lz4_le32(p);
+				if (size == LZ4_MAGIC || size == LZ4_LEGACY_MAGIC ||
+				    LZ4_SKIP_MAGIC(size))
+					break;		/* another frame */
+				p += 4;
+				if (p == end)
+					break;	/* the size the kernel appends */
+				if (size > (size_t)(end - p))
+					return -1;
+				n = unlz4_block(p, size, op, op_end - op, op);
+				if (n < 0)
+					return -1;
+				p += size;
+				op += n;
+			}
+			continue;
+		}
+
+		if (LZ4_SKIP_MAGIC(magic)) {
+			if (end - p < 4)
+				return -1;
+			size = lz4_le32(p);
+			p += 4;
+			if (size > (size_t)(end - p))
+				return -1;
+			p += size;
+			continue;
+		}
+
+		if (magic != LZ4_MAGIC || end - p < 3)
+			return -1;
+		flg = p[0];
+		if ((flg & LZ4_FLG_VERSION) != 0x40 || (flg & LZ4_FLG_DICT_ID))
+			return -1;
+		skip = 3;			/* FLG, BD, header checksum */
+		if (flg & LZ4_FLG_C_SIZE)
+			skip += 8;
+		if ((size_t)(end - p) < skip)
+			return -1;
+		p += skip;
+
+		for (;;) {
+			if (end - p < 4)
+				return -1;
+			size = lz4_le32(p);
+			p += 4;
+			if (size == 0)
+				break;			/* end mark */
+
+			if ((size & ~LZ4_BLOCK_RAW) > (size_t)(end - p))
+				return -1;
+			if (size & LZ4_BLOCK_RAW) {
+				size &= ~LZ4_BLOCK_RAW;
+				if (size > (size_t)(op_end - op))
+					return -1;
+				memops_copy(op, p, size);
+				n = size;
+			} else {
+				n = unlz4_block(p, size, op, op_end - op,
+						flg & LZ4_FLG_B_INDEP ? op : dst);
+				if (n < 0)
+					return -1;
+			}
+			p += size;
+			op += n;
+
+			if (flg & LZ4_FLG_B_CHECKSUM) {
+				if (end - p < 4)
+					return -1;
+				p += 4;
+			}
+		}
+		if (flg & LZ4_FLG_C_CHECKSUM) {
+			if (end - p < 4)
+				return -1;
+			p += 4;
+		}
+	}
+	if (p != end)
+		return -1;
+
+	*dst_len = op - dst;
+	return 0;
+}
+
+#endif /* _UNLZ4_H */
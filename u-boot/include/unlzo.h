@@ -0,0 +1,328 @@
+/*
+ * LZO1X and lzop decompression shared by lib_generic/unlzo.c (bootm and
+ * jffs2) and qi's phase2.c (qi/include/unlzo.h is a link to this file).
+ *
+ * unlzo_block() is the LZO1X decompressor jffs2 carried in
+ * fs/jffs2/compr_lzo.c, from minilzo by Markus F.X.J. Oberhumer, with
+ * its input reads bounded too and the byte (or aligned-only word) copy
+ * loops replaced by memops_copy() and memops_copy_match().  It works
+ * for anything the LZO1X-1 and LZO1X-999 compressors made.
+ *
+ * unlzop() takes the file format of the lzop tool, which is what
+ * "lzop vmlinux.bin" leaves for mkimage -C lzo: a header, then blocks
+ * of at most 256KB each compressed on its own.  The checksums lzop
+ * keeps are skipped, the uImage data CRC covers the whole of it.
+ *
+ * Copyright (C) 1996-2002 Markus Franz Xaver Johannes Oberhumer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ */
+#ifndef _UNLZO_H
+#define _UNLZO_H
+
+#include <memops.h>
+
+#define LZO_E_OK			0
+#define LZO_E_ERROR			(-1)
+#define LZO_E_INPUT_OVERRUN		(-4)
+#define LZO_E_OUTPUT_OVERRUN		(-5)
+#define LZO_E_LOOKBEHIND_OVERRUN	(-6)
+#define LZO_E_EOF_NOT_FOUND		(-7)
+#define LZO_E_INPUT_NOT_CONSUMED	(-8)
+
+#define LZO_M2_MAX_OFFSET	0x0800
+
+#define LZO_NEED_IP(x) \
+	if ((size_t)(ip_end - ip) < (size_t)(x)) goto input_overrun
+#define LZO_NEED_OP(x) \
+	if ((size_t)(op_end - op) < (size_t)(x)) goto output_overrun
+#define LZO_TEST_LOOKBEHIND(m_pos) \
+	if (m_pos < out) goto lookbehind_overrun
+
+/*
+ * Decompress the LZO1X data in[0..in_len-1] to out, which has room for
+ * *out_len bytes; *out_len is set to what was written.  Returns LZO_E_OK
+ * or one of the LZO_E errors, without reading or writing outside the
+ * buffers whatever the input.
+ */
+static inline int unlzo_block(const unsigned char *in, size_t in_len,
+			      unsigned char *out, size_t *out_len)
+{
+	const unsigned char *ip = in;
+	const unsigned char *const ip_end = in + in_len;
+	unsigned char *op = out;
+	unsigned char *const op_end = out + *out_len;
+	const unsigned char *m_pos;
+	size_t t;
+
+	*out_len = 0;
+
+	LZO_NEED_IP(1);
+	if (*ip > 17) {
+		t = *ip++ - 17;
+		if (t < 4)
+			goto match_next;
+		LZO_NEED_OP(t);
+		LZO_NEED_IP(t + 1);
+		memops_copy(op, ip, t);
+		op += t;
+		ip += t;
+		goto first_literal_run;
+	}
+
+	while (ip < ip_end) {
+		/* a literal run */
+		t = *ip++;
+		if (t >= 16)
+			goto match;
+		if (t == 0) {
+			LZO_NEED_IP(1);
+			while (*ip == 0) {
+				t += 255;
+				ip++;
+				LZO_NEED_IP(1);
+			}
+			t += 15 + *ip++;
+		}
+		LZO_NEED_OP(t + 3);
+		LZO_NEED_IP(t + 4);
+		memops_copy(op, ip, t + 3);
+		op += t + 3;
+		ip += t + 3;
+
+first_literal_run:
+		t = *ip++;
+		if (t >= 16)
+			goto match;
+
+		/* a three byte match straight after a literal run */
+		LZO_NEED_IP(1);
+		m_pos = op - (1 + LZO_M2_MAX_OFFSET);
+		m_pos -= t >> 2;
+		m_pos -= *ip++ << 2;
+		LZO_TEST_LOOKBEHIND(m_pos);
+		LZO_NEED_OP(3);
+		*op++ = *m_pos++;
+		*op++ = *m_pos++;
+		*op++ = *m_pos;
+		goto match_done;
+
+		do {
+match:
+			if (t >= 64) {
+				/* M2: 3..8 bytes up to 2KB back */
+				LZO_NEED_IP(1);
+				m_pos = op - 1;
+				m_pos -= (t >> 2) & 7;
+				m_pos -= *ip++ << 3;
+				t = (t >> 5) - 1;
+				LZO_TEST_LOOKBEHIND(m_pos);
+				LZO_NEED_OP(t + 2);
+				goto copy_match;
+			} else if (t >= 32) {
+				/* M3: up to 16KB back */
+				t &= 31;
+				if (t == 0) {
+					LZO_NEED_IP(1);
+					while (*ip == 0) {
+						t += 255;
+						ip++;
+						LZO_NEED_IP(1);
+					}
+					t += 31 + *ip++;
+				}
+				LZO_NEED_IP(2);
+				m_pos = op - 1;
+				m_pos -= (ip[0] >> 2) + (ip[1] << 6);
+				ip += 2;
+			} else if (t >= 16) {
+				/* M4: up to 48KB back, or the end */
+				m_pos = op;
+				m_pos -= (t & 8) << 11;
+				t &= 7;
+				if (t == 0) {
+					LZO_NEED_IP(1);
+					while (*ip == 0) {
+						t += 255;
+						ip++;
+						LZO_NEED_IP(1);
+					}
+					t += 7 + *ip++;
+				}
+				LZO_NEED_IP(2);
+				m_pos -= (ip[0] >> 2) + (ip[1] << 6);
+				ip += 2;
+				if (m_pos == op)
+					goto eof_found;
+				m_pos -= 0x4000;
+			} else {
+				/* M1: two bytes up to 1KB back */
+				LZO_NEED_IP(1);
+				m_pos = op - 1;
+				m_pos -= t >> 2;
+				m_pos -= *ip++ << 2;
+				LZO_TEST_LOOKBEHIND(m_pos);
+				LZO_NEED_OP(2);
+				*op++ = *m_pos++;
+				*op++ = *m_pos;
+				goto match_done;
+			}
+			LZO_TEST_LOOKBEHIND(m_pos);
+			LZO_NEED_OP(t + 2);
+copy_match:
+			op = memops_copy_match(op, m_pos, t + 2);
+
+match_done:
+			/* up to three literals ride in the low bits */
+			t = ip[-2] & 3;
+			if (t == 0)
+				break;
+match_next:
+			LZO_NEED_OP(t);
+			LZO_NEED_IP(t + 1);
+			*op++ = *ip++;
+			if (t > 1) {
+				*op++ = *ip++;
+				if (t > 2)
+					*op++ = *ip++;
+			}
+			t = *ip++;
+		} while (ip < ip_end);
+	}
+	*out_len = op - out;
+	return LZO_E_EOF_NOT_FOUND;
+
+eof_found:
+	*out_len = op - out;
+	return ip == ip_end ? LZO_E_OK :
+	       ip < ip_end ? LZO_E_INPUT_NOT_CONSUMED : LZO_E_INPUT_OVERRUN;
+
+input_overrun:
+	*out_len = op - out;
+	return LZO_E_INPUT_OVERRUN;
+
+output_overrun:
+	*out_len = op - out;
+	return LZO_E_OUTPUT_OVERRUN;
+
+lookbehind_overrun:
+	*out_len = op - out;
+	return LZO_E_LOOKBEHIND_OVERRUN;
+}
+
+#define LZOP_F_ADLER32_D	0x00000001
+#define LZOP_F_ADLER32_C	0x00000002
+#define LZOP_F_H_EXTRA_FIELD	0x00000040
+#define LZOP_F_CRC32_D		0x00000100
+#define LZOP_F_CRC32_C		0x00000200
+#define LZOP_F_H_FILTER		0x00000800
+
+static const unsigned char lzop_magic[9] = {
+	0x89, 'L', 'Z', 'O', 0x00, '\r', '\n', 0x1a, '\n'
+};
+
+static inline unsigned int lzop_be32(const unsigned char *p)
+{
+	return (unsigned int)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+/*
+ * Decompress the lzop file src[0..src_len-1] to dst, which has room for
+ * *dst_len bytes; *dst_len is set to the decompressed size.  Returns
+ * LZO_E_OK or an LZO_E error.
+ */
+static inline int unlzop(const unsigned char *src, size_t src_len,
+			 unsigned char *dst, size_t *dst_len)
+{
+	const unsigned char *p = src;
+	const unsigned char *end = src + src_len;
+	unsigned int version, flags, i;
+	size_t out = 0, dlen, clen, len;
+	int r;
+
+	/* the shortest header there is, and the end marker */
+	if (src_len < 9 + 25 + 4)
+		return LZO_E_INPUT_OVERRUN;
+	for (i = 0; i < sizeof(lzop_magic); i++)
+		if (p[i] != lzop_magic[i])
+			return LZO_E_ERROR;
+	p += 9;
+
+	version = p[0] << 8 | p[1];
+	p += 4;				/* version, library version */
+	if (version >= 0x0940)
+		p += 2;			/* version needed to extract */
+	if (*p < 1 || *p > 3)		/* the LZO1X methods */
+		return LZO_E_ERROR;
+	p++;
+	if (version >= 0x0940)
+		p++;			/* level */
+	flags = lzop_be32(p);
+	p += 4;
+	if (flags & LZOP_F_H_FILTER)
+		return LZO_E_ERROR;
+	p += 8;				/* mode, mtime */
+	if (version >= 0x0940)
+		p += 4;			/* mtime high */
+	p += 1 + *p + 4;		/* name, header checksum */
+	if (p + 4 > end)
+		return LZO_E_INPUT_OVERRUN;
+	if (flags & LZOP_F_H_EXTRA_FIELD) {
+		len = lzop_be32(p);
+		if (len > (size_t)(end - p) - 12)
+			return LZO_E_INPUT_OVERRUN;
+		p += 4 + len + 4;
+	}
+
+	for (;;) {
+		if (end - p < 4)
+			return LZO_E_INPUT_OVERRUN;
+		dlen = lzop_be32(p);
+		p += 4;
+		if (dlen == 0)
+			break;
+
+		if (end - p < 4)
+			return LZO_E_INPUT_OVERRUN;
+		clen = lzop_be32(p);
+		p += 4;
+		i = 0;
+		if (flags & LZOP_F_ADLER32_D)
+			i += 4;
+		if (flags & LZOP_F_CRC32_D)
+			i += 4;
+		if (clen < dlen) {
+			if (flags & LZOP_F_ADLER32_C)
+				i += 4;
+			if (flags & LZOP_F_CRC32_C)
+				i += 4;
+		}
+		if ((size_t)(end - p) < i || clen > (size_t)(end - p) - i)
+			return LZO_E_INPUT_OVERRUN;
+		p += i;
+		if (clen > dlen || dlen > *dst_len - out)
+			return LZO_E_OUTPUT_OVERRUN;
+
+		if (clen == dlen) {
+			/* stored, it didn't compress */
+			memops_copy(dst + out, p, dlen);
+		} else {
+			len = dlen;
+			r = unlzo_block(p, clen, dst + out, &len);
+			if (r != LZO_E_OK)
+				return r;
+			if (len != dlen)
+				return LZO_E_ERROR;
+		}
+		p += clen;
+		out += dlen;
+	}
+
+	*dst_len = out;
+	return LZO_E_OK;
+}
+
+#endif /* _UNLZO_H */
@@ -102,7 +102,9 @@
 
    The memory requirements for inflate are (in bytes) 1 << windowBits
  that is, 32K for windowBits=15 (default value) plus a few kilobytes
- for small objects.
+ for small objects.  The window is only allocated once a stream is
+ continued in another inflate() call; a single Z_FINISH call into a
+ large enough buffer needs just the 7K or so of the state.
 */
 
 			/* Type declarations */
@@ -75,6 +75,51 @@ static struct tag *params;
 
 extern image_header_t header;	/* from cmd_bootm.c */
 
+#ifndef CFG_BOOTM_LEN
+#define CFG_BOOTM_LEN	0x800000	/* as in cmd_bootm.c */
+#endif
+
+#if defined(CONFIG_LZO) || defined(CONFIG_LZ4)
+/* what is left of room bytes at load once [start, start + len) is taken */
+static ulong ramdisk_clip (ulong room, ulong load, ulong start, ulong len)
+{
+	if (load >= start && load - start < len)
+		return 0;
+	if (start > load && start - load < room)
+		return start - load;
+	return room;
+}
+
+/*
+ * Room for a ramdisk unpacked to load: up to CFG_BOOTM_LEN within its
+ * SDRAM bank, stopping short of the kernel, the packed ramdisk at src,
+ * the boot parameters and the stack, with U-Boot above it.  0 if load
+ * is not in free SDRAM.
+ */
+static ulong ramdisk_room (bd_t *bd, ulong load, ulong kernel, ulong klen,
+			   ulong src, ulong srclen)
+{
+	ulong room = 0, sp;
+	int i;
+
+	for (i = 0; i < CONFIG_NR_DRAM_BANKS; ++i) {
+		if (load >= bd->bi_dram[i].start &&
+		    load - bd->bi_dram[i].start < bd->bi_dram[i].size)
+			room = bd->bi_dram[i].start + bd->bi_dram[i].size - load;
+	}
+	if (room > CFG_BOOTM_LEN)
+		room = CFG_BOOTM_LEN;
+
+	asm ("mov %0, sp" : "=r" (sp));
+	sp -= 2048;		/* just to be sure */
+
+	room = ramdisk_clip (room, load, kernel, klen);
+	room = ramdisk_clip (room, load, src, srclen);
+	room = ramdisk_clip (room, load, bd->bi_boot_params, 4096);
+	return ramdisk_clip (room, load, sp, 0 - sp);
+}
+#endif /* CONFIG_LZO || CONFIG_LZ4 */
+
 
 void do_bootm_linux (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[],
 		     ulong addr, ulong *len_ptr, int verify)
@@ -85,6 +130,12 @@ void do_bootm_linux (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[],
 	void (*theKernel)(int zero, int arch, uint params);
 	image_header_t *hdr = &header;
 	bd_t *bd = gd->bd;
+#if defined(CONFIG_LZO) || defined(CONFIG_LZ4)
+	/* where the kernel is; header is the ramdisk's further down */
+	ulong kernel = ntohl(hdr->ih_load);
+	ulong klen = hdr->ih_comp == IH_COMP_NONE ?
+		     ntohl(hdr->ih_size) : CFG_BOOTM_LEN;
+#endif
 
 #ifdef CONFIG_CMDLINE_TAG
 	char *commandline = getenv ("bootargs");
@@ -167,6 +218,46 @@ void do_bootm_linux (cmd_tbl_t *cmdtp, int flag, int argc, char *argv[],
 			do_reset (cmdtp, flag, argc, argv);
 		}
 
+#if defined(CONFIG_LZO) || defined(CONFIG_LZ4)
+		/*
+		 * The kernel unpacks gzip ramdisks itself, but may not
+		 * know LZO or LZ4: those are unpacked to the load address.
+		 */
+		if (hdr->ih_comp == IH_COMP_LZO ||
+		    hdr->ih_comp == IH_COMP_LZ4) {
+			ulong load = ntohl(hdr->ih_load);
+			ulong room = ramdisk_room (bd, load, kernel, klen,
+						   data, len);
+			int i = -1;
+
+			if (!room) {
+				printf ("Bad Ramdisk Load Address %08lx\n",
+					load);
+				SHOW_BOOT_PROGRESS (-13);
+				do_reset (cmdtp, flag, argc, argv);
+			}
+
+			printf ("   Uncompressing Ramdisk ... ");
+#ifdef CONFIG_LZO
+			if (hdr->ih_comp == IH_COMP_LZO)
+				i = lzop_decompress ((void *)load, room,
+						     (uchar *)data, &len);
+#endif
+#ifdef CONFIG_LZ4
+			if (hdr->ih_comp == IH_COMP_LZ4)
+				i = lz4_decompress ((void *)load, room,
+						    (uchar *)data, &len);
+#endif
+			if (i != 0) {
+				printf ("ERROR %d\n", i);
+				SHOW_BOOT_PROGRESS (-13);
+				do_reset (cmdtp, flag, argc, argv);
+			}
+			printf ("OK\n");
+			data = load;
+		}
+#endif /* CONFIG_LZO || CONFIG_LZ4 */
+
 #if defined(CONFIG_B2) || defined(CONFIG_EVB4510) || defined(CONFIG_ARMADILLO)
 		/*
 		 *we need to copy the ramdisk to SRAM to let Linux boot
@@ -1,6 +1,10 @@
+#ifdef USE_HOSTCC		/* tools/bunzip2bench */
+#define CONFIG_BZIP2
+#else
 #include <config.h>
 #include <common.h>
 #include <watchdog.h>
+#endif
 #ifdef CONFIG_BZIP2
 
 /*
@@ -573,6 +577,8 @@ int BZ_API(BZ2_bzDecompressInit)
    s->ll4                   = NULL;
    s->ll16                  = NULL;
    s->tt                    = NULL;
+   s->ttWork                = NULL;
+   s->ttWorkSize            = 0;
    s->currBlockNo           = 0;
    s->verbosity             = verbosity;
 
@@ -888,6 +894,29 @@ int BZ_API(BZ2_bzDecompress) ( bz_stream *strm )
 }
 
 
+/*---------------------------------------------------*/
+int BZ_API(BZ2_bzDecompressWorkspace)
+		     ( bz_stream*   strm,
+		       void*        buf,
+		       unsigned int size )
+{
+   DState* s;
+   unsigned int align;
+   if (strm == NULL) return BZ_PARAM_ERROR;
+   s = strm->state;
+   if (s == NULL) return BZ_PARAM_ERROR;
+   if (s->strm != strm) return BZ_PARAM_ERROR;
+   if (s->state != BZ_X_MAGIC_1) return BZ_SEQUENCE_ERROR;
+
+   /* tt is words */
+   align = (4 - ((unsigned long)buf & 3)) & 3;
+   if (buf == NULL || size < align) return BZ_PARAM_ERROR;
+   s->ttWork     = (UInt32*)((char*)buf + align);
+   s->ttWorkSize = size - align;
+   return BZ_OK;
+}
+
+
 /*---------------------------------------------------*/
 int BZ_API(BZ2_bzDecompressEnd)  ( bz_stream *strm )
 {
@@ -897,7 +926,7 @@ int BZ_API(BZ2_bzDecompressEnd)  ( bz_stream *strm )
    if (s == NULL) return BZ_PARAM_ERROR;
    if (s->strm != strm) return BZ_PARAM_ERROR;
 
-   if (s->tt   != NULL) BZFREE(s->tt);
+   if (s->tt   != NULL && s->tt != s->ttWork) BZFREE(s->tt);
    if (s->ll16 != NULL) BZFREE(s->ll16);
    if (s->ll4  != NULL) BZFREE(s->ll4);
 
@@ -1325,25 +1354,26 @@ int BZ_API(BZ2_bzBuffToBuffCompress)
 #endif /* BZ_NO_COMPRESS */
 
 /*---------------------------------------------------*/
-int BZ_API(BZ2_bzBuffToBuffDecompress)
-			   ( char*         dest,
-			     unsigned int* destLen,
-			     char*         source,
-			     unsigned int  sourceLen,
-			     int           small,
-			     int           verbosity )
+static
+int buffToBuffDecompress ( char*         dest,
+			   unsigned int* destLen,
+			   char*         source,
+			   unsigned int  sourceLen,
+			   int           small,
+			   int           verbosity,
+			   char*         work,
+			   unsigned int  workLen )
 {
    bz_stream strm;
    int ret;
 
-   if (destLen == NULL || source == NULL)
-	  return BZ_PARAM_ERROR;
-
    strm.bzalloc = NULL;
    strm.bzfree = NULL;
    strm.opaque = NULL;
    ret = BZ2_bzDecompressInit ( &strm, verbosity, small );
    if (ret != BZ_OK) return ret;
+   if (work != NULL)
+      BZ2_bzDecompressWorkspace ( &strm, work, workLen );
 
    strm.next_in = source;
    strm.next_out = dest;
@@ -1374,6 +1404,55 @@ int BZ_API(BZ2_bzBuffToBuffDecompress)
 }
 
 
+/*---------------------------------------------------*/
+/*--
+   U-Boot: dest is usually far bigger than what comes out (bootm gives
+   it CFG_BOOTM_LEN), so the fast decoder's tt is put at its top, clear
+   of source, rather than malloc'ed: that needs 3.6MB for a -9 file,
+   more than most boards have to malloc, and the small decoder, which
+   needs 2.25MB, is several times slower.  Only if the output reaches
+   tt is it done again the usual way.
+--*/
+int BZ_API(BZ2_bzBuffToBuffDecompress)
+			   ( char*         dest,
+			     unsigned int* destLen,
+			     char*         source,
+			     unsigned int  sourceLen,
+			     int           small,
+			     int           verbosity )
+{
+   unsigned long d, src, tt, need;
+   unsigned int len;
+   int ret;
+
+   if (destLen == NULL || source == NULL)
+	  return BZ_PARAM_ERROR;
+
+   if (sourceLen > 3 && source[3] >= BZ_HDR_0 + 1 &&
+       source[3] <= BZ_HDR_0 + 9) {
+      need = (source[3] - BZ_HDR_0) * 100000 * sizeof(UInt32);
+      d = (unsigned long)dest;
+      src = (unsigned long)source;
+      tt = (d + *destLen - need) & ~3UL;
+      if (tt < src + sourceLen && src < tt + need)
+	 tt = (src - need) & ~3UL;		/* below it then */
+      if (*destLen >= need && tt >= d && tt <= d + *destLen - need &&
+	  (tt + need <= src || tt >= src + sourceLen)) {
+	 len = tt - d;
+	 ret = buffToBuffDecompress ( dest, &len, source, sourceLen,
+				      small, verbosity, (char*)tt, need );
+	 if (ret != BZ_OUTBUFF_FULL) {
+	    if (ret == BZ_OK) *destLen = len;
+	    return ret;
+	 }
+      }
+   }
+
+   return buffToBuffDecompress ( dest, destLen, source, sourceLen,
+				 small, verbosity, NULL, 0 );
+}
+
+
 /*---------------------------------------------------*/
 /*--
    Code contributed by Yoshioka Tsuneo
@@ -1,4 +1,8 @@
+#ifdef USE_HOSTCC		/* tools/bunzip2bench */
+#define CONFIG_BZIP2
+#else
 #include <config.h>
+#endif
 #ifdef CONFIG_BZIP2
 
 /*-------------------------------------------------------------*/
@@ -1,6 +1,10 @@
+#ifdef USE_HOSTCC		/* tools/bunzip2bench */
+#define CONFIG_BZIP2
+#else
 #include <config.h>
 #include <common.h>
 #include <watchdog.h>
+#endif
 #ifdef CONFIG_BZIP2
 
 /*-------------------------------------------------------------*/
@@ -115,6 +119,13 @@ void makeMaps_d ( DState* s )
    GET_BITS(lll,uuu,1)
 
 /*---------------------------------------------------*/
+/*--
+   The bit buffer is topped up to more than 24 bits while there is
+   input, and a code of up to BZ_LOOKUP_BITS bits is then decoded with
+   one lookup.  Longer codes, and the last few before the input runs
+   out, go the old way, a bit at a time.  The top-up never reads past
+   the stream: its end marker and CRC follow the last code.
+--*/
 #define GET_MTF_VAL(label1,label2,lval)           \
 {                                                 \
    if (groupPos == 0) {                           \
@@ -127,22 +138,45 @@ void makeMaps_d ( DState* s )
       gLimit = &(s->limit[gSel][0]);              \
       gPerm = &(s->perm[gSel][0]);                \
       gBase = &(s->base[gSel][0]);                \
+      gLookup = &(s->lookup[gSel][0]);            \
    }                                              \
    groupPos--;                                    \
-   zn = gMinlen;                                  \
-   GET_BITS(label1, zvec, zn);                    \
-   while (1) {                                    \
-      if (zn > 20 /* the longest code */)         \
+   while (s->bsLive <= 24 && strm->avail_in > 0) {\
+      s->bsBuff                                   \
+	 = (s->bsBuff << 8) |                     \
+	   ((UInt32)                              \
+	      (*((UChar*)(strm->next_in))));      \
+      s->bsLive += 8;                             \
+      strm->next_in++;                            \
+      strm->avail_in--;                           \
+      strm->total_in_lo32++;                      \
+      if (strm->total_in_lo32 == 0)               \
+	 strm->total_in_hi32++;                   \
+   }                                              \
+   zl = 0;                                        \
+   if (s->bsLive >= BZ_LOOKUP_BITS)               \
+      zl = gLookup[(s->bsBuff >>                  \
+		    (s->bsLive - BZ_LOOKUP_BITS)) \
+		   & ((1 << BZ_LOOKUP_BITS) - 1)];\
+   if (zl != 0) {                                 \
+      s->bsLive -= zl >> 9;                       \
+      lval = zl & 0x1ff;                          \
+   } else {                                       \
+      zn = gMinlen;                               \
+      GET_BITS(label1, zvec, zn);                 \
+      while (1) {                                 \
+	 if (zn > 20 /* the longest code */)      \
+	    RETURN(BZ_DATA_ERROR);                \
+	 if (zvec <= gLimit[zn]) break;           \
+	 zn++;                                    \
+	 GET_BIT(label2, zj);                     \
+	 zvec = (zvec << 1) | zj;                 \
+      };                                          \
+      if (zvec - gBase[zn] < 0                    \
+	  || zvec - gBase[zn] >= BZ_MAX_ALPHA_SIZE)\
 	 RETURN(BZ_DATA_ERROR);                   \
-      if (zvec <= gLimit[zn]) break;              \
-      zn++;                                       \
-      GET_BIT(label2, zj);                        \
-      zvec = (zvec << 1) | zj;                    \
-   };                                             \
-   if (zvec - gBase[zn] < 0                       \
-       || zvec - gBase[zn] >= BZ_MAX_ALPHA_SIZE)  \
-      RETURN(BZ_DATA_ERROR);                      \
-   lval = gPerm[zvec - gBase[zn]];                \
+      lval = gPerm[zvec - gBase[zn]];             \
+   }                                              \
 }
 
 
@@ -179,6 +213,10 @@ Int32 BZ2_decompress ( DState* s )
    Int32* gLimit;
    Int32* gBase;
    Int32* gPerm;
+   UInt16* gLookup;
+
+   /* not kept across calls */
+   UInt32 zl;
 
    if (s->state == BZ_X_MAGIC_1) {
       /*initialise the save area*/
@@ -206,6 +244,7 @@ Int32 BZ2_decompress ( DState* s )
       s->save_gLimit      = NULL;
       s->save_gBase       = NULL;
       s->save_gPerm       = NULL;
+      s->save_gLookup     = NULL;
    }
 
    /*restore from the save area*/
@@ -233,6 +272,7 @@ Int32 BZ2_decompress ( DState* s )
    gLimit      = s->save_gLimit;
    gBase       = s->save_gBase;
    gPerm       = s->save_gPerm;
+   gLookup     = s->save_gLookup;
 
    retVal = BZ_OK;
 
@@ -252,7 +292,11 @@ Int32 BZ2_decompress ( DState* s )
 	  s->blockSize100k > (BZ_HDR_0 + 9)) RETURN(BZ_DATA_ERROR_MAGIC);
       s->blockSize100k -= BZ_HDR_0;
 
-      if (s->smallDecompress) {
+      if (s->ttWork != NULL &&
+	  s->ttWorkSize >= s->blockSize100k * 100000 * sizeof(UInt32)) {
+	 s->tt = s->ttWork;
+	 s->smallDecompress = False;
+      } else if (s->smallDecompress) {
 	 s->ll16 = BZALLOC( s->blockSize100k * 100000 * sizeof(UInt16) );
 	 s->ll4  = BZALLOC(
 		      ((1 + s->blockSize100k * 100000) >> 1) * sizeof(UChar)
@@ -388,6 +432,13 @@ Int32 BZ2_decompress ( DState* s )
 	    minLen, maxLen, alphaSize
 	 );
 	 s->minLens[t] = minLen;
+	 BZ2_hbCreateLookupTable (
+	    &(s->lookup[t][0]),
+	    &(s->limit[t][0]),
+	    &(s->base[t][0]),
+	    &(s->perm[t][0]),
+	    minLen
+	 );
       }
 
       /*--- Now the MTF values ---*/
@@ -665,6 +716,7 @@ Int32 BZ2_decompress ( DState* s )
    s->save_gLimit      = gLimit;
    s->save_gBase       = gBase;
    s->save_gPerm       = gPerm;
+   s->save_gLookup     = gLookup;
 
    return retVal;
 }
@@ -1,4 +1,8 @@
+#ifdef USE_HOSTCC		/* tools/bunzip2bench */
+#define CONFIG_BZIP2
+#else
 #include <config.h>
+#endif
 #ifdef CONFIG_BZIP2
 
 /*-------------------------------------------------------------*/
@@ -225,6 +229,35 @@ void BZ2_hbCreateDecodeTables ( Int32 *limit,
 }
 
 
+/*---------------------------------------------------*/
+/*--
+   Fill lookup with what GET_MTF_VAL in decompress.c would decode from
+   each BZ_LOOKUP_BITS bit value, using the tables made above: the
+   symbol and its length, or 0 where that needs more bits (or fails).
+--*/
+void BZ2_hbCreateLookupTable ( UInt16 *lookup,
+			       Int32 *limit,
+			       Int32 *base,
+			       Int32 *perm,
+			       Int32 minLen )
+{
+   Int32 i, n, v;
+
+   for (i = 0; i < (1 << BZ_LOOKUP_BITS); i++) {
+      lookup[i] = 0;
+      for (n = minLen; n <= BZ_LOOKUP_BITS; n++) {
+	 v = i >> (BZ_LOOKUP_BITS - n);
+	 if (v <= limit[n]) {
+	    v -= base[n];
+	    if (v >= 0 && v < BZ_MAX_ALPHA_SIZE)
+	       lookup[i] = (UInt16)(perm[v] | (n << 9));
+	    break;
+	 }
+      }
+   }
+}
+
+
 /*-------------------------------------------------------------*/
 /*--- end                                         huffman.c ---*/
 /*-------------------------------------------------------------*/
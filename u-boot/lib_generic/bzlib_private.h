@@ -370,6 +370,13 @@ BZ2_hbMakeCodeLengths ( UChar*, Int32*, Int32, Int32 );
 #define MTFL_SIZE 16
 
 
+/*-- Huffman codes of up to this many bits decode with one table
+     lookup; entries are the symbol | the length << 9, 0 for longer
+     codes, which are decoded a bit at a time. --*/
+
+#define BZ_LOOKUP_BITS 10
+
+
 /*-- Structure holding all the decompression-side stuff. --*/
 
 typedef
@@ -408,6 +415,10 @@ typedef
       /* for undoing the Burrows-Wheeler transform (FAST) */
       UInt32   *tt;
 
+      /* the caller's memory for tt, from BZ2_bzDecompressWorkspace */
+      UInt32   *ttWork;
+      UInt32   ttWorkSize;
+
       /* for undoing the Burrows-Wheeler transform (SMALL) */
       UInt16   *ll16;
       UChar    *ll4;
@@ -435,6 +446,7 @@ typedef
       Int32    base   [BZ_N_GROUPS][BZ_MAX_ALPHA_SIZE];
       Int32    perm   [BZ_N_GROUPS][BZ_MAX_ALPHA_SIZE];
       Int32    minLens[BZ_N_GROUPS];
+      UInt16   lookup [BZ_N_GROUPS][1 << BZ_LOOKUP_BITS];
 
       /* save area for scalars in the main decompress code */
       Int32    save_i;
@@ -461,6 +473,7 @@ typedef
       Int32*   save_gLimit;
       Int32*   save_gBase;
       Int32*   save_gPerm;
+      UInt16*  save_gLookup;
 
    }
    DState;
@@ -512,6 +525,9 @@ extern void
 BZ2_hbCreateDecodeTables ( Int32*, Int32*, Int32*, UChar*,
 			   Int32,  Int32, Int32 );
 
+extern void
+BZ2_hbCreateLookupTable ( UInt16*, Int32*, Int32*, Int32*, Int32 );
+
 
 #endif
 
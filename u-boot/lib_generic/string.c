@@ -19,6 +19,7 @@
 #include <linux/string.h>
 #include <linux/ctype.h>
 #include <malloc.h>
+#include <memops.h>
 
 
 #if 0 /* not used - was: #ifndef __HAVE_ARCH_STRNICMP */
@@ -403,12 +404,7 @@ char *strswab(const char *s)
  */
 void * memset(void * s,int c,size_t count)
 {
-	char *xs = (char *) s;
-
-	while (count--)
-		*xs++ = c;
-
-	return s;
+	return memops_fill(s, c, count);
 }
 #endif
 
@@ -448,12 +444,7 @@ char * bcopy(const char * src, char * dest, int count)
  */
 void * memcpy(void * dest,const void *src,size_t count)
 {
-	char *tmp = (char *) dest, *s = (char *) src;
-
-	while (count--)
-		*tmp++ = *s++;
-
-	return dest;
+	return memops_copy(dest, src, count);
 }
 #endif
 
@@ -468,22 +459,10 @@ void * memcpy(void * dest,const void *src,size_t count)
  */
 void * memmove(void * dest,const void *src,size_t count)
 {
-	char *tmp, *s;
+	if (dest <= src || (char *) dest >= (char *) src + count)
+		return memops_copy(dest, src, count);
 
-	if (dest <= src) {
-		tmp = (char *) dest;
-		s = (char *) src;
-		while (count--)
-			*tmp++ = *s++;
-		}
-	else {
-		tmp = (char *) dest + count;
-		s = (char *) src + count;
-		while (count--)
-			*--tmp = *--s;
-		}
-
-	return dest;
+	return memops_copy_down(dest, src, count);
 }
 #endif
 
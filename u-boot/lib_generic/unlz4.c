@@ -0,0 +1,32 @@
+/*
+ * lz4_decompress(), for LZ4 compressed uImages (IH_COMP_LZ4).
+ * The decompressor is include/unlz4.h, shared with qi.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ */
+
+#include <config.h>
+#include <common.h>
+#ifdef CONFIG_LZ4
+
+#include <unlz4.h>
+
+/*
+ * Decompress the lz4 file at src, *lenp bytes, to dst, which has room
+ * for dstlen; *lenp is set to the decompressed size.  Like gunzip(),
+ * returns 0, or -1 for bad data or data that does not fit.
+ */
+int lz4_decompress(void *dst, ulong dstlen, const uchar *src, ulong *lenp)
+{
+	size_t len = dstlen;
+
+	if (unlz4(src, *lenp, dst, &len))
+		return -1;
+	*lenp = len;
+	return 0;
+}
+
+#endif /* CONFIG_LZ4 */
@@ -0,0 +1,33 @@
+/*
+ * lzop_decompress(), for LZO compressed uImages (IH_COMP_LZO).
+ * The decompressor is include/unlzo.h, shared with qi.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ */
+
+#include <config.h>
+#include <common.h>
+#ifdef CONFIG_LZO
+
+#include <unlzo.h>
+
+/*
+ * Decompress the lzop file at src, *lenp bytes, to dst, which has room
+ * for dstlen; *lenp is set to the decompressed size.  Like gunzip(),
+ * returns 0, or an LZO_E error.
+ */
+int lzop_decompress(void *dst, ulong dstlen, const uchar *src, ulong *lenp)
+{
+	size_t len = dstlen;
+	int r;
+
+	r = unlzop(src, *lenp, dst, &len);
+	if (r == LZO_E_OK)
+		*lenp = len;
+	return r;
+}
+
+#endif /* CONFIG_LZO */
@@ -0,0 +1,288 @@
+/*
+ * bunzip2bench: check and time the bzip2 decoder of lib_generic/bzlib*.c
+ *
+ * Each bzip2 file is unpacked the way bootm does it, with
+ * BZ2_bzBuffToBuffDecompress() into a buffer with room to spare (which
+ * puts the fast decoder's work area at its top), and the block and
+ * stream CRCs in the file are checked as it goes.  Then it is unpacked
+ * again and compared:
+ *  - with the fast decoder's tt malloc'ed, and with the small decoder
+ *  - with a work area from BZ2_bzDecompressWorkspace(), as bootdev does
+ *  - in random small pieces of input and output, so that every state
+ *    of BZ2_decompress() gets interrupted, also mid Huffman code
+ *  - into a buffer too small for the work area, which has to fall
+ *    back to malloc
+ *  - with random bytes of the input corrupted, which only has to fail
+ *    cleanly (run it under valgrind or -fsanitize=address for that)
+ * and the bootm call is timed (with room for the work area), against
+ * the small decoder.
+ *
+ *   bunzip2bench [-r rounds] file.bz2...
+ *
+ * Not built by default: "make tools/bunzip2bench".
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "bzlib.h"
+
+#define WORK_LEN	(900000 * 4)	/* tt for -9 */
+
+/* what U-Boot has in cmd_bootm.c */
+void bz_internal_error(int errcode)
+{
+	fprintf(stderr, "BZIP2 internal error %d\n", errcode);
+	exit(1);
+}
+
+static int init(bz_stream *s, int small, void *work)
+{
+	int r;
+
+	memset(s, 0, sizeof(*s));
+	r = BZ2_bzDecompressInit(s, 0, small);
+	if (r == BZ_OK && work)
+		r = BZ2_bzDecompressWorkspace(s, work, WORK_LEN);
+	return r;
+}
+
+/* unpack all of src into dst in one call; returns the length or -1 */
+static long bunzip_once(int small, void *work, char *src, unsigned int srclen,
+			char *dst, unsigned int dstlen)
+{
+	bz_stream s;
+	int r;
+
+	if (init(&s, small, work) != BZ_OK)
+		return -1;
+	s.next_in = src;
+	s.avail_in = srclen;
+	s.next_out = dst;
+	s.avail_out = dstlen;
+	r = BZ2_bzDecompress(&s);
+	BZ2_bzDecompressEnd(&s);
+	if (r != BZ_STREAM_END)
+		return -1;
+	return s.next_out - dst;
+}
+
+/* the same, but a random few bytes of input and output at a time */
+static long bunzip_pieces(int small, void *work, char *src,
+			  unsigned int srclen, char *dst, unsigned int dstlen)
+{
+	bz_stream s;
+	unsigned int in = 0, out = 0, n;
+	int r = BZ_OK, stuck = 0;
+
+	if (init(&s, small, work) != BZ_OK)
+		return -1;
+	s.next_in = src;
+	s.next_out = dst;
+	while (r == BZ_OK) {
+		n = 1 + rand() % (rand() & 1 ? 3 : 600);
+		if (n > srclen - in)
+			n = srclen - in;
+		s.avail_in = n;
+		n = 1 + rand() % (rand() & 1 ? 5 : 70000);
+		if (n > dstlen - out)
+			n = dstlen - out;
+		s.avail_out = n;
+		r = BZ2_bzDecompress(&s);
+		stuck = s.next_in - src == in && s.next_out - dst == out ?
+			stuck + 1 : 0;
+		in = s.next_in - src;
+		out = s.next_out - dst;
+		if (stuck > 100)
+			break;
+	}
+	BZ2_bzDecompressEnd(&s);
+	if (r != BZ_STREAM_END)
+		return -1;
+	return out;
+}
+
+/* as bootm: returns the length or -1 */
+static long bunzip_bootm(char *src, unsigned int srclen,
+			 char *dst, unsigned int dstlen)
+{
+	unsigned int len = dstlen;
+
+	if (BZ2_bzBuffToBuffDecompress(dst, &len, src, srclen, 1, 0) != BZ_OK)
+		return -1;
+	return len;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static char *read_file(const char *name, unsigned int *lenp)
+{
+	FILE *f = fopen(name, "rb");
+	char *buf;
+	long len;
+
+	if (!f) {
+		perror(name);
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	rewind(f);
+	buf = malloc(len);
+	if (!buf || fread(buf, 1, len, f) != (size_t)len) {
+		perror(name);
+		fclose(f);
+		free(buf);
+		return NULL;
+	}
+	fclose(f);
+	*lenp = len;
+	return buf;
+}
+
+static int bench(const char *name, unsigned int rounds)
+{
+	char *bz, *want, *got, *bad, *work;
+	unsigned int bzlen, size, room, i;
+	long n;
+	int errors = 0, failed;
+	double t, ts;
+
+	bz = read_file(name, &bzlen);
+	if (!bz)
+		return 1;
+	if (bzlen < 14 || memcmp(bz, "BZh", 3)) {
+		fprintf(stderr, "%s: not a bzip2 file\n", name);
+		return 1;
+	}
+
+	/* room for it and the work area, as CFG_BOOTM_LEN would have */
+	room = 8 * 1024 * 1024;
+	for (;;) {
+		want = malloc(room);
+		if (!want) {
+			perror("malloc");
+			return 1;
+		}
+		n = bunzip_bootm(bz, bzlen, want, room);
+		if (n >= 0 || room > 1024 * 1024 * 1024)
+			break;
+		free(want);
+		room *= 2;
+	}
+	if (n < 0) {
+		fprintf(stderr, "%s: bad bzip2 data\n", name);
+		return 1;
+	}
+	size = n;
+	if (room < size + WORK_LEN + 4)
+		room = size + WORK_LEN + 4;
+
+	got = malloc(room);
+	bad = malloc(bzlen);
+	work = malloc(WORK_LEN);
+	if (!got || !bad || !work) {
+		perror("malloc");
+		return 1;
+	}
+
+	n = bunzip_once(0, NULL, bz, bzlen, got, size + 1);
+	if (n != size || memcmp(got, want, size)) {
+		fprintf(stderr, "%s: fast: %ld bytes\n", name, n);
+		errors++;
+	}
+	n = bunzip_once(1, NULL, bz, bzlen, got, size + 1);
+	if (n != size || memcmp(got, want, size)) {
+		fprintf(stderr, "%s: small: %ld bytes\n", name, n);
+		errors++;
+	}
+	n = bunzip_once(1, work, bz, bzlen, got, size + 1);
+	if (n != size || memcmp(got, want, size)) {
+		fprintf(stderr, "%s: work area: %ld bytes\n", name, n);
+		errors++;
+	}
+
+	srand(1);
+	for (i = 0; i < 8; i++) {
+		memset(got, 0, size);
+		n = bunzip_pieces(i & 1, i & 2 ? work : NULL, bz, bzlen,
+				  got, size);
+		if (n != size || memcmp(got, want, size)) {
+			fprintf(stderr, "%s: in pieces, try %u: %ld bytes%s\n",
+				name, i, n, n == size ? " that differ" : "");
+			errors++;
+		}
+	}
+
+	/* too little room to put the work area above the output */
+	n = bunzip_bootm(bz, bzlen, got, size + 1);
+	if (n != size || memcmp(got, want, size)) {
+		fprintf(stderr, "%s: no room for the work area: %ld bytes\n",
+			name, n);
+		errors++;
+	}
+	if (size && bunzip_bootm(bz, bzlen, got, size - 1) >= 0) {
+		fprintf(stderr, "%s: output too big not caught\n", name);
+		errors++;
+	}
+
+	/* corrupted data must fail or at least stay inside the buffers */
+	failed = 0;
+	for (i = 0; i < 200; i++) {
+		memcpy(bad, bz, bzlen);
+		n = 1 + rand() % 4;
+		while (n--)
+			bad[rand() % bzlen] ^= 1 << (rand() % 8);
+		if (bunzip_once(i & 1, i & 2 ? work : NULL, bad, bzlen,
+				got, size + 1) != size ||
+		    memcmp(got, want, size))
+			failed++;
+	}
+
+	t = now();
+	for (i = 0; i < rounds; i++)
+		n = bunzip_bootm(bz, bzlen, got, room);
+	t = now() - t;
+	ts = now();
+	for (i = 0; i < rounds; i++)
+		n = bunzip_once(1, NULL, bz, bzlen, got, size);
+	ts = now() - ts;
+
+	printf("%-24s %9u -> %9u  %6.1f MB/s (small %5.1f)  "
+	       "%u/200 corrupted caught%s\n",
+	       name, bzlen, size, (double)size * rounds / t / (1024 * 1024),
+	       (double)size * rounds / ts / (1024 * 1024),
+	       failed, errors ? "  FAILED" : "");
+
+	free(bz);
+	free(want);
+	free(got);
+	free(bad);
+	free(work);
+	return errors != 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int rounds = 5;
+	int i = 1, errors = 0;
+
+	if (argc > 2 && !strcmp(argv[1], "-r")) {
+		rounds = atoi(argv[2]);
+		i = 3;
+	}
+	if (i >= argc || !rounds) {
+		fprintf(stderr, "usage: %s [-r rounds] file.bz2...\n", argv[0]);
+		return 2;
+	}
+	for (; i < argc; i++)
+		errors += bench(argv[i], rounds);
+	return errors != 0;
+}
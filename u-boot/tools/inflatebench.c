@@ -0,0 +1,286 @@
+/*
+ * inflatebench: check and time the inflate of lib_generic/zlib.c
+ *
+ * Each gzip file is inflated the way gunzip() in cmd_bootm.c does it, in
+ * one Z_FINISH call, and the result checked against the CRC-32 and
+ * length in the gzip trailer.  Then it is inflated again:
+ *  - in random small pieces of input and output, so every state of
+ *    inflate() gets interrupted and matches come out of the window
+ *  - with a zlib header and adler32 check around it instead, as cramfs
+ *    has them
+ *  - with random bytes of the input corrupted, which only has to fail
+ *    cleanly (run it under valgrind or -fsanitize=address for that)
+ * and the one call inflate is timed.
+ *
+ *   inflatebench [-r rounds] file.gz...
+ *
+ * Not built by default: "make tools/inflatebench".
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "zlib.h"
+
+unsigned long crc32(unsigned long, const unsigned char *, unsigned int);
+
+#define HEAD_CRC	2
+#define EXTRA_FIELD	4
+#define ORIG_NAME	8
+#define COMMENT		0x10
+
+static void *zalloc(void *x, unsigned items, unsigned size)
+{
+	return malloc(items * size);
+}
+
+static void zfree(void *x, void *addr, unsigned nb)
+{
+	free(addr);
+}
+
+/* start of the deflate data in a gzip file, or 0 */
+static unsigned int gzip_skip(const unsigned char *src, unsigned int len)
+{
+	unsigned int i = 10;
+	int flags;
+
+	if (len < 18 || src[0] != 0x1f || src[1] != 0x8b || src[2] != 8)
+		return 0;
+	flags = src[3];
+	if (flags & EXTRA_FIELD)
+		i = 12 + src[10] + (src[11] << 8);
+	if (flags & ORIG_NAME)
+		while (i < len && src[i++] != 0)
+			;
+	if (flags & COMMENT)
+		while (i < len && src[i++] != 0)
+			;
+	if (flags & HEAD_CRC)
+		i += 2;
+	return i < len - 8 ? i : 0;
+}
+
+static unsigned int get_le32(const unsigned char *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+}
+
+static int init(z_stream *s, int w)
+{
+	memset(s, 0, sizeof(*s));
+	s->zalloc = zalloc;
+	s->zfree = zfree;
+	s->outcb = Z_NULL;
+	return w ? inflateInit2(s, w) : inflateInit(s);
+}
+
+/* inflate all of src into dst in one call; returns the length or -1 */
+static long inflate_once(int w, unsigned char *src, unsigned int srclen,
+			 unsigned char *dst, unsigned int dstlen)
+{
+	z_stream s;
+	int r;
+
+	if (init(&s, w) != Z_OK)
+		return -1;
+	s.next_in = src;
+	s.avail_in = srclen;
+	s.next_out = dst;
+	s.avail_out = dstlen;
+	r = inflate(&s, Z_FINISH);
+	inflateEnd(&s);
+	if (r != Z_STREAM_END)
+		return -1;
+	return s.next_out - dst;
+}
+
+/* the same, but a random few bytes of input and output at a time */
+static long inflate_pieces(int w, unsigned char *src, unsigned int srclen,
+			   unsigned char *dst, unsigned int dstlen)
+{
+	z_stream s;
+	unsigned int in = 0, out = 0, n;
+	int r = Z_OK, stuck = 0;
+
+	if (init(&s, w) != Z_OK)
+		return -1;
+	s.next_in = src;
+	s.next_out = dst;
+	while (r == Z_OK || r == Z_BUF_ERROR) {
+		n = 1 + rand() % (rand() & 1 ? 7 : 600);
+		if (n > srclen - in)
+			n = srclen - in;
+		s.avail_in = n;
+		n = 1 + rand() % (rand() & 1 ? 5 : 70000);
+		if (n > dstlen - out)
+			n = dstlen - out;
+		s.avail_out = n;
+		r = inflate(&s, Z_NO_FLUSH);
+		in = s.next_in - src;
+		out = s.next_out - dst;
+		stuck = r == Z_BUF_ERROR ? stuck + 1 : 0;
+		if (stuck > 100)
+			break;
+	}
+	inflateEnd(&s);
+	if (r != Z_STREAM_END)
+		return -1;
+	return out;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static unsigned char *read_file(const char *name, unsigned int *lenp)
+{
+	FILE *f = fopen(name, "rb");
+	unsigned char *buf;
+	long len;
+
+	if (!f) {
+		perror(name);
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	rewind(f);
+	buf = malloc(len);
+	if (!buf || fread(buf, 1, len, f) != (size_t)len) {
+		perror(name);
+		fclose(f);
+		free(buf);
+		return NULL;
+	}
+	fclose(f);
+	*lenp = len;
+	return buf;
+}
+
+static int bench(const char *name, unsigned int rounds)
+{
+	unsigned char *gz, *raw, *want, *got, *bad;
+	unsigned int gzlen, rawlen, size, crc, adler, i;
+	long n;
+	int errors = 0, failed;
+	double t;
+
+	gz = read_file(name, &gzlen);
+	if (!gz)
+		return 1;
+	i = gzip_skip(gz, gzlen);
+	if (!i) {
+		fprintf(stderr, "%s: not a gzip file\n", name);
+		return 1;
+	}
+	raw = gz + i;
+	rawlen = gzlen - 8 - i;
+	crc = get_le32(gz + gzlen - 8);
+	size = get_le32(gz + gzlen - 4);
+
+	want = malloc(size + 1);
+	got = malloc(size + 1);
+	bad = malloc(rawlen);
+	if (!want || !got || !bad) {
+		perror("malloc");
+		return 1;
+	}
+
+	n = inflate_once(-MAX_WBITS, raw, rawlen, want, size + 1);
+	if (n != size || crc32(0, want, size) != crc) {
+		fprintf(stderr, "%s: inflate gave %ld bytes, crc %08lx; "
+			"want %u, %08x\n", name, n,
+			n < 0 ? 0 : crc32(0, want, n), size, crc);
+		return 1;
+	}
+
+	srand(1);
+	for (i = 0; i < 8; i++) {
+		memset(got, 0, size);
+		n = inflate_pieces(-MAX_WBITS, raw, rawlen, got, size);
+		if (n != size || memcmp(got, want, size)) {
+			fprintf(stderr, "%s: in pieces, try %u: %ld bytes%s\n",
+				name, i, n, n == size ? " that differ" : "");
+			errors++;
+		}
+	}
+
+	/* wrap the same deflate data as zlib would: 78 9c ... adler32 */
+	adler = adler32(adler32(0, Z_NULL, 0), want, size);
+	raw -= 2;
+	raw[0] = 0x78;
+	raw[1] = 0x9c;
+	raw[rawlen + 2] = adler >> 24;
+	raw[rawlen + 3] = adler >> 16;
+	raw[rawlen + 4] = adler >> 8;
+	raw[rawlen + 5] = adler;
+	n = inflate_once(0, raw, rawlen + 6, got, size + 1);
+	if (n != size || memcmp(got, want, size)) {
+		fprintf(stderr, "%s: with zlib header: %ld bytes\n", name, n);
+		errors++;
+	}
+	n = inflate_pieces(0, raw, rawlen + 6, got, size);
+	if (n != size || memcmp(got, want, size)) {
+		fprintf(stderr, "%s: zlib header, pieces: %ld bytes\n",
+			name, n);
+		errors++;
+	}
+	raw[rawlen + 5] ^= 1;
+	if (inflate_once(0, raw, rawlen + 6, got, size + 1) >= 0) {
+		fprintf(stderr, "%s: bad adler32 not caught\n", name);
+		errors++;
+	}
+	raw[rawlen + 5] ^= 1;
+	raw += 2;
+
+	/* corrupted data must fail or at least stay inside the buffers */
+	failed = 0;
+	for (i = 0; i < 200; i++) {
+		memcpy(bad, raw, rawlen);
+		n = 1 + rand() % 4;
+		while (n--)
+			bad[rand() % rawlen] ^= 1 << (rand() % 8);
+		if (inflate_once(-MAX_WBITS, bad, rawlen, got, size + 1) != size ||
+		    memcmp(got, want, size))
+			failed++;
+	}
+
+	t = now();
+	for (i = 0; i < rounds; i++)
+		n = inflate_once(-MAX_WBITS, raw, rawlen, got, size + 1);
+	t = now() - t;
+
+	printf("%-24s %9u -> %9u  %8.1f MB/s  %u/200 corrupted caught%s\n",
+	       name, rawlen, size, (double)size * rounds / t / (1024 * 1024),
+	       failed, errors ? "  FAILED" : "");
+
+	free(gz);
+	free(want);
+	free(got);
+	free(bad);
+	return errors != 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int rounds = 20;
+	int i = 1, errors = 0;
+
+	if (argc > 2 && !strcmp(argv[1], "-r")) {
+		rounds = atoi(argv[2]);
+		i = 3;
+	}
+	if (i >= argc || !rounds) {
+		fprintf(stderr, "usage: %s [-r rounds] file.gz...\n", argv[0]);
+		return 2;
+	}
+	for (; i < argc; i++)
+		errors += bench(argv[i], rounds);
+	return errors != 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * membench: check and time the memcpy/memmove/memset bodies of
+ * include/memops.h
+ *
+ * Every combination of source and destination alignment and a spread of
+ * lengths is checked against plain byte loops, including the guard bytes
+ * either side, and memmove in both directions over overlapping areas.
+ * Then the byte loops, memops and the host's libc are timed copying and
+ * clearing a buffer of the given size, the way bootm moves a kernel.
+ *
+ *   membench [size_kb [rounds]]
+ *
+ * Not built by default: "make tools/membench".
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <memops.h>
+
+#define AREA	1024
+#define GUARD	32
+
+static void *byte_copy(void *dest, const void *src, size_t n)
+{
+	unsigned char *d = dest;
+	const unsigned char *s = src;
+
+	while (n--)
+		*d++ = *s++;
+	return dest;
+}
+
+static void *byte_move(void *dest, const void *src, size_t n)
+{
+	unsigned char *d = dest;
+	const unsigned char *s = src;
+
+	if (d <= s)
+		return byte_copy(dest, src, n);
+	d += n;
+	s += n;
+	while (n--)
+		*--d = *--s;
+	return dest;
+}
+
+static void *byte_fill(void *s, int c, size_t n)
+{
+	unsigned char *p = s;
+
+	while (n--)
+		*p++ = c;
+	return s;
+}
+
+static void *memops_move(void *dest, const void *src, size_t n)
+{
+	if (dest <= src || (char *)dest >= (char *)src + n)
+		return memops_copy(dest, src, n);
+	return memops_copy_down(dest, src, n);
+}
+
+static unsigned char src[AREA + 2 * GUARD];
+static unsigned char want[AREA + 2 * GUARD], got[AREA + 2 * GUARD];
+
+static void pattern(unsigned char *p, size_t n, unsigned int seed)
+{
+	while (n--) {
+		seed = seed * 1103515245 + 12345;
+		*p++ = seed >> 8;
+	}
+}
+
+static int compare(const char *what, size_t doff, size_t soff, size_t len)
+{
+	if (!memcmp(want, got, sizeof(got)))
+		return 0;
+	fprintf(stderr, "%s: dest +%u src +%u len %u differs\n", what,
+		(unsigned int)doff, (unsigned int)soff, (unsigned int)len);
+	return 1;
+}
+
+static int check(void)
+{
+	static const size_t lens[] = {
+		0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64,
+		65, 100, 127, 128, 129, 255, 256, 257, 511, 512, 700, AREA - 16,
+	};
+	size_t doff, soff, l, len;
+	int errors = 0;
+
+	pattern(src, sizeof(src), 1);
+	for (doff = 0; doff < 16; doff++)
+	for (soff = 0; soff < 16; soff++)
+	for (l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+		len = lens[l];
+
+		/* memcpy between separate buffers */
+		pattern(want, sizeof(want), 2);
+		memcpy(got, want, sizeof(got));
+		byte_copy(want + GUARD + doff, src + GUARD + soff, len);
+		memops_copy(got + GUARD + doff, src + GUARD + soff, len);
+		errors += compare("memcpy", doff, soff, len);
+
+		/* memset */
+		pattern(want, sizeof(want), 3);
+		memcpy(got, want, sizeof(got));
+		byte_fill(want + GUARD + doff, 0xa5 + soff, len);
+		memops_fill(got + GUARD + doff, 0xa5 + soff, len);
+		errors += compare("memset", doff, soff, len);
+
+		/* memmove within one buffer, both directions */
+		if (len + 16 > AREA)
+			continue;
+		pattern(want, sizeof(want), 4);
+		memcpy(got, want, sizeof(got));
+		byte_move(want + GUARD + doff, want + GUARD + soff, len);
+		memops_move(got + GUARD + doff, got + GUARD + soff, len);
+		errors += compare("memmove", doff, soff, len);
+
+		if (errors > 10)
+			return 1;
+	}
+	return errors != 0;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void time_copy(const char *name,
+		      void *(*fn)(void *, const void *, size_t),
+		      unsigned char *d, const unsigned char *s, size_t size,
+		      unsigned int rounds)
+{
+	unsigned int i;
+	double t = now();
+
+	for (i = 0; i < rounds; i++)
+		fn(d, s, size);
+	t = now() - t;
+	printf("%-24s %8.1f MB/s\n", name,
+	       (double)size * rounds / t / (1024 * 1024));
+}
+
+static void time_fill(const char *name, void *(*fn)(void *, int, size_t),
+		      unsigned char *d, size_t size, unsigned int rounds)
+{
+	unsigned int i;
+	double t = now();
+
+	for (i = 0; i < rounds; i++)
+		fn(d, i, size);
+	t = now() - t;
+	printf("%-24s %8.1f MB/s\n", name,
+	       (double)size * rounds / t / (1024 * 1024));
+}
+
+int main(int argc, char **argv)
+{
+	size_t size = 4096;
+	unsigned int rounds = 16;
+	unsigned char *a, *b;
+
+	if (argc > 1)
+		size = atoi(argv[1]);
+	if (argc > 2)
+		rounds = atoi(argv[2]);
+	if (!size || !rounds) {
+		fprintf(stderr, "usage: %s [size_kb [rounds]]\n", argv[0]);
+		return 2;
+	}
+	size *= 1024;
+
+	if (check()) {
+		printf("FAILED\n");
+		return 1;
+	}
+	printf("memops agree with the byte loops\n");
+
+	a = malloc(size + 8);
+	b = malloc(size + 8);
+	if (!a || !b) {
+		perror("malloc");
+		return 1;
+	}
+	pattern(a, size + 8, 5);
+	memset(b, 0, size + 8);
+
+	time_copy("memcpy bytes", byte_copy, b, a, size, rounds);
+	time_copy("memcpy memops", memops_copy, b, a, size, rounds);
+	time_copy("memcpy memops, src+1", memops_copy, b, a + 1, size, rounds);
+	time_copy("memcpy libc", memcpy, b, a, size, rounds);
+	time_fill("memset bytes", byte_fill, b, size, rounds);
+	time_fill("memset memops", memops_fill, b, size, rounds);
+	time_fill("memset libc", memset, b, size, rounds);
+
+	free(a);
+	free(b);
+	return 0;
+}